@@ -0,0 +1,470 @@
+#include "pch.h"
+
+// Renders frames headless and reports frame time statistics as JSON on stdout.
+//
+// usage: vulkan-demo-2-benchmark [--flag value]...
+//
+// --frames, --warmup       measured and discarded frames
+// --width, --height        render extent
+// --draws                  test triangles drawn with one call each
+// --objects, --moving      batched objects, and how many move every frame
+// --materials, --spread    materials in use, and scale of the object grid
+// --frames-in-flight       frames the cpu may run ahead
+// --threads                job system workers
+// --output, --trace        JSON report file, Chrome trace of the measured frames
+// --texture, --mesh        KTX2 files to stream, mesh packer file for the pyramids
+// --async-compute 0|1      post process on the compute queue when there is one
+// --frame-budget, --min-scale  dynamic resolution target and lower bound
+// --shader-dir             load .spv files from there instead of the embedded ones
+// --capture 0|1, --capture-dir  read back every frame, and write it there
+
+namespace
+{
+    struct Options
+    {
+        uint32_t frames = 1000;
+        uint32_t warmup = 100;
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        uint32_t draws = 1;
+        uint32_t objects = 0;
+        uint32_t moving = 0;
+        uint32_t materials = 16;
+        float spread = 1.0f;
+        uint32_t frames_in_flight = 2;
+        // 0 uses one worker per spare hardware thread
+        uint32_t threads = 0;
+        std::string output;
+        std::string trace;
+        std::vector<std::string> textures;
+        std::string mesh;
+        bool async_compute = true;
+        // 0 renders at full resolution
+        double frame_budget_ms = 0.0;
+        float min_scale = 0.5f;
+        std::string shader_dir;
+        bool capture = false;
+        std::string capture_dir;
+    };
+
+    Options ParseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            std::string value = argv[++i];
+
+            if (arg == "--frames") options.frames = std::stoul(value);
+            else if (arg == "--warmup") options.warmup = std::stoul(value);
+            else if (arg == "--width") options.width = std::stoul(value);
+            else if (arg == "--height") options.height = std::stoul(value);
+            else if (arg == "--draws") options.draws = std::stoul(value);
+            else if (arg == "--objects") options.objects = std::stoul(value);
+            else if (arg == "--moving") options.moving = std::stoul(value);
+            else if (arg == "--materials") options.materials = std::stoul(value);
+            else if (arg == "--spread") options.spread = std::stof(value);
+            else if (arg == "--frames-in-flight") options.frames_in_flight = std::stoul(value);
+            else if (arg == "--threads") options.threads = std::stoul(value);
+            else if (arg == "--output") options.output = value;
+            else if (arg == "--trace") options.trace = value;
+            else if (arg == "--texture") options.textures.push_back(value);
+            else if (arg == "--mesh") options.mesh = value;
+            else if (arg == "--async-compute") options.async_compute = std::stoul(value) != 0;
+            else if (arg == "--frame-budget") options.frame_budget_ms = std::stod(value);
+            else if (arg == "--min-scale") options.min_scale = std::stof(value);
+            else if (arg == "--shader-dir") options.shader_dir = value;
+            else if (arg == "--capture") options.capture = std::stoul(value) != 0;
+            else if (arg == "--capture-dir") { options.capture_dir = value; options.capture = true; }
+            else throw std::runtime_error("Unknown argument: " + arg);
+        }
+        if (options.frames == 0)
+            throw std::runtime_error("--frames must be at least 1.");
+        if (options.materials == 0)
+            throw std::runtime_error("--materials must be at least 1.");
+        options.moving = std::min(options.moving, options.objects);
+        return options;
+    }
+
+    vk::Matrix4 GridTransform(uint32_t index, uint32_t count, float spread, float offset)
+    {
+        // lay the objects out on a square grid, a spread of 1 fills clip space
+        uint32_t side = (uint32_t)std::ceil(std::sqrt((double)count));
+        float cell = 2.0f * spread / side;
+        float x = -spread + cell * (index % side + 0.5f) + offset * cell;
+        float y = -spread + cell * (index / side + 0.5f);
+        float scale = cell * 0.4f;
+        return { scale, 0, 0, 0, 0, scale, 0, 0, 0, 0, scale, 0, x, y, 0.5f, 1 };
+    }
+
+    void CreateScene(vk::Renderer& renderer, const Options& options, std::vector<uint32_t>& objects, double& mesh_load_ms)
+    {
+        // unit cube with flat normals
+        std::vector<vk::Vertex> cube_vertices;
+        std::vector<uint32_t> cube_indices;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (float sign : { -1.0f, 1.0f })
+            {
+                uint32_t base = (uint32_t)cube_vertices.size();
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    float u = (corner & 1) ? 0.5f : -0.5f;
+                    float v = (corner & 2) ? 0.5f : -0.5f;
+                    vk::Vertex vertex{};
+                    vertex.position[axis] = 0.5f * sign;
+                    vertex.position[(axis + 1) % 3] = u;
+                    vertex.position[(axis + 2) % 3] = v;
+                    vertex.normal[axis] = sign;
+                    cube_vertices.push_back(vertex);
+                }
+                if (sign > 0)
+                    cube_indices.insert(cube_indices.end(), { base, base + 1, base + 2, base + 2, base + 1, base + 3 });
+                else
+                    cube_indices.insert(cube_indices.end(), { base, base + 2, base + 1, base + 1, base + 2, base + 3 });
+            }
+        }
+
+        // square pyramid, normals are approximate
+        std::vector<vk::Vertex> pyramid_vertices = {
+            { { -0.5f, 0.5f, -0.5f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+            { { 0.5f, 0.5f, -0.5f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+            { { 0.5f, 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+            { { -0.5f, 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+            { { 0.0f, -0.5f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f } },
+        };
+        std::vector<uint32_t> pyramid_indices = { 0, 2, 1, 0, 3, 2, 0, 1, 4, 1, 2, 4, 2, 3, 4, 3, 0, 4 };
+
+        uint32_t meshes[] = {
+            renderer.CreateMesh(cube_vertices, cube_indices),
+            renderer.CreateMesh(pyramid_vertices, pyramid_indices),
+        };
+
+        mesh_load_ms = 0.0;
+        if (!options.mesh.empty())
+        {
+            auto start = std::chrono::steady_clock::now();
+            meshes[1] = renderer.LoadMesh(options.mesh)[0];
+            mesh_load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::vector<uint32_t> materials;
+        for (uint32_t i = 0; i < options.materials; i++)
+        {
+            vk::Material material;
+            material.color[0] = (i % 4) / 3.0f;
+            material.color[1] = (i / 4 % 4) / 3.0f;
+            material.color[2] = 1.0f - (i % 7) / 6.0f;
+            material.double_sided = i % 4 == 3;
+            materials.push_back(renderer.CreateMaterial(material));
+        }
+
+        // interleave meshes and materials so that the renderer has to sort them
+        objects.reserve(options.objects);
+        for (uint32_t i = 0; i < options.objects; i++)
+        {
+            objects.push_back(renderer.AddObject(meshes[i % 2], materials[(i / 2) % materials.size()],
+                GridTransform(i, options.objects, options.spread, 0.0f)));
+        }
+    }
+
+    // nearest-rank percentile of sorted samples
+    double Percentile(const std::vector<double>& sorted, double percentile)
+    {
+        size_t rank = (size_t)std::ceil(percentile / 100.0 * sorted.size());
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // the engine logs to std::cout, which goes to stderr here so that stdout only gets the report
+    std::ostream report(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    int result = 0;
+    try
+    {
+        Options options = ParseOptions(argc, argv);
+        util::SetShaderDirectory(options.shader_dir);
+        // written by the capture thread, which may still run while vk_manager shuts down
+        std::atomic<uint64_t> capture_checksum{ 0 };
+
+        vk::VulkanManager vk_manager(options.width, options.height, options.frames_in_flight, options.threads);
+        vk_manager.SetDrawCount(options.draws);
+        vk_manager.SetAsyncCompute(options.async_compute);
+        auto& dynamic_resolution = vk_manager.GetDynamicResolution();
+        if (options.frame_budget_ms > 0.0)
+        {
+            dynamic_resolution.SetScaleRange(options.min_scale, 1.0f);
+            dynamic_resolution.SetBudget(options.frame_budget_ms);
+            dynamic_resolution.SetEnabled(true);
+        }
+
+        std::vector<uint32_t> objects;
+        auto& renderer = vk_manager.GetRenderer();
+        double mesh_load_ms;
+        CreateScene(renderer, options, objects, mesh_load_ms);
+
+        // transforms of the next frame, simulated while the current one is submitted
+        auto& job_system = vk_manager.GetJobSystem();
+        std::vector<vk::Matrix4> transforms(options.moving);
+        util::JobSystem::JobHandle simulation;
+        uint32_t frame = 0;
+        auto simulate = [&]()
+        {
+            // sway the moving objects sideways
+            float offset = 0.2f * std::sin(frame++ * 0.05f);
+            simulation = job_system.Run([&, offset](uint32_t)
+            {
+                job_system.ParallelFor(options.moving, 1024, [&, offset](uint32_t, uint32_t begin, uint32_t end)
+                {
+                    for (uint32_t i = begin; i < end; i++)
+                        transforms[i] = GridTransform(i, options.objects, options.spread, offset);
+                });
+            });
+        };
+        auto draw_frame = [&]()
+        {
+            job_system.Wait(simulation);
+            for (uint32_t i = 0; i < options.moving; i++)
+                renderer.SetTransform(objects[i], transforms[i]);
+            vk_manager.DrawFrame();
+            simulate();
+        };
+        simulate();
+
+        for (uint32_t i = 0; i < options.warmup; i++)
+            draw_frame();
+        vk_manager.WaitIdle();
+
+        // the streamer publishes levels from DrawFrame, so keep drawing until it is done
+        auto& asset_streamer = vk_manager.GetAssetStreamer();
+        auto stream_start = std::chrono::steady_clock::now();
+        uint32_t failed_textures = 0;
+        if (!options.textures.empty())
+        {
+            std::vector<uint32_t> textures;
+            for (const auto& path : options.textures)
+            {
+                uint32_t texture = asset_streamer.RequestTexture(path);
+                asset_streamer.RequestLevel(texture, 0);
+                textures.push_back(texture);
+            }
+            while (!asset_streamer.IsIdle())
+                draw_frame();
+            for (uint32_t texture : textures)
+                failed_textures += asset_streamer.IsFailed(texture) ? 1 : 0;
+        }
+        double texture_stream_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stream_start).count();
+        vk_manager.WaitIdle();
+
+        // with frames in flight the interval between DrawFrame returns is the
+        // steady state frame time once the pipeline is full
+        using clock = std::chrono::steady_clock;
+        std::vector<double> frame_times_ms;
+        frame_times_ms.reserve(options.frames);
+
+        auto& profiler = vk_manager.GetProfiler();
+        if (!options.trace.empty())
+            profiler.StartCapture();
+
+        // stands in for an encoder: reads every pixel once, optionally writes them out
+        if (options.capture)
+        {
+            vk_manager.SetCaptureConsumer([&options, &capture_checksum](const vk::FrameCapture::Frame& frame)
+            {
+                uint64_t sum = 0;
+                auto words = reinterpret_cast<const uint32_t*>(frame.pixels);
+                for (size_t i = 0; i < frame.size / sizeof(uint32_t); i++)
+                    sum += words[i];
+                capture_checksum = sum;
+
+                if (options.capture_dir.empty())
+                    return;
+                bool bgra = frame.format == VK_FORMAT_B8G8R8A8_SRGB || frame.format == VK_FORMAT_B8G8R8A8_UNORM;
+                std::string path = options.capture_dir + "/frame-" + std::to_string(frame.frame_number) + "-" +
+                    std::to_string(frame.extent.width) + "x" + std::to_string(frame.extent.height) + (bgra ? ".bgra" : ".rgba");
+                std::ofstream file(path, std::ios::binary);
+                if (!file.write(reinterpret_cast<const char*>(frame.pixels), frame.size))
+                    throw std::runtime_error("Failed to write capture: " + path);
+            });
+        }
+
+        job_system.ResetStats();
+        uint64_t host_allocations = 0;
+        uint64_t max_host_allocations = 0;
+        auto start = clock::now();
+        auto previous = start;
+        for (uint32_t i = 0; i < options.frames; i++)
+        {
+            draw_frame();
+            uint64_t frame_host_allocations = 0;
+            for (uint64_t allocations : vk_manager.GetFrameHostAllocations())
+                frame_host_allocations += allocations;
+            host_allocations += frame_host_allocations;
+            max_host_allocations = std::max(max_host_allocations, frame_host_allocations);
+            auto now = clock::now();
+            frame_times_ms.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+            previous = now;
+        }
+        vk_manager.WaitIdle();
+        double total_s = std::chrono::duration<double>(clock::now() - start).count();
+        auto worker_stats = job_system.GetStats();
+        job_system.Wait(simulation);
+        vk_manager.SetCaptureConsumer(nullptr);
+        auto& frame_capture = vk_manager.GetFrameCapture();
+        frame_capture.Wait();
+        auto capture_stats = frame_capture.GetStats();
+        if (!options.trace.empty())
+            profiler.WriteTrace(options.trace);
+
+        double sum = 0.0;
+        for (double t : frame_times_ms)
+            sum += t;
+        std::sort(frame_times_ms.begin(), frame_times_ms.end());
+
+        const vk::RenderGraph& render_graph = vk_manager.GetRenderGraph();
+        std::ostringstream json;
+        json << "{"
+            << "\"device\": \"" << vk_manager.GetDeviceName() << "\", "
+            << "\"width\": " << options.width << ", "
+            << "\"height\": " << options.height << ", "
+            << "\"draws\": " << options.draws << ", "
+            << "\"objects\": " << renderer.GetObjectCount() << ", "
+            << "\"moving\": " << options.moving << ", "
+            << "\"batches\": " << renderer.GetBatchCount() << ", "
+            << "\"draw_commands\": " << renderer.GetDrawCommandCount() << ", "
+            << "\"gpu_culling\": " << (renderer.IsGpuCullingEnabled() ? "true" : "false") << ", "
+            << "\"submitted_instances\": " << renderer.GetSubmittedInstanceCount() << ", "
+            << "\"visible_instances\": " << renderer.GetVisibleInstanceCount() << ", "
+            << "\"frames_in_flight\": " << options.frames_in_flight << ", "
+            << "\"threads\": " << vk_manager.GetWorkerThreadCount() << ", "
+            << "\"uniform_bytes_per_frame\": " << vk_manager.GetUniformRing().GetFrameUsage() << ", "
+            << "\"pipeline_cache\": \"" << (vk_manager.IsPipelineCacheWarm() ? "warm" : "cold") << "\", "
+            << "\"startup_ms\": " << vk_manager.GetStartupTime() << ", "
+            << "\"first_frame_ms\": " << vk_manager.GetFirstFrameTime() << ", "
+            << "\"embedded_shaders\": " << (util::IsShaderEmbedded("vert.spv") ? "true" : "false") << ", "
+            << "\"pipeline_creation_ms\": " << vk_manager.GetPipelineCreationTime() << ", "
+            << "\"pipelines\": " << vk_manager.GetPipelineLibrary().GetPipelineCount() << ", "
+            << "\"prewarmed_pipelines\": " << vk_manager.GetPipelineLibrary().GetPrewarmedCount() << ", "
+            << "\"textures\": " << options.textures.size() << ", "
+            << "\"failed_textures\": " << failed_textures << ", "
+            << "\"mesh_load_ms\": " << mesh_load_ms << ", "
+            << "\"texture_stream_ms\": " << (options.textures.empty() ? 0.0 : texture_stream_ms) << ", "
+            << "\"graph_passes\": " << render_graph.GetPassCount() << ", "
+            << "\"graph_culled_passes\": " << render_graph.GetCulledPassCount() << ", "
+            << "\"graph_render_passes\": " << render_graph.GetRenderPassCount() << ", "
+            << "\"transient_bytes\": " << render_graph.GetTransientBytes() << ", "
+            << "\"transient_unaliased_bytes\": " << render_graph.GetUnaliasedBytes() << ", "
+            << "\"async_compute\": " << (vk_manager.IsAsyncCompute() ? "true" : "false") << ", "
+            << "\"async_compute_available\": " << (vk_manager.IsAsyncComputeAvailable() ? "true" : "false") << ", "
+            << "\"frame_budget_ms\": " << options.frame_budget_ms << ", "
+            << "\"render_scale\": " << dynamic_resolution.GetScale() << ", "
+            << "\"render_width\": " << vk_manager.GetRenderExtent().width << ", "
+            << "\"render_height\": " << vk_manager.GetRenderExtent().height << ", "
+            << "\"scale_changes\": " << dynamic_resolution.GetChangeCount() << ", "
+            << "\"frames\": " << options.frames << ", "
+            << "\"mean_ms\": " << sum / frame_times_ms.size() << ", "
+            << "\"p50_ms\": " << Percentile(frame_times_ms, 50.0) << ", "
+            << "\"p99_ms\": " << Percentile(frame_times_ms, 99.0) << ", "
+            << "\"max_ms\": " << frame_times_ms.back() << ", "
+            << "\"fps\": " << options.frames / total_s << ", "
+            << "\"capture\": " << (options.capture ? "true" : "false") << ", "
+            << "\"captured_frames\": " << capture_stats.captured << ", "
+            << "\"dropped_captures\": " << capture_stats.dropped << ", "
+            << "\"capture_mb_per_s\": " << capture_stats.bytes / total_s / (1 << 20) << ", "
+            << "\"capture_latency_ms\": " << capture_stats.avg_latency_ms << ", "
+            << "\"max_capture_latency_ms\": " << capture_stats.max_latency_ms << ", "
+            << "\"capture_latency_frames\": " << capture_stats.avg_latency_frames << ", "
+            << "\"capture_consumer_ms\": " << capture_stats.consumer_ms << ", "
+            << "\"capture_checksum\": " << capture_checksum << ", "
+            << "\"host_allocations_per_frame\": " << (double)host_allocations / options.frames << ", "
+            << "\"max_host_allocations_per_frame\": " << max_host_allocations << ", "
+            << "\"workers\": [";
+        for (size_t i = 0; i < worker_stats.size(); i++)
+        {
+            json << (i ? ", " : "") << "{"
+                << "\"jobs\": " << worker_stats[i].jobs << ", "
+                << "\"steals\": " << worker_stats[i].steals << ", "
+                << "\"busy_ms\": " << worker_stats[i].busy_ms << ", "
+                << "\"utilization\": " << worker_stats[i].utilization
+                << "}";
+        }
+        json << "], \"heaps\": [";
+        auto heap_stats = vk_manager.GetAllocator().GetHeapStats();
+        for (size_t i = 0; i < heap_stats.size(); i++)
+        {
+            json << (i ? ", " : "") << "{"
+                << "\"size\": " << heap_stats[i].heap_size << ", "
+                << "\"block_bytes\": " << heap_stats[i].block_bytes << ", "
+                << "\"used_bytes\": " << heap_stats[i].used_bytes << ", "
+                << "\"blocks\": " << heap_stats[i].block_count << ", "
+                << "\"allocations\": " << heap_stats[i].allocation_count
+                << "}";
+        }
+        json << "], \"startup_phases\": [";
+        const auto& startup_phases = vk_manager.GetStartupPhases();
+        for (size_t i = 0; i < startup_phases.size(); i++)
+        {
+            json << (i ? ", " : "") << "{"
+                << "\"name\": \"" << startup_phases[i].name << "\", "
+                << "\"start_ms\": " << startup_phases[i].start_ms << ", "
+                << "\"ms\": " << startup_phases[i].ms
+                << "}";
+        }
+        json << "], \"host_scopes\": [";
+        auto host_stats = vk_manager.GetHostAllocator().GetStats();
+        for (uint32_t i = 0; i < vk::HostAllocator::kScopeCount; i++)
+        {
+            json << (i ? ", " : "") << "{"
+                << "\"scope\": \"" << vk::HostAllocator::GetScopeName(i) << "\", "
+                << "\"allocations\": " << host_stats[i].allocations << ", "
+                << "\"pooled_allocations\": " << host_stats[i].pooled_allocations << ", "
+                << "\"frees\": " << host_stats[i].frees << ", "
+                << "\"live_bytes\": " << host_stats[i].live_bytes << ", "
+                << "\"peak_bytes\": " << host_stats[i].peak_bytes << ", "
+                << "\"internal_allocations\": " << host_stats[i].internal_allocations
+                << "}";
+        }
+        json << "], \"zones\": [";
+        auto write_zones = [&json](const std::vector<vk::ZoneStats>& zones)
+        {
+            for (size_t i = 0; i < zones.size(); i++)
+            {
+                json << (i ? ", " : "") << "{"
+                    << "\"name\": \"" << zones[i].name << "\", "
+                    << "\"gpu\": " << (zones[i].gpu ? "true" : "false") << ", "
+                    << "\"avg_ms\": " << zones[i].avg_ms << ", "
+                    << "\"min_ms\": " << zones[i].min_ms << ", "
+                    << "\"max_ms\": " << zones[i].max_ms
+                    << "}";
+            }
+        };
+        write_zones(profiler.GetSummary());
+        // the compute queue's own frame zone, bloom and tone map, empty unless async
+        json << "], \"compute_zones\": [";
+        if (vk_manager.GetComputeProfiler())
+            write_zones(vk_manager.GetComputeProfiler()->GetSummary());
+        json << "]}";
+
+        if (options.output.empty())
+            report << json.str() << std::endl;
+        else
+        {
+            std::ofstream file(options.output);
+            if (!file.is_open())
+                throw std::runtime_error("Failed to open output file: " + options.output);
+            file << json.str() << std::endl;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        result = 1;
+    }
+    std::cout.rdbuf(report.rdbuf());
+    return result;
+}
@@ -0,0 +1,44 @@
+# Writes SPIR-V files into a header as constexpr uint32_t arrays, for
+# src/shader-code.cpp. SHADERS is separated by | so it survives the command line.
+#
+# cmake -DSHADERS=a.spv|b.spv -DOUTPUT=embedded-shaders.h -P embed-spirv.cmake
+
+string(REPLACE "|" ";" SHADERS "${SHADERS}")
+
+set(arrays "")
+set(table "")
+foreach(shader IN LISTS SHADERS)
+    get_filename_component(name ${shader} NAME)
+    string(MAKE_C_IDENTIFIER ${name} identifier)
+
+    file(READ ${shader} hex HEX)
+    string(LENGTH "${hex}" length)
+    math(EXPR remainder "${length} % 8")
+    if(length EQUAL 0 OR NOT remainder EQUAL 0)
+        message(FATAL_ERROR "Not SPIR-V: ${shader}")
+    endif()
+
+    # little endian words, eight per line
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " words "${hex}")
+    set(word "0x[0-9a-f]+u, ")
+    string(REGEX REPLACE "(${word}${word}${word}${word}${word}${word}${word}${word})" "\\1\n        " words "${words}")
+    string(REPLACE " \n" "\n" words "${words}")
+    string(STRIP "${words}" words)
+
+    string(APPEND arrays "    constexpr uint32_t k_${identifier}[] = {\n        ${words}\n    };\n\n")
+    string(APPEND table "        { \"${name}\", k_${identifier}, sizeof(k_${identifier}) },\n")
+endforeach()
+
+set(content "// generated by cmake/embed-spirv.cmake, do not edit\n#pragma once\n\nnamespace util::embedded\n{\n")
+string(APPEND content "${arrays}")
+string(APPEND content "    struct Shader\n    {\n        const char* name;\n        const uint32_t* code;\n        size_t size;\n    };\n\n")
+string(APPEND content "    // ends with a null name\n    constexpr Shader kShaders[] = {\n${table}        { nullptr, nullptr, 0 },\n    };\n}\n")
+
+# only touch the header when it changes, everything including it rebuilds otherwise
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+    if(previous STREQUAL content)
+        return()
+    endif()
+endif()
+file(WRITE ${OUTPUT} "${content}")
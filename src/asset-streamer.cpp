@@ -0,0 +1,520 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        const uint8_t kKtx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        // identifier, nine header fields and the index
+        constexpr size_t kKtx2LevelIndexOffset = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+        constexpr size_t kKtx2LevelIndexEntrySize = 3 * 8;
+
+        struct Ktx2Level
+        {
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct Ktx2Texture
+        {
+            VkFormat format;
+            VkExtent3D extent;
+            // finest first
+            std::vector<Ktx2Level> levels;
+        };
+
+        template<typename T>
+        T ReadLittleEndian(const char* data)
+        {
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); i++)
+                value |= static_cast<T>(static_cast<uint8_t>(data[i])) << (8 * i);
+            return value;
+        }
+
+        // Only the parts needed for upload. Transcoding Basis Universal or
+        // inflating supercompressed levels needs libktx and is not supported.
+        Ktx2Texture ParseKtx2(const util::MappedFile& file, const std::string& path)
+        {
+            const char* data = file.GetData();
+            size_t size = file.GetSize();
+            if (size < kKtx2LevelIndexOffset || std::memcmp(data, kKtx2Identifier, sizeof(kKtx2Identifier)) != 0)
+                throw std::runtime_error("Not a KTX2 file: " + path);
+
+            const char* header = data + sizeof(kKtx2Identifier);
+            uint32_t format = ReadLittleEndian<uint32_t>(header + 0);
+            uint32_t width = ReadLittleEndian<uint32_t>(header + 8);
+            uint32_t height = ReadLittleEndian<uint32_t>(header + 12);
+            uint32_t depth = ReadLittleEndian<uint32_t>(header + 16);
+            uint32_t layer_count = ReadLittleEndian<uint32_t>(header + 20);
+            uint32_t face_count = ReadLittleEndian<uint32_t>(header + 24);
+            uint32_t level_count = std::max(1u, ReadLittleEndian<uint32_t>(header + 28));
+            uint32_t supercompression = ReadLittleEndian<uint32_t>(header + 32);
+
+            if (format == VK_FORMAT_UNDEFINED || supercompression != 0)
+                throw std::runtime_error("KTX2 file needs transcoding: " + path);
+            if (width == 0 || height == 0 || depth > 1 || layer_count > 1 || face_count != 1)
+                throw std::runtime_error("KTX2 file is not a 2D texture: " + path);
+            if (level_count > 32 || ((width >> (level_count - 1)) == 0 && (height >> (level_count - 1)) == 0))
+                throw std::runtime_error("KTX2 file has too many levels: " + path);
+            if (size < kKtx2LevelIndexOffset + level_count * kKtx2LevelIndexEntrySize)
+                throw std::runtime_error("KTX2 file is truncated: " + path);
+
+            Ktx2Texture texture{};
+            texture.format = static_cast<VkFormat>(format);
+            texture.extent = { width, height, 1 };
+            for (uint32_t i = 0; i < level_count; i++)
+            {
+                const char* entry = data + kKtx2LevelIndexOffset + i * kKtx2LevelIndexEntrySize;
+                Ktx2Level level{};
+                level.offset = ReadLittleEndian<uint64_t>(entry);
+                level.size = ReadLittleEndian<uint64_t>(entry + 8);
+                if (level.size == 0 || level.offset > size || level.size > size - level.offset)
+                    throw std::runtime_error("KTX2 file is truncated: " + path);
+                texture.levels.push_back(level);
+            }
+            return texture;
+        }
+    }
+
+    AssetStreamer::AssetStreamer(MemoryAllocator& allocator, UploadManager& upload_manager, BindlessHeap& bindless_heap, const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), allocator_(allocator), upload_manager_(upload_manager),
+        bindless_heap_(bindless_heap), frames_in_flight_(config.frames_in_flight), initial_max_extent_(config.initial_max_extent)
+    {
+        VkSamplerCreateInfo sampler_info{};
+        sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_info.magFilter = VK_FILTER_LINEAR;
+        sampler_info.minFilter = VK_FILTER_LINEAR;
+        sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.minLod = 0.0f;
+        sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device_, &sampler_info, allocation_callbacks_, &sampler_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create streaming sampler.");
+
+        workers_ = std::make_unique<util::ThreadPool>(config.worker_threads);
+    }
+
+    AssetStreamer::~AssetStreamer()
+    {
+        // queued jobs are dropped, running ones finish
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.clear();
+        }
+        workers_.reset();
+        // uploads the workers queued after the device went idle
+        upload_manager_.Finish();
+
+        for (const auto& retired : retired_)
+            DestroyRetired(retired);
+        for (auto& texture : textures_)
+        {
+            if (!texture)
+                continue;
+            if (texture->view != VK_NULL_HANDLE)
+            {
+                vkDestroyImageView(device_, texture->view, allocation_callbacks_);
+                bindless_heap_.FreeSampledImages(texture->slot);
+            }
+            if (texture->image != VK_NULL_HANDLE)
+                allocator_.DestroyImage(texture->image, texture->allocation);
+        }
+        vkDestroySampler(device_, sampler_, allocation_callbacks_);
+    }
+
+    uint32_t AssetStreamer::RequestTexture(const std::string& path, int priority)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        uint32_t id;
+        if (!free_textures_.empty())
+        {
+            id = free_textures_.back();
+            free_textures_.pop_back();
+        }
+        else
+        {
+            id = static_cast<uint32_t>(textures_.size());
+            textures_.emplace_back();
+        }
+
+        textures_[id] = std::make_unique<Texture>();
+        Texture& texture = *textures_[id];
+        texture.path = path;
+        texture.priority = priority;
+        PushJob(texture, id, kHeaderJob);
+        return id;
+    }
+
+    void AssetStreamer::RequestLevel(uint32_t texture_id, uint32_t level)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Texture& texture = *textures_.at(texture_id);
+        if (texture.released || texture.failed)
+            return;
+
+        texture.wanted_level = texture.wanted_level == ~0u ? level : std::min(texture.wanted_level, level);
+        if (texture.loaded)
+            QueueLevels(texture, texture_id);
+        else if (!texture.header_queued && texture.running_jobs == 0)
+            PushJob(texture, texture_id, kHeaderJob);
+    }
+
+    void AssetStreamer::SetPriority(uint32_t texture_id, int priority)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        textures_.at(texture_id)->priority = priority;
+
+        bool changed = false;
+        for (auto& job : jobs_)
+        {
+            if (job.texture == texture_id)
+            {
+                job.priority = priority;
+                changed = true;
+            }
+        }
+        if (changed)
+            std::make_heap(jobs_.begin(), jobs_.end(), JobLess);
+    }
+
+    void AssetStreamer::Cancel(uint32_t texture_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Texture& texture = *textures_.at(texture_id);
+
+        auto end = std::remove_if(jobs_.begin(), jobs_.end(), [texture_id](const Job& job) { return job.texture == texture_id; });
+        if (end == jobs_.end())
+            return;
+        jobs_.erase(end, jobs_.end());
+        std::make_heap(jobs_.begin(), jobs_.end(), JobLess);
+
+        // workers already woken for the dropped jobs find nothing and return
+        texture.header_queued = false;
+        for (auto& level : texture.levels)
+        {
+            if (level.state == LevelState::Queued)
+                level.state = LevelState::Unrequested;
+        }
+        texture.wanted_level = ~0u;
+    }
+
+    void AssetStreamer::ReleaseTexture(uint32_t texture_id)
+    {
+        Cancel(texture_id);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        textures_.at(texture_id)->released = true;
+    }
+
+    void AssetStreamer::Update()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame_++;
+
+        // the frames that could use these have retired
+        for (size_t i = 0; i < retired_.size();)
+        {
+            if (retired_[i].frame <= frame_)
+            {
+                DestroyRetired(retired_[i]);
+                retired_[i] = retired_.back();
+                retired_.pop_back();
+            }
+            else i++;
+        }
+
+        for (uint32_t id = 0; id < textures_.size(); id++)
+        {
+            if (!textures_[id])
+                continue;
+            Texture& texture = *textures_[id];
+
+            if (texture.released)
+            {
+                // the image may only go once no worker or transfer writes it
+                if (texture.running_jobs > 0)
+                    continue;
+                bool uploading = false;
+                for (const auto& level : texture.levels)
+                    uploading |= level.state == LevelState::Uploaded && !upload_manager_.IsReady(level.ticket);
+                if (uploading)
+                    continue;
+
+                Retire(texture, true);
+                textures_[id].reset();
+                free_textures_.push_back(id);
+                continue;
+            }
+
+            if (!texture.loaded || texture.failed)
+                continue;
+
+            for (auto& level : texture.levels)
+            {
+                if (level.state == LevelState::Uploaded && upload_manager_.IsReady(level.ticket))
+                    level.state = LevelState::Resident;
+            }
+
+            // only a contiguous chain down from the coarsest level can be sampled
+            uint32_t resident_level = texture.resident_level;
+            while (resident_level > 0 && texture.levels[resident_level - 1].state == LevelState::Resident)
+                resident_level--;
+            if (resident_level == texture.resident_level)
+                continue;
+
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = texture.image;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = texture.format;
+            view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_info.subresourceRange.baseMipLevel = resident_level;
+            view_info.subresourceRange.levelCount = static_cast<uint32_t>(texture.levels.size()) - resident_level;
+            view_info.subresourceRange.baseArrayLayer = 0;
+            view_info.subresourceRange.layerCount = 1;
+
+            VkImageView view;
+            if (vkCreateImageView(device_, &view_info, allocation_callbacks_, &view) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create streamed texture view.");
+
+            // in flight frames may still sample the old slot, so the new view gets its own
+            uint32_t slot = bindless_heap_.AllocateSampledImages();
+            bindless_heap_.WriteSampledImage(slot, view, sampler_);
+            Retire(texture, false);
+            texture.view = view;
+            texture.slot = slot;
+            texture.resident_level = resident_level;
+
+            // fully resident, nothing more to read from the file
+            if (resident_level == 0)
+                texture.file.reset();
+        }
+    }
+
+    uint32_t AssetStreamer::GetTextureSlot(uint32_t texture_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return textures_.at(texture_id)->slot;
+    }
+
+    uint32_t AssetStreamer::GetResidentLevel(uint32_t texture_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return textures_.at(texture_id)->resident_level;
+    }
+
+    uint32_t AssetStreamer::GetLevelCount(uint32_t texture_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(textures_.at(texture_id)->levels.size());
+    }
+
+    bool AssetStreamer::IsFailed(uint32_t texture_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return textures_.at(texture_id)->failed;
+    }
+
+    bool AssetStreamer::IsIdle()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!jobs_.empty())
+            return false;
+        for (const auto& texture : textures_)
+        {
+            if (!texture || texture->failed)
+                continue;
+            if (texture->running_jobs > 0)
+                return false;
+            for (const auto& level : texture->levels)
+            {
+                if (level.state == LevelState::Uploaded)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool AssetStreamer::JobLess(const Job& a, const Job& b)
+    {
+        if (a.priority != b.priority)
+            return a.priority < b.priority;
+        return a.sequence > b.sequence;
+    }
+
+    void AssetStreamer::PushJob(Texture& texture, uint32_t id, uint32_t level)
+    {
+        if (level == kHeaderJob)
+            texture.header_queued = true;
+        else
+            texture.levels[level].state = LevelState::Queued;
+
+        jobs_.push_back({ id, level, texture.priority, next_sequence_++ });
+        std::push_heap(jobs_.begin(), jobs_.end(), JobLess);
+
+        // each worker task runs whichever job is most urgent by the time it starts
+        workers_->Submit([this](uint32_t) { RunNextJob(); });
+    }
+
+    void AssetStreamer::QueueLevels(Texture& texture, uint32_t id)
+    {
+        // coarsest first, so something shows up as early as possible
+        uint32_t level_count = static_cast<uint32_t>(texture.levels.size());
+        uint32_t wanted_level = std::min(texture.wanted_level, level_count - 1);
+        for (uint32_t level = level_count; level-- > wanted_level;)
+        {
+            if (texture.levels[level].state == LevelState::Unrequested)
+                PushJob(texture, id, level);
+        }
+    }
+
+    void AssetStreamer::RunNextJob()
+    {
+        Job job;
+        Texture* texture;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (jobs_.empty())
+                return;
+            std::pop_heap(jobs_.begin(), jobs_.end(), JobLess);
+            job = jobs_.back();
+            jobs_.pop_back();
+
+            texture = textures_[job.texture].get();
+            texture->running_jobs++;
+            if (job.level == kHeaderJob)
+                texture->header_queued = false;
+        }
+
+        // textures are only destroyed by Update once running_jobs is back at zero
+        try
+        {
+            if (job.level == kHeaderJob)
+                LoadHeader(*texture);
+            else
+                LoadLevel(*texture, job.level);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+            std::lock_guard<std::mutex> lock(mutex_);
+            texture->failed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        texture->running_jobs--;
+        if (job.level == kHeaderJob && texture->loaded && !texture->released)
+            QueueLevels(*texture, job.texture);
+    }
+
+    void AssetStreamer::LoadHeader(Texture& texture)
+    {
+        // path never changes after the request
+        auto file = std::make_shared<util::MappedFile>(texture.path);
+        Ktx2Texture ktx = ParseKtx2(*file, texture.path);
+
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = ktx.format;
+        image_info.extent = ktx.extent;
+        image_info.mipLevels = static_cast<uint32_t>(ktx.levels.size());
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image;
+        Allocation allocation = allocator_.CreateImage(image_info, MemoryUsage::GpuOnly, &image);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        texture.file = std::move(file);
+        texture.format = ktx.format;
+        texture.extent = ktx.extent;
+        texture.image = image;
+        texture.allocation = allocation;
+        texture.levels.resize(ktx.levels.size());
+        for (size_t i = 0; i < ktx.levels.size(); i++)
+        {
+            texture.levels[i].offset = ktx.levels[i].offset;
+            texture.levels[i].size = ktx.levels[i].size;
+        }
+        texture.resident_level = static_cast<uint32_t>(texture.levels.size());
+
+        // without an explicit request, stop at the first level that fits the initial extent
+        if (texture.wanted_level == ~0u)
+        {
+            uint32_t level = 0;
+            while (level + 1 < texture.levels.size() &&
+                std::max(ktx.extent.width >> level, ktx.extent.height >> level) > initial_max_extent_)
+                level++;
+            texture.wanted_level = level;
+        }
+        texture.loaded = true;
+    }
+
+    void AssetStreamer::LoadLevel(Texture& texture, uint32_t level)
+    {
+        std::shared_ptr<util::MappedFile> file;
+        VkImage image;
+        VkExtent3D extent;
+        Level info;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (texture.released)
+            {
+                texture.levels[level].state = LevelState::Unrequested;
+                return;
+            }
+            file = texture.file;
+            image = texture.image;
+            extent = texture.extent;
+            info = texture.levels[level];
+        }
+
+        // start the disk reads for the whole level, then copy from the mapping into staging
+        file->Prefetch(info.offset, info.size);
+        uint64_t ticket = upload_manager_.UploadImage(image, extent, level, file->GetData() + info.offset, info.size);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        texture.levels[level].state = LevelState::Uploaded;
+        texture.levels[level].ticket = ticket;
+    }
+
+    void AssetStreamer::Retire(Texture& texture, bool destroy_image)
+    {
+        Retired retired{};
+        retired.frame = frame_ + frames_in_flight_;
+        retired.view = texture.view;
+        retired.slot = texture.slot;
+        if (destroy_image)
+        {
+            retired.image = texture.image;
+            retired.allocation = texture.allocation;
+            texture.image = VK_NULL_HANDLE;
+        }
+        texture.view = VK_NULL_HANDLE;
+        texture.slot = kNoSlot;
+
+        if (retired.view != VK_NULL_HANDLE || retired.image != VK_NULL_HANDLE)
+            retired_.push_back(retired);
+    }
+
+    void AssetStreamer::DestroyRetired(const Retired& retired)
+    {
+        if (retired.view != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(device_, retired.view, allocation_callbacks_);
+            bindless_heap_.FreeSampledImages(retired.slot);
+        }
+        if (retired.image != VK_NULL_HANDLE)
+            allocator_.DestroyImage(retired.image, retired.allocation);
+    }
+}
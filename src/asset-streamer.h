@@ -0,0 +1,167 @@
+#pragma once
+
+namespace vk
+{
+    // Loads KTX2 textures on worker threads without blocking frames.
+    //
+    // Files are memory mapped and their levels are copied straight from the
+    // mapping into the upload manager's staging ring, so the only copy is the
+    // one the gpu needs anyway. Every level is a separate job in a priority
+    // queue; coarse levels are queued before fine ones, and only levels up to
+    // initial_max_extent are loaded until RequestLevel asks for more detail.
+    //
+    // A texture becomes visible through a bindless slot once its coarsest level
+    // has arrived. Whenever finer levels complete, Update publishes a new view
+    // in a new slot and retires the old pair after the frames in flight that
+    // may still sample it. Requests may come from any thread, Update is called
+    // once per frame before the frame is recorded, never concurrently.
+    class AssetStreamer
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            uint32_t frames_in_flight;
+            uint32_t worker_threads = 2;
+            // levels larger than this stream in on demand
+            uint32_t initial_max_extent = 256;
+        };
+
+        static constexpr uint32_t kNoSlot = ~0u;
+
+    private:
+        enum class LevelState
+        {
+            Unrequested,
+            Queued,
+            // upload recorded, waiting for its acquire on the graphics queue
+            Uploaded,
+            Resident,
+        };
+
+        struct Level
+        {
+            uint64_t offset;
+            uint64_t size;
+            LevelState state = LevelState::Unrequested;
+            uint64_t ticket = 0;
+        };
+
+        struct Texture
+        {
+            std::string path;
+            int priority;
+            // finest level wanted, ~0u until the header says what initial_max_extent means
+            uint32_t wanted_level = ~0u;
+            bool header_queued = false;
+            bool loaded = false;
+            bool failed = false;
+            bool released = false;
+            uint32_t running_jobs = 0;
+
+            // set by the header job
+            std::shared_ptr<util::MappedFile> file;
+            VkFormat format = VK_FORMAT_UNDEFINED;
+            VkExtent3D extent{};
+            std::vector<Level> levels;
+            VkImage image = VK_NULL_HANDLE;
+            Allocation allocation{};
+
+            // view over the resident levels and its slot, published by Update
+            VkImageView view = VK_NULL_HANDLE;
+            uint32_t slot = kNoSlot;
+            uint32_t resident_level = 0;
+        };
+
+        struct Job
+        {
+            uint32_t texture;
+            // kHeaderJob parses the file and creates the image
+            uint32_t level;
+            int priority;
+            // first in first out among equal priorities
+            uint64_t sequence;
+        };
+
+        // destroyed once the frames that may use it have retired
+        struct Retired
+        {
+            uint64_t frame;
+            VkImageView view;
+            uint32_t slot;
+            VkImage image;
+            Allocation allocation;
+        };
+
+        static constexpr uint32_t kHeaderJob = ~0u;
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        MemoryAllocator& allocator_;
+        UploadManager& upload_manager_;
+        BindlessHeap& bindless_heap_;
+        uint32_t frames_in_flight_;
+        uint32_t initial_max_extent_;
+        VkSampler sampler_;
+
+        std::mutex mutex_;
+        // indexed by id, released textures leave a null entry until the id is reused
+        std::vector<std::unique_ptr<Texture>> textures_;
+        std::vector<uint32_t> free_textures_;
+        // max heap by priority
+        std::vector<Job> jobs_;
+        uint64_t next_sequence_ = 0;
+
+        // Update calls so far, one per submitted frame
+        uint64_t frame_ = 0;
+        std::vector<Retired> retired_;
+
+        std::unique_ptr<util::ThreadPool> workers_;
+
+    public:
+        AssetStreamer(MemoryAllocator& allocator, UploadManager& upload_manager, BindlessHeap& bindless_heap, const Config& config);
+        // frames using the textures must have retired
+        ~AssetStreamer();
+
+        AssetStreamer(const AssetStreamer&) = delete;
+        AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+        // Start streaming a KTX2 texture, higher priorities load first.
+        uint32_t RequestTexture(const std::string& path, int priority = 0);
+        // stream levels down to level, 0 being full resolution
+        void RequestLevel(uint32_t texture, uint32_t level);
+        void SetPriority(uint32_t texture, int priority);
+        // drop levels that have not started loading, resident levels stay
+        void Cancel(uint32_t texture);
+        // cancel and destroy once no job or frame uses it, the id may be reused
+        void ReleaseTexture(uint32_t texture);
+
+        // Publish finished levels and destroy retired resources. Call once per
+        // frame before recording, after the frame's image has been acquired.
+        void Update();
+
+        // bindless slot of the resident levels, kNoSlot until the first level arrives
+        uint32_t GetTextureSlot(uint32_t texture);
+        // finest resident level, the level count while nothing is resident
+        uint32_t GetResidentLevel(uint32_t texture);
+        uint32_t GetLevelCount(uint32_t texture);
+        bool IsFailed(uint32_t texture);
+        // true when every requested level of every texture is resident
+        bool IsIdle();
+
+    private:
+        static bool JobLess(const Job& a, const Job& b);
+        void PushJob(Texture& texture, uint32_t id, uint32_t level);
+        void QueueLevels(Texture& texture, uint32_t id);
+        void RunNextJob();
+        void LoadHeader(Texture& texture);
+        void LoadLevel(Texture& texture, uint32_t level);
+        void Retire(Texture& texture, bool destroy_image);
+        void DestroyRetired(const Retired& retired);
+
+    public:
+        // getters
+        VkSampler GetSampler() const { return sampler_; }
+    };
+}
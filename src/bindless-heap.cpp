@@ -0,0 +1,168 @@
+#include "pch.h"
+
+namespace vk
+{
+    BindlessHeap::BindlessHeap(const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks)
+    {
+        storage_buffers_.capacity = config.storage_buffer_capacity;
+        sampled_images_.capacity = config.sampled_image_capacity;
+
+        VkDescriptorSetLayoutBinding bindings[2]{};
+        bindings[0].binding = kStorageBufferBinding;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[0].descriptorCount = storage_buffers_.capacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+        bindings[1].binding = kSampledImageBinding;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[1].descriptorCount = sampled_images_.capacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+        // unwritten slots are fine as long as nothing reads them, and slots can be
+        // rewritten after the set was bound as long as pending work does not read them
+        VkDescriptorBindingFlags binding_flags[2];
+        binding_flags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        binding_flags[1] = binding_flags[0];
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+        binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        binding_flags_info.bindingCount = 2;
+        binding_flags_info.pBindingFlags = binding_flags;
+
+        VkDescriptorSetLayoutCreateInfo set_layout_info{};
+        set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        set_layout_info.pNext = &binding_flags_info;
+        set_layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        set_layout_info.bindingCount = 2;
+        set_layout_info.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device_, &set_layout_info, allocation_callbacks_, &set_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create bindless descriptor set layout.");
+
+        VkDescriptorPoolSize pool_sizes[2]{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[0].descriptorCount = storage_buffers_.capacity;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_sizes[1].descriptorCount = sampled_images_.capacity;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = 2;
+        pool_info.pPoolSizes = pool_sizes;
+
+        if (vkCreateDescriptorPool(device_, &pool_info, allocation_callbacks_, &descriptor_pool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create bindless descriptor pool.");
+
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool = descriptor_pool_;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &set_layout_;
+
+        if (vkAllocateDescriptorSets(device_, &allocate_info, &descriptor_set_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate bindless descriptor set.");
+    }
+
+    BindlessHeap::~BindlessHeap()
+    {
+        vkDestroyDescriptorPool(device_, descriptor_pool_, allocation_callbacks_);
+        vkDestroyDescriptorSetLayout(device_, set_layout_, allocation_callbacks_);
+    }
+
+    uint32_t BindlessHeap::AllocateStorageBuffers(uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Allocate(storage_buffers_, count);
+    }
+
+    void BindlessHeap::FreeStorageBuffers(uint32_t first, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Free(storage_buffers_, first, count);
+    }
+
+    void BindlessHeap::WriteStorageBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+    {
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = buffer;
+        buffer_info.offset = offset;
+        buffer_info.range = range;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_set_;
+        write.dstBinding = kStorageBufferBinding;
+        write.dstArrayElement = slot;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &buffer_info;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    }
+
+    uint32_t BindlessHeap::AllocateSampledImages(uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Allocate(sampled_images_, count);
+    }
+
+    void BindlessHeap::FreeSampledImages(uint32_t first, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Free(sampled_images_, first, count);
+    }
+
+    void BindlessHeap::WriteSampledImage(uint32_t slot, VkImageView image_view, VkSampler sampler, VkImageLayout layout)
+    {
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = sampler;
+        image_info.imageView = image_view;
+        image_info.imageLayout = layout;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_set_;
+        write.dstBinding = kSampledImageBinding;
+        write.dstArrayElement = slot;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_info;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    }
+
+    void BindlessHeap::Bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout) const
+    {
+        vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, 0, 1, &descriptor_set_, 0, nullptr);
+    }
+
+    uint32_t BindlessHeap::Allocate(Slots& slots, uint32_t count)
+    {
+        auto it = slots.free_ranges.find(count);
+        if (it != slots.free_ranges.end())
+        {
+            uint32_t first = it->second.back();
+            it->second.pop_back();
+            if (it->second.empty())
+                slots.free_ranges.erase(it);
+            return first;
+        }
+
+        if (count > slots.capacity - slots.used)
+            throw std::runtime_error("Bindless descriptor heap is full.");
+
+        uint32_t first = slots.used;
+        slots.used += count;
+        return first;
+    }
+
+    void BindlessHeap::Free(Slots& slots, uint32_t first, uint32_t count)
+    {
+        slots.free_ranges[count].push_back(first);
+    }
+}
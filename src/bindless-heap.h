@@ -0,0 +1,85 @@
+#pragma once
+
+namespace vk
+{
+    // One global descriptor set holding every storage buffer and sampled image.
+    //
+    // The set is bound once per command buffer and pipeline bind point; shaders
+    // pick their resources by indices passed in push constants, so nothing is
+    // bound or allocated per draw. Resources keep their index for as long as they
+    // are registered and rewriting a slot does not disturb the others, so slots
+    // can be updated while command buffers that use the set are pending.
+    //
+    // Slots are handed out in contiguous ranges so that a group of resources can
+    // be addressed by one base index. A range may only be freed or rewritten once
+    // the gpu is done with the submissions that read it.
+    class BindlessHeap
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            // clamped to the device's update after bind limits by the caller
+            uint32_t storage_buffer_capacity = 16384;
+            uint32_t sampled_image_capacity = 16384;
+        };
+
+        // matches the bindings in the shaders
+        static constexpr uint32_t kStorageBufferBinding = 0;
+        static constexpr uint32_t kSampledImageBinding = 1;
+
+    private:
+        struct Slots
+        {
+            uint32_t capacity;
+            // slots below this have been handed out at some point
+            uint32_t used = 0;
+            // freed ranges by length, reused for ranges of the same length
+            std::map<uint32_t, std::vector<uint32_t>> free_ranges;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        VkDescriptorSetLayout set_layout_;
+        VkDescriptorPool descriptor_pool_;
+        VkDescriptorSet descriptor_set_;
+
+        // guards the slots and writes into the set, which must be externally synchronized
+        std::mutex mutex_;
+        Slots storage_buffers_;
+        Slots sampled_images_;
+
+    public:
+        explicit BindlessHeap(const Config& config);
+        ~BindlessHeap();
+
+        BindlessHeap(const BindlessHeap&) = delete;
+        BindlessHeap& operator=(const BindlessHeap&) = delete;
+
+        // Reserve count consecutive slots and return the first. The slots stay
+        // unwritten until Write is called.
+        uint32_t AllocateStorageBuffers(uint32_t count = 1);
+        void FreeStorageBuffers(uint32_t first, uint32_t count = 1);
+        void WriteStorageBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+        uint32_t AllocateSampledImages(uint32_t count = 1);
+        void FreeSampledImages(uint32_t first, uint32_t count = 1);
+        // the image must be in layout whenever a shader samples it
+        void WriteSampledImage(uint32_t slot, VkImageView image_view, VkSampler sampler,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        // bind the set as set 0 of a layout created with GetSetLayout
+        void Bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout) const;
+
+    private:
+        uint32_t Allocate(Slots& slots, uint32_t count);
+        void Free(Slots& slots, uint32_t first, uint32_t count);
+
+    public:
+        // getters
+        VkDescriptorSetLayout GetSetLayout() const { return set_layout_; }
+        uint32_t GetStorageBufferCapacity() const { return storage_buffers_.capacity; }
+        uint32_t GetSampledImageCapacity() const { return sampled_images_.capacity; }
+    };
+}
@@ -0,0 +1,57 @@
+#include "pch.h"
+
+namespace vk
+{
+    DeletionQueue::DeletionQueue(uint32_t frames_in_flight)
+        : frames_in_flight_(frames_in_flight)
+    {
+    }
+
+    DeletionQueue::~DeletionQueue()
+    {
+        Flush();
+    }
+
+    void DeletionQueue::Defer(std::function<void()> destroy)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deletions_.push_back({ frame_, std::move(destroy) });
+    }
+
+    void DeletionQueue::NextFrame()
+    {
+        // destroy outside the lock, destroys may defer more
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frame_++;
+            // before this submission DrawFrame waited for the slot's previous frame to retire,
+            // frame timeline value frame_ - frames_in_flight_, the last to use deletions deferred
+            // up to frame_ - 1 - frames_in_flight_
+            while (!deletions_.empty() && deletions_.front().frame + frames_in_flight_ < frame_)
+            {
+                ready.push_back(std::move(deletions_.front().destroy));
+                deletions_.pop_front();
+            }
+        }
+        for (auto& destroy : ready)
+            destroy();
+    }
+
+    void DeletionQueue::Flush()
+    {
+        std::deque<Deletion> deletions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            deletions.swap(deletions_);
+        }
+        for (auto& deletion : deletions)
+            deletion.destroy();
+    }
+
+    uint32_t DeletionQueue::GetPendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(deletions_.size());
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+namespace vk
+{
+    // Destroys what the gpu may still be using once the frames that could use it
+    // have retired, instead of idling the device.
+    //
+    // Every deferred destroy is tagged with the frame being recorded, which may
+    // still use it. NextFrame is called right after each frame's submission.
+    // Since a frame slot's last submission is waited on before the slot records
+    // again, by the time frames_in_flight more frames have been submitted the
+    // tagged frame has retired, and whatever was deferred during it is
+    // destroyed. Deferring is safe from any thread.
+    class DeletionQueue
+    {
+    private:
+        struct Deletion
+        {
+            uint64_t frame;
+            std::function<void()> destroy;
+        };
+
+        uint32_t frames_in_flight_;
+        std::mutex mutex_;
+        // in frame order
+        std::deque<Deletion> deletions_;
+        uint64_t frame_ = 0;
+
+    public:
+        explicit DeletionQueue(uint32_t frames_in_flight);
+        // destroys everything left, the device must be idle
+        ~DeletionQueue();
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        void Defer(std::function<void()> destroy);
+        // after submitting the frame, frames that are never submitted do not count
+        void NextFrame();
+        // destroy everything now, the device must be idle
+        void Flush();
+
+    public:
+        // getters
+        uint32_t GetPendingCount();
+    };
+
+    // Owns one handle destroyed through Destroy, move only.
+    //
+    // Resetting or destroying the wrapper destroys the handle right away, which
+    // is for teardown and for handles the gpu cannot be using. Retire hands it to
+    // a DeletionQueue instead, for replacing resources while frames are in flight.
+    // The handle is destroyed with the allocation callbacks it was created with.
+    template <typename T, void (VKAPI_PTR* Destroy)(VkDevice, T, const VkAllocationCallbacks*)>
+    class Handle
+    {
+    private:
+        VkDevice device_ = VK_NULL_HANDLE;
+        T handle_ = VK_NULL_HANDLE;
+        const VkAllocationCallbacks* allocation_callbacks_ = nullptr;
+
+    public:
+        Handle() = default;
+        Handle(VkDevice device, T handle, const VkAllocationCallbacks* allocation_callbacks = nullptr)
+            : device_(device), handle_(handle), allocation_callbacks_(allocation_callbacks) {}
+        ~Handle() { Reset(); }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle(Handle&& other) noexcept : device_(other.device_), allocation_callbacks_(other.allocation_callbacks_) { handle_ = other.Release(); }
+        Handle& operator=(Handle&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                device_ = other.device_;
+                allocation_callbacks_ = other.allocation_callbacks_;
+                handle_ = other.Release();
+            }
+            return *this;
+        }
+
+        void Reset()
+        {
+            if (handle_ != VK_NULL_HANDLE)
+                Destroy(device_, handle_, allocation_callbacks_);
+            handle_ = VK_NULL_HANDLE;
+        }
+
+        // for create calls, destroys the current handle first; pass the callbacks the create call gets
+        T* Replace(VkDevice device, const VkAllocationCallbacks* allocation_callbacks = nullptr)
+        {
+            Reset();
+            device_ = device;
+            allocation_callbacks_ = allocation_callbacks;
+            return &handle_;
+        }
+
+        // give up ownership without destroying
+        T Release()
+        {
+            T handle = handle_;
+            handle_ = VK_NULL_HANDLE;
+            return handle;
+        }
+
+        // destroy once the frames in flight have retired
+        void Retire(DeletionQueue& queue)
+        {
+            if (handle_ == VK_NULL_HANDLE)
+                return;
+            VkDevice device = device_;
+            const VkAllocationCallbacks* allocation_callbacks = allocation_callbacks_;
+            T handle = Release();
+            queue.Defer([device, handle, allocation_callbacks] { Destroy(device, handle, allocation_callbacks); });
+        }
+
+    public:
+        // getters
+        T Get() const { return handle_; }
+        explicit operator bool() const { return handle_ != VK_NULL_HANDLE; }
+    };
+
+    using UniqueSemaphore = Handle<VkSemaphore, vkDestroySemaphore>;
+    using UniqueFence = Handle<VkFence, vkDestroyFence>;
+    using UniqueCommandPool = Handle<VkCommandPool, vkDestroyCommandPool>;
+    using UniquePipelineLayout = Handle<VkPipelineLayout, vkDestroyPipelineLayout>;
+    using UniqueImageView = Handle<VkImageView, vkDestroyImageView>;
+    using UniqueFramebuffer = Handle<VkFramebuffer, vkDestroyFramebuffer>;
+    using UniqueSwapchain = Handle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+}
@@ -0,0 +1,90 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        constexpr float kScaleStep = 0.05f;
+        // weight of the newest timing
+        constexpr double kSmoothing = 0.1;
+        // drops aim here, grows wait for this much headroom, in between the scale stays
+        constexpr double kShrinkTarget = 0.9;
+        constexpr double kGrowThreshold = 0.75;
+        constexpr uint32_t kGrowFrames = 30;
+        // timings right after a change are noisy, new framebuffers and all
+        constexpr uint32_t kSettleFrames = 4;
+    }
+
+    DynamicResolution::DynamicResolution(const Config& config)
+        : config_(config), scale_(config.max_scale)
+    {
+        if (config_.min_scale <= 0.0f || config_.min_scale > config_.max_scale || config_.max_scale > 1.0f)
+            throw std::runtime_error("Invalid dynamic resolution scale range.");
+    }
+
+    void DynamicResolution::Update(double gpu_frame_ms)
+    {
+        if (!enabled_ || gpu_frame_ms <= 0.0)
+            return;
+        if (settle_frames_ > 0)
+        {
+            settle_frames_--;
+            return;
+        }
+
+        smoothed_ms_ = smoothed_ms_ == 0.0 ? gpu_frame_ms : smoothed_ms_ + (gpu_frame_ms - smoothed_ms_) * kSmoothing;
+
+        if (smoothed_ms_ > config_.budget_ms)
+        {
+            // at least one step, the estimate is rough
+            float fit = scale_ * (float)std::sqrt(config_.budget_ms * kShrinkTarget / smoothed_ms_);
+            SetScale(std::min(std::floor(fit / kScaleStep + 1e-3f) * kScaleStep, scale_ - kScaleStep));
+        }
+        else if (smoothed_ms_ < config_.budget_ms * kGrowThreshold)
+        {
+            if (++headroom_frames_ >= kGrowFrames)
+                SetScale(scale_ + kScaleStep);
+        }
+        else headroom_frames_ = 0;
+    }
+
+    VkExtent2D DynamicResolution::GetExtent(VkExtent2D full_extent) const
+    {
+        return {
+            std::max(1u, (uint32_t)std::lround(full_extent.width * scale_)),
+            std::max(1u, (uint32_t)std::lround(full_extent.height * scale_)),
+        };
+    }
+
+    void DynamicResolution::SetScale(float scale)
+    {
+        scale = std::clamp(scale, config_.min_scale, config_.max_scale);
+        headroom_frames_ = 0;
+        if (std::abs(scale - scale_) < 1e-4f)
+            return;
+
+        scale_ = scale;
+        change_count_++;
+        // timings at the old scale say nothing about the new one
+        smoothed_ms_ = 0.0;
+        settle_frames_ = config_.latency_frames + kSettleFrames;
+    }
+
+    void DynamicResolution::SetEnabled(bool enabled)
+    {
+        enabled_ = enabled;
+        smoothed_ms_ = 0.0;
+        headroom_frames_ = 0;
+        if (!enabled_)
+            SetScale(config_.max_scale);
+    }
+
+    void DynamicResolution::SetScaleRange(float min_scale, float max_scale)
+    {
+        if (min_scale <= 0.0f || min_scale > max_scale || max_scale > 1.0f)
+            throw std::runtime_error("Invalid dynamic resolution scale range.");
+        config_.min_scale = min_scale;
+        config_.max_scale = max_scale;
+        SetScale(scale_);
+    }
+}
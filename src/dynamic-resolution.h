@@ -0,0 +1,67 @@
+#pragma once
+
+namespace vk
+{
+    // Picks the scale the scene is rendered at from measured gpu frame times.
+    //
+    // Frame times are smoothed. Once the smoothed time exceeds the budget the
+    // scale drops right away to what should fit, assuming the cost follows the
+    // pixel count. It grows back one step at a time, and only after frames have
+    // stayed well under the budget for a while, so the scale does not flip
+    // between two steps. Scales are quantized to steps because every change
+    // rebuilds the render graph's framebuffers and transient images.
+    //
+    // Timings arrive frames in flight late; after a change the frames recorded
+    // at the old scale are ignored.
+    class DynamicResolution
+    {
+    public:
+        struct Config
+        {
+            float min_scale = 0.5f;
+            float max_scale = 1.0f;
+            // gpu time a frame should take
+            double budget_ms = 1000.0 / 60.0;
+            // frames between recording and reading back their timings
+            uint32_t latency_frames = 2;
+        };
+
+    private:
+        Config config_;
+        bool enabled_ = false;
+        float scale_;
+        // 0 until the first timing at the current scale
+        double smoothed_ms_ = 0.0;
+        // timings still to ignore after a change
+        uint32_t settle_frames_ = 0;
+        // consecutive frames well under the budget
+        uint32_t headroom_frames_ = 0;
+        uint32_t change_count_ = 0;
+
+    public:
+        explicit DynamicResolution(const Config& config);
+
+        // Feed the gpu time of the latest finished frame, 0 when there is none.
+        // Does nothing while disabled.
+        void Update(double gpu_frame_ms);
+        // the extent to render at, at least one pixel
+        VkExtent2D GetExtent(VkExtent2D full_extent) const;
+
+    private:
+        void SetScale(float scale);
+
+    public:
+        // getters
+        bool IsEnabled() const { return enabled_; }
+        float GetScale() const { return scale_; }
+        double GetSmoothedFrameTime() const { return smoothed_ms_; }
+        double GetBudget() const { return config_.budget_ms; }
+        uint32_t GetChangeCount() const { return change_count_; }
+
+        // setters
+        // disabling goes back to the largest scale
+        void SetEnabled(bool enabled);
+        void SetBudget(double budget_ms) { config_.budget_ms = budget_ms; }
+        void SetScaleRange(float min_scale, float max_scale);
+    };
+}
@@ -0,0 +1,103 @@
+#include "pch.h"
+
+namespace util
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& filename)
+    {
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open file: " + filename);
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size))
+        {
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+
+        // empty files cannot be mapped
+        if (size_ == 0)
+            return;
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_)
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_)
+        {
+            if (mapping_)
+                CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+            UnmapViewOfFile(data_);
+        if (mapping_)
+            CloseHandle(mapping_);
+        CloseHandle(file_);
+    }
+
+    void MappedFile::Prefetch(size_t offset, size_t size) const
+    {
+        if (offset >= size_)
+            return;
+
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<char*>(data_ + offset);
+        range.NumberOfBytes = std::min(size, size_ - offset);
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    MappedFile::MappedFile(const std::string& filename)
+    {
+        fd_ = open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::runtime_error("Failed to open file: " + filename);
+
+        struct stat status;
+        if (fstat(fd_, &status) != 0)
+        {
+            close(fd_);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+        size_ = static_cast<size_t>(status.st_size);
+
+        // empty files cannot be mapped
+        if (size_ == 0)
+            return;
+
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd_);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+            munmap(const_cast<char*>(data_), size_);
+        close(fd_);
+    }
+
+    void MappedFile::Prefetch(size_t offset, size_t size) const
+    {
+        if (offset >= size_)
+            return;
+
+        // madvise wants a page aligned start
+        size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset / page_size * page_size;
+        size_t end = offset + std::min(size, size_ - offset);
+        madvise(const_cast<char*>(data_ + start), end - start, MADV_WILLNEED);
+    }
+#endif
+}
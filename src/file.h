@@ -16,4 +16,35 @@ namespace util
         file.close();
         return buffer;
     }
+
+    // Read only memory mapping of a whole file. Pages are read from disk when
+    // first touched, so nothing is copied up front and only the ranges that are
+    // used cost any io.
+    class MappedFile
+    {
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+#ifdef _WIN32
+        void* file_ = nullptr;
+        void* mapping_ = nullptr;
+#else
+        int fd_ = -1;
+#endif
+
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // hint that a range is about to be read so the os can start the io early
+        void Prefetch(size_t offset, size_t size) const;
+
+    public:
+        // getters
+        const char* GetData() const { return data_; }
+        size_t GetSize() const { return size_; }
+    };
 }
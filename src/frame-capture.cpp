@@ -0,0 +1,186 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // the swapchain and offscreen formats are all 8 bit rgba or bgra
+        constexpr uint32_t kBytesPerPixel = 4;
+    }
+
+    FrameCapture::FrameCapture(MemoryAllocator& allocator, const Config& config)
+        : allocator_(allocator), slots_(std::max(1u, config.slot_count))
+    {
+        consumer_thread_ = std::make_unique<util::ThreadPool>(1);
+    }
+
+    FrameCapture::~FrameCapture()
+    {
+        consumer_thread_.reset();
+
+        for (const auto& slot : slots_)
+        {
+            if (slot.buffer != VK_NULL_HANDLE)
+                allocator_.DestroyBuffer(slot.buffer, slot.allocation);
+        }
+    }
+
+    bool FrameCapture::Record(VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent, VkFormat format, uint64_t frame_number,
+        VkImageLayout final_layout)
+    {
+        Slot* slot = nullptr;
+        if (consumer_)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& candidate : slots_)
+            {
+                if (candidate.state == SlotState::Free)
+                {
+                    slot = &candidate;
+                    slot->state = SlotState::Recorded;
+                    break;
+                }
+            }
+            if (!slot)
+                dropped_++;
+        }
+
+        if (slot)
+        {
+            // a free slot is neither read by the gpu nor by the consumer, so it can grow right away
+            VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * kBytesPerPixel;
+            if (slot->capacity < size)
+            {
+                if (slot->buffer != VK_NULL_HANDLE)
+                    allocator_.DestroyBuffer(slot->buffer, slot->allocation);
+                slot->buffer = VK_NULL_HANDLE;
+                slot->capacity = 0;
+
+                VkBufferCreateInfo buffer_info{};
+                buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                buffer_info.size = size;
+                buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+                buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                slot->allocation = allocator_.CreateBuffer(buffer_info, MemoryUsage::GpuToCpu, &slot->buffer);
+                slot->capacity = size;
+            }
+
+            slot->frame = { frame_number, extent, format, static_cast<const uint8_t*>(slot->allocation.mapped), static_cast<size_t>(size) };
+            slot->consumer = consumer_;
+            slot->recorded = std::chrono::steady_clock::now();
+
+            VkBufferImageCopy region{};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = { extent.width, extent.height, 1 };
+            vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+            VkBufferMemoryBarrier buffer_barrier{};
+            buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.buffer = slot->buffer;
+            buffer_barrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                0, nullptr, 1, &buffer_barrier, 0, nullptr);
+        }
+
+        if (final_layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+        {
+            VkImageMemoryBarrier image_barrier{};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.srcAccessMask = 0;
+            image_barrier.dstAccessMask = 0;
+            image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            image_barrier.newLayout = final_layout;
+            image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image = image;
+            image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_barrier.subresourceRange.levelCount = 1;
+            image_barrier.subresourceRange.layerCount = 1;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &image_barrier);
+        }
+        return slot != nullptr;
+    }
+
+    void FrameCapture::Update(uint64_t retired_frame, uint64_t current_frame)
+    {
+        std::vector<Slot*> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& slot : slots_)
+            {
+                if (slot.state == SlotState::Recorded && slot.frame.frame_number <= retired_frame)
+                {
+                    slot.state = SlotState::Consuming;
+                    finished.push_back(&slot);
+                }
+            }
+        }
+        std::sort(finished.begin(), finished.end(), [](const Slot* a, const Slot* b) { return a->frame.frame_number < b->frame.frame_number; });
+
+        // the consumer owns the slot until it returns, the slot vector never changes size
+        for (Slot* slot : finished)
+        {
+            uint64_t latency_frames = current_frame - slot->frame.frame_number;
+            consumer_thread_->Submit([this, slot, latency_frames](uint32_t)
+            {
+                allocator_.Invalidate(slot->allocation);
+
+                auto start = std::chrono::steady_clock::now();
+                try
+                {
+                    (*slot->consumer)(slot->frame);
+                }
+                catch (const std::exception& e)
+                {
+                    // the frame is lost, the slot is not
+                    std::cout << e.what() << std::endl;
+                }
+                auto end = std::chrono::steady_clock::now();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                double latency_ms = std::chrono::duration<double, std::milli>(start - slot->recorded).count();
+                captured_++;
+                bytes_ += slot->frame.size;
+                latency_ms_ += latency_ms;
+                max_latency_ms_ = std::max(max_latency_ms_, latency_ms);
+                latency_frames_ += latency_frames;
+                consumer_ms_ += std::chrono::duration<double, std::milli>(end - start).count();
+                slot->consumer.reset();
+                slot->state = SlotState::Free;
+            });
+        }
+    }
+
+    void FrameCapture::Wait()
+    {
+        consumer_thread_->Wait();
+    }
+
+    FrameCapture::Stats FrameCapture::GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats{};
+        stats.captured = captured_;
+        stats.dropped = dropped_;
+        stats.bytes = bytes_;
+        stats.max_latency_ms = max_latency_ms_;
+        stats.consumer_ms = consumer_ms_;
+        if (captured_ > 0)
+        {
+            stats.avg_latency_ms = latency_ms_ / captured_;
+            stats.avg_latency_frames = (double)latency_frames_ / captured_;
+        }
+        return stats;
+    }
+
+    void FrameCapture::SetConsumer(Consumer consumer)
+    {
+        consumer_ = consumer ? std::make_shared<const Consumer>(std::move(consumer)) : nullptr;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+namespace vk
+{
+    // Copies presented frames into a ring of host visible buffers and hands
+    // them to a consumer thread without stalling the frame loop.
+    //
+    // Record appends the copy to the frame's command buffer when a slot is
+    // free, otherwise the frame is dropped and counted; capturing never waits
+    // on the gpu. Update, called once per frame with the last retired frame
+    // number, passes the finished slots on in frame order, and the consumer
+    // reads the pixels straight out of the mapped buffer. A slot is reused
+    // once the consumer has returned, so a consumer slower than the frame
+    // rate shows up as dropped frames rather than as longer frame times.
+    //
+    // Record, Update and SetConsumer come from the thread driving the frames
+    // or a job it waits for; the consumer runs on the capture thread.
+    class FrameCapture
+    {
+    public:
+        struct Config
+        {
+            // frames in flight plus the ones the consumer may hold on to
+            uint32_t slot_count = 4;
+        };
+
+        // the pixels are only valid during the consumer call
+        struct Frame
+        {
+            uint64_t frame_number;
+            VkExtent2D extent;
+            // 4 bytes per pixel, rows tightly packed
+            VkFormat format;
+            const uint8_t* pixels;
+            size_t size;
+        };
+        using Consumer = std::function<void(const Frame& frame)>;
+
+        struct Stats
+        {
+            uint64_t captured;
+            // no free slot when the frame was recorded
+            uint64_t dropped;
+            uint64_t bytes;
+            // from recording the copy until the consumer got the frame
+            double avg_latency_ms;
+            double max_latency_ms;
+            double avg_latency_frames;
+            // spent in the consumer
+            double consumer_ms;
+        };
+
+    private:
+        enum class SlotState
+        {
+            Free,
+            Recorded,
+            Consuming,
+        };
+
+        struct Slot
+        {
+            SlotState state = SlotState::Free;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            Allocation allocation;
+            VkDeviceSize capacity = 0;
+            Frame frame{};
+            // the consumer set when the frame was recorded
+            std::shared_ptr<const Consumer> consumer;
+            std::chrono::steady_clock::time_point recorded;
+        };
+
+        MemoryAllocator& allocator_;
+        std::shared_ptr<const Consumer> consumer_;
+
+        std::mutex mutex_;
+        std::vector<Slot> slots_;
+        uint64_t captured_ = 0;
+        uint64_t dropped_ = 0;
+        uint64_t bytes_ = 0;
+        double latency_ms_ = 0.0;
+        double max_latency_ms_ = 0.0;
+        uint64_t latency_frames_ = 0;
+        double consumer_ms_ = 0.0;
+
+        std::unique_ptr<util::ThreadPool> consumer_thread_;
+
+    public:
+        FrameCapture(MemoryAllocator& allocator, const Config& config);
+        // finishes the frames already handed to the consumer
+        ~FrameCapture();
+
+        FrameCapture(const FrameCapture&) = delete;
+        FrameCapture& operator=(const FrameCapture&) = delete;
+
+        // Copy image, in TRANSFER_SRC_OPTIMAL with its transfer writes visible to
+        // transfer reads, and leave it in final_layout. Returns false when the
+        // frame is not captured, without a consumer or a free slot.
+        bool Record(VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent, VkFormat format, uint64_t frame_number,
+            VkImageLayout final_layout);
+        // hand every frame up to retired_frame to the consumer, current_frame is the one being recorded
+        void Update(uint64_t retired_frame, uint64_t current_frame);
+        // block until the consumer has finished every frame handed to it
+        void Wait();
+
+    public:
+        // getters
+        bool IsCapturing() const { return consumer_ != nullptr; }
+        Stats GetStats();
+
+        // setters
+        // null stops capturing, frames already recorded still go to the consumer they were recorded with
+        void SetConsumer(Consumer consumer);
+    };
+}
@@ -0,0 +1,243 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // in front of every allocation, keeps the user pointer 16 byte aligned
+        struct alignas(16) Header
+        {
+            uint64_t size;
+            uint32_t scope;
+            // size class + 1 for pooled blocks, else the offset from the system allocation
+            uint32_t origin;
+        };
+
+        constexpr size_t kBlockSizes[] = { 64, 128, 256, 512, 1024 };
+        constexpr size_t kChunkSize = 64 << 10;
+        // malloc alignment, pooled blocks are aligned to it
+        constexpr size_t kPoolAlignment = 16;
+
+        Header* GetHeader(void* memory)
+        {
+            return reinterpret_cast<Header*>(static_cast<uint8_t*>(memory) - sizeof(Header));
+        }
+    }
+
+    HostAllocator::HostAllocator(bool pooling)
+        : pooling_(pooling)
+    {
+        callbacks_.pUserData = this;
+        callbacks_.pfnAllocation = AllocationCallback;
+        callbacks_.pfnReallocation = ReallocationCallback;
+        callbacks_.pfnFree = FreeCallback;
+        callbacks_.pfnInternalAllocation = InternalAllocationCallback;
+        callbacks_.pfnInternalFree = InternalFreeCallback;
+
+        for (size_t block_size : kBlockSizes)
+            size_classes_.push_back({ block_size, {} });
+    }
+
+    HostAllocator::~HostAllocator()
+    {
+        for (void* chunk : chunks_)
+            std::free(chunk);
+    }
+
+    std::array<uint64_t, HostAllocator::kScopeCount> HostAllocator::TakeFrameAllocations()
+    {
+        std::array<uint64_t, kScopeCount> allocations{};
+        for (uint32_t scope = 0; scope < kScopeCount; scope++)
+            allocations[scope] = counters_[scope].frame_allocations.exchange(0);
+        return allocations;
+    }
+
+    std::array<HostAllocator::ScopeStats, HostAllocator::kScopeCount> HostAllocator::GetStats() const
+    {
+        std::array<ScopeStats, kScopeCount> stats{};
+        for (uint32_t scope = 0; scope < kScopeCount; scope++)
+        {
+            const Counters& counters = counters_[scope];
+            stats[scope].allocations = counters.allocations;
+            stats[scope].frees = counters.frees;
+            stats[scope].pooled_allocations = counters.pooled_allocations;
+            stats[scope].live_bytes = counters.live_bytes;
+            stats[scope].peak_bytes = counters.peak_bytes;
+            stats[scope].internal_allocations = counters.internal_allocations;
+            stats[scope].internal_live_bytes = counters.internal_live_bytes;
+        }
+        return stats;
+    }
+
+    const char* HostAllocator::GetScopeName(uint32_t scope)
+    {
+        switch (scope)
+        {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        default: return "unknown";
+        }
+    }
+
+    void* HostAllocator::Allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        if (size == 0)
+            return nullptr;
+
+        uint32_t size_class = FindSizeClass(size, alignment, scope);
+        if (size_class != ~0u)
+        {
+            uint8_t* block;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                SizeClass& pool = size_classes_[size_class];
+                if (pool.free_blocks.empty())
+                {
+                    // carve a new chunk into blocks of this class
+                    auto chunk = static_cast<uint8_t*>(std::malloc(kChunkSize));
+                    if (!chunk)
+                        return nullptr;
+                    chunks_.push_back(chunk);
+                    for (size_t offset = 0; offset + pool.block_size <= kChunkSize; offset += pool.block_size)
+                        pool.free_blocks.push_back(chunk + offset);
+                }
+                block = pool.free_blocks.back();
+                pool.free_blocks.pop_back();
+            }
+
+            auto header = reinterpret_cast<Header*>(block);
+            header->size = size;
+            header->scope = scope;
+            header->origin = size_class + 1;
+            CountAllocation(scope, size, true);
+            return block + sizeof(Header);
+        }
+
+        // room for the header in front and for aligning the pointer after it
+        alignment = std::max(alignment, alignof(Header));
+        auto raw = static_cast<uint8_t*>(std::malloc(size + sizeof(Header) + alignment - 1));
+        if (!raw)
+            return nullptr;
+
+        uintptr_t user = (reinterpret_cast<uintptr_t>(raw) + sizeof(Header) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        auto memory = reinterpret_cast<uint8_t*>(user);
+        Header* header = GetHeader(memory);
+        header->size = size;
+        header->scope = scope;
+        header->origin = static_cast<uint32_t>(memory - raw);
+        CountAllocation(scope, size, false);
+        return memory;
+    }
+
+    void* HostAllocator::Reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        if (!original)
+            return Allocate(size, alignment, scope);
+        if (size == 0)
+        {
+            Free(original);
+            return nullptr;
+        }
+
+        // a pooled block that still fits stays where it is
+        Header* header = GetHeader(original);
+        if (header->origin <= size_classes_.size() && header->scope == (uint32_t)scope &&
+            FindSizeClass(size, alignment, scope) == header->origin - 1)
+        {
+            CountFree(header->scope, header->size);
+            header->size = size;
+            CountAllocation(scope, size, true);
+            return original;
+        }
+
+        void* memory = Allocate(size, alignment, scope);
+        if (!memory)
+            return nullptr;
+        std::memcpy(memory, original, std::min<size_t>(size, header->size));
+        Free(original);
+        return memory;
+    }
+
+    void HostAllocator::Free(void* memory)
+    {
+        if (!memory)
+            return;
+
+        Header* header = GetHeader(memory);
+        CountFree(header->scope, header->size);
+        if (header->origin <= size_classes_.size())
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            size_classes_[header->origin - 1].free_blocks.push_back(reinterpret_cast<uint8_t*>(header));
+            return;
+        }
+        std::free(static_cast<uint8_t*>(memory) - header->origin);
+    }
+
+    uint32_t HostAllocator::FindSizeClass(size_t size, size_t alignment, VkSystemAllocationScope scope) const
+    {
+        if (!pooling_ || alignment > kPoolAlignment ||
+            (scope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && scope != VK_SYSTEM_ALLOCATION_SCOPE_OBJECT))
+            return ~0u;
+
+        for (uint32_t i = 0; i < size_classes_.size(); i++)
+        {
+            if (size + sizeof(Header) <= size_classes_[i].block_size)
+                return i;
+        }
+        return ~0u;
+    }
+
+    void HostAllocator::CountAllocation(VkSystemAllocationScope scope, size_t size, bool pooled)
+    {
+        Counters& counters = counters_[scope];
+        counters.allocations++;
+        counters.frame_allocations++;
+        if (pooled)
+            counters.pooled_allocations++;
+
+        uint64_t live = counters.live_bytes += size;
+        uint64_t peak = counters.peak_bytes;
+        while (live > peak && !counters.peak_bytes.compare_exchange_weak(peak, live))
+        {
+        }
+    }
+
+    void HostAllocator::CountFree(uint32_t scope, size_t size)
+    {
+        Counters& counters = counters_[scope];
+        counters.frees++;
+        counters.live_bytes -= size;
+    }
+
+    void* VKAPI_PTR HostAllocator::AllocationCallback(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        return static_cast<HostAllocator*>(user_data)->Allocate(size, alignment, scope);
+    }
+
+    void* VKAPI_PTR HostAllocator::ReallocationCallback(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        return static_cast<HostAllocator*>(user_data)->Reallocate(original, size, alignment, scope);
+    }
+
+    void VKAPI_PTR HostAllocator::FreeCallback(void* user_data, void* memory)
+    {
+        static_cast<HostAllocator*>(user_data)->Free(memory);
+    }
+
+    void VKAPI_PTR HostAllocator::InternalAllocationCallback(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+    {
+        Counters& counters = static_cast<HostAllocator*>(user_data)->counters_[scope];
+        counters.internal_allocations++;
+        counters.internal_live_bytes += size;
+    }
+
+    void VKAPI_PTR HostAllocator::InternalFreeCallback(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+    {
+        Counters& counters = static_cast<HostAllocator*>(user_data)->counters_[scope];
+        counters.internal_live_bytes -= size;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+namespace vk
+{
+    // VkAllocationCallbacks that account for the host memory Vulkan allocates.
+    //
+    // Every create and destroy call passes GetCallbacks(), so allocations are
+    // counted and sized per VkSystemAllocationScope, together with the internal
+    // allocations the driver reports. Small command and object scope
+    // allocations, the ones made while recording and creating objects, come
+    // from size class pools carved out of larger chunks and are recycled
+    // instead of going back to the system allocator; the pools never shrink.
+    //
+    // Drivers call back from whichever thread makes the Vulkan call, so the
+    // counters are atomic and the pools are locked. TakeFrameAllocations
+    // returns the allocations since its last call; once per frame it shows what
+    // the frame loop still allocates.
+    class HostAllocator
+    {
+    public:
+        static constexpr uint32_t kScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+        struct ScopeStats
+        {
+            // reallocations count as allocations
+            uint64_t allocations;
+            uint64_t frees;
+            // of those, served from the pools
+            uint64_t pooled_allocations;
+            uint64_t live_bytes;
+            uint64_t peak_bytes;
+            // reported by the driver, which allocated them itself
+            uint64_t internal_allocations;
+            uint64_t internal_live_bytes;
+        };
+
+    private:
+        struct Counters
+        {
+            std::atomic<uint64_t> allocations{ 0 };
+            std::atomic<uint64_t> frees{ 0 };
+            std::atomic<uint64_t> pooled_allocations{ 0 };
+            std::atomic<uint64_t> live_bytes{ 0 };
+            std::atomic<uint64_t> peak_bytes{ 0 };
+            std::atomic<uint64_t> internal_allocations{ 0 };
+            std::atomic<uint64_t> internal_live_bytes{ 0 };
+            // since the last TakeFrameAllocations
+            std::atomic<uint64_t> frame_allocations{ 0 };
+        };
+
+        struct SizeClass
+        {
+            // header included
+            size_t block_size;
+            std::vector<uint8_t*> free_blocks;
+        };
+
+        VkAllocationCallbacks callbacks_{};
+        bool pooling_;
+        std::array<Counters, kScopeCount> counters_;
+
+        std::mutex pool_mutex_;
+        std::vector<SizeClass> size_classes_;
+        std::vector<void*> chunks_;
+
+    public:
+        // without pooling every allocation goes to the system allocator, for comparisons
+        explicit HostAllocator(bool pooling = true);
+        // everything allocated through the callbacks must have been freed
+        ~HostAllocator();
+
+        HostAllocator(const HostAllocator&) = delete;
+        HostAllocator& operator=(const HostAllocator&) = delete;
+
+        // allocations per scope since the last call
+        std::array<uint64_t, kScopeCount> TakeFrameAllocations();
+        std::array<ScopeStats, kScopeCount> GetStats() const;
+
+        static const char* GetScopeName(uint32_t scope);
+
+    private:
+        void* Allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+        void* Reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+        void Free(void* memory);
+        // ~0u when the allocation goes to the system allocator
+        uint32_t FindSizeClass(size_t size, size_t alignment, VkSystemAllocationScope scope) const;
+        void CountAllocation(VkSystemAllocationScope scope, size_t size, bool pooled);
+        void CountFree(uint32_t scope, size_t size);
+
+        static void* VKAPI_PTR AllocationCallback(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope);
+        static void* VKAPI_PTR ReallocationCallback(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+        static void VKAPI_PTR FreeCallback(void* user_data, void* memory);
+        static void VKAPI_PTR InternalAllocationCallback(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+        static void VKAPI_PTR InternalFreeCallback(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    public:
+        // getters
+        const VkAllocationCallbacks* GetCallbacks() const { return &callbacks_; }
+        bool IsPooling() const { return pooling_; }
+    };
+}
@@ -0,0 +1,322 @@
+#include "pch.h"
+
+namespace util
+{
+    namespace
+    {
+        // lets nested Run and Wait calls find the deque of the worker they run on
+        thread_local const JobSystem* current_system = nullptr;
+        thread_local uint32_t current_worker = 0;
+        // jobs run from Wait inside other jobs are already part of the outer job's busy time
+        thread_local uint32_t execute_depth = 0;
+
+        int64_t NowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    struct JobSystem::Job
+    {
+        Work work;
+        // unfinished dependencies, plus one until Run
+        std::atomic<uint32_t> pending{ 1 };
+        // guards done and continuations
+        std::mutex mutex;
+        bool done = false;
+        std::vector<JobHandle> continuations;
+        std::atomic<bool> finished{ false };
+        // set by the first failing dependency, such a job is skipped
+        std::atomic<bool> skipped{ false };
+        // written before finished, by the job itself or by a failing dependency
+        std::exception_ptr error;
+    };
+
+    JobSystem::JobSystem(uint32_t thread_count)
+    {
+        if (thread_count == 0)
+            thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        thread_count_ = thread_count;
+        stats_start_ns_ = NowNs();
+
+        for (uint32_t i = 0; i <= thread_count_; i++)
+            workers_.push_back(std::make_unique<Worker>());
+
+        threads_.reserve(thread_count_);
+        for (uint32_t i = 0; i < thread_count_; i++)
+            threads_.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+    JobSystem::JobHandle JobSystem::Create(Work work)
+    {
+        auto job = std::make_shared<Job>();
+        job->work = std::move(work);
+        return job;
+    }
+
+    void JobSystem::AddDependency(const JobHandle& job, const JobHandle& dependency)
+    {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->done)
+        {
+            job->pending++;
+            dependency->continuations.push_back(job);
+        }
+        else if (dependency->error && !job->skipped.exchange(true))
+            job->error = dependency->error;
+    }
+
+    void JobSystem::Run(const JobHandle& job)
+    {
+        if (job->pending.fetch_sub(1) == 1)
+            Push(GetWorkerIndex(), job);
+    }
+
+    JobSystem::JobHandle JobSystem::Run(Work work, std::initializer_list<JobHandle> dependencies)
+    {
+        JobHandle job = Create(std::move(work));
+        for (const auto& dependency : dependencies)
+        {
+            if (dependency)
+                AddDependency(job, dependency);
+        }
+        Run(job);
+        return job;
+    }
+
+    void JobSystem::Wait(const JobHandle& job)
+    {
+        if (!job)
+            return;
+
+        uint32_t worker_index = GetWorkerIndex();
+        while (!job->finished)
+        {
+            if (RunOne(worker_index))
+                continue;
+
+            // nothing to help with, sleep until a job is queued or finishes
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            waiting_++;
+            wake_.wait(lock, [this, &job] { return job->finished || queued_ > 0; });
+            waiting_--;
+        }
+
+        if (job->error)
+            std::rethrow_exception(job->error);
+    }
+
+    void JobSystem::ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t, uint32_t)>& body)
+    {
+        if (count == 0)
+            return;
+
+        uint32_t range_count = std::clamp(count / std::max(grain, 1u), 1u, thread_count_ + 1);
+        if (range_count == 1)
+        {
+            body(GetWorkerIndex(), 0, count);
+            return;
+        }
+
+        std::vector<JobHandle> jobs;
+        jobs.reserve(range_count);
+        for (uint32_t i = 0; i < range_count; i++)
+        {
+            uint32_t begin = (uint64_t)count * i / range_count;
+            uint32_t end = (uint64_t)count * (i + 1) / range_count;
+            jobs.push_back(Run([&body, begin, end](uint32_t worker) { body(worker, begin, end); }));
+        }
+
+        // every job references body, so all of them have to finish before throwing
+        std::exception_ptr error;
+        for (const auto& job : jobs)
+        {
+            try
+            {
+                Wait(job);
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void JobSystem::ResetStats()
+    {
+        for (auto& worker : workers_)
+        {
+            worker->executed = 0;
+            worker->steals = 0;
+            worker->busy_ns = 0;
+        }
+        stats_start_ns_ = NowNs();
+    }
+
+    std::vector<JobSystem::WorkerStats> JobSystem::GetStats() const
+    {
+        double elapsed_ms = (NowNs() - stats_start_ns_) / 1e6;
+
+        std::vector<WorkerStats> stats;
+        stats.reserve(workers_.size());
+        for (const auto& worker : workers_)
+        {
+            WorkerStats worker_stats{};
+            worker_stats.jobs = worker->executed;
+            worker_stats.steals = worker->steals;
+            worker_stats.busy_ms = worker->busy_ns / 1e6;
+            worker_stats.utilization = elapsed_ms > 0.0 ? worker_stats.busy_ms / elapsed_ms : 0.0;
+            stats.push_back(worker_stats);
+        }
+        return stats;
+    }
+
+    bool JobSystem::IsFinished(const JobHandle& job)
+    {
+        return job && job->finished;
+    }
+
+    bool JobSystem::IsFailed(const JobHandle& job)
+    {
+        return IsFinished(job) && job->error;
+    }
+
+    void JobSystem::WorkerLoop(uint32_t worker_index)
+    {
+        current_system = this;
+        current_worker = worker_index;
+
+        while (true)
+        {
+            if (RunOne(worker_index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+            if (stopping_ && queued_ == 0)
+                return;
+        }
+    }
+
+    void JobSystem::Push(uint32_t worker_index, JobHandle job)
+    {
+        // counted first so a thief never takes the count below zero
+        queued_++;
+        {
+            Worker& worker = *workers_[worker_index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.jobs.push_back(std::move(job));
+        }
+
+        // pairs with the predicate checks under the lock, so no sleeper misses the job
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_one();
+    }
+
+    bool JobSystem::RunOne(uint32_t worker_index)
+    {
+        JobHandle job;
+        bool stolen = false;
+        {
+            // newest first, its data is most likely still cached
+            Worker& worker = *workers_[worker_index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.jobs.empty())
+            {
+                job = std::move(worker.jobs.back());
+                worker.jobs.pop_back();
+            }
+        }
+
+        // steal the oldest job of the next worker that has any, which tends to be the biggest
+        for (size_t i = 1; !job && i < workers_.size(); i++)
+        {
+            Worker& victim = *workers_[(worker_index + i) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                stolen = true;
+            }
+        }
+
+        if (!job)
+            return false;
+
+        queued_--;
+        if (stolen)
+            workers_[worker_index]->steals++;
+        Execute(worker_index, job);
+        return true;
+    }
+
+    void JobSystem::Execute(uint32_t worker_index, const JobHandle& job)
+    {
+        Worker& worker = *workers_[worker_index];
+        if (!job->skipped)
+        {
+            int64_t start = NowNs();
+            execute_depth++;
+            try
+            {
+                job->work(worker_index);
+            }
+            catch (...)
+            {
+                job->error = std::current_exception();
+            }
+            execute_depth--;
+            if (execute_depth == 0)
+                worker.busy_ns += NowNs() - start;
+            worker.executed++;
+        }
+        // let go of whatever the work captured
+        job->work = nullptr;
+
+        std::vector<JobHandle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done = true;
+            continuations.swap(job->continuations);
+        }
+        job->finished = true;
+
+        for (auto& continuation : continuations)
+        {
+            if (job->error && !continuation->skipped.exchange(true))
+                continuation->error = job->error;
+            if (continuation->pending.fetch_sub(1) == 1)
+                Push(worker_index, std::move(continuation));
+        }
+
+        if (waiting_ > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+            }
+            wake_.notify_all();
+        }
+    }
+
+    uint32_t JobSystem::GetWorkerIndex() const
+    {
+        return current_system == this ? current_worker : thread_count_;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+namespace util
+{
+    // Work stealing job scheduler with continuation style dependencies.
+    //
+    // Every worker owns a deque: it pushes and pops its own jobs at the back,
+    // so freshly released work stays hot in its cache, and steals from the front
+    // of the others' deques when its own runs dry. Jobs started from threads
+    // outside the pool go into one more deque that every worker steals from.
+    //
+    // A job runs once the jobs it depends on have finished; finishing releases
+    // the jobs waiting on it onto the finishing worker's deque. A job whose
+    // dependency threw is skipped and counts as failed, the exception surfaces
+    // from Wait. Waiting runs other jobs instead of blocking, so jobs may wait
+    // on jobs of their own.
+    //
+    // Work receives the index of the worker running it, GetThreadCount() for a
+    // thread outside the pool, so callers can keep per-worker state such as
+    // command pools without locking. Only one outside thread may run jobs at a
+    // time, the one driving the frame loop.
+    class JobSystem
+    {
+    public:
+        struct Job;
+        using JobHandle = std::shared_ptr<Job>;
+        using Work = std::function<void(uint32_t worker)>;
+
+        // since the last ResetStats, the last entry is the outside thread
+        struct WorkerStats
+        {
+            uint64_t jobs;
+            // jobs taken from another worker's deque
+            uint64_t steals;
+            double busy_ms;
+            // busy time over the time since the last ResetStats
+            double utilization;
+        };
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<JobHandle> jobs;
+            std::atomic<uint64_t> executed{ 0 };
+            std::atomic<uint64_t> steals{ 0 };
+            std::atomic<uint64_t> busy_ns{ 0 };
+        };
+
+        uint32_t thread_count_;
+        // one per thread plus the outside deque
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+        // jobs sitting in any deque
+        std::atomic<uint32_t> queued_{ 0 };
+        // threads asleep in Wait, woken whenever a job finishes
+        std::atomic<uint32_t> waiting_{ 0 };
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        std::atomic<int64_t> stats_start_ns_;
+
+    public:
+        // 0 picks one worker per hardware thread minus the calling thread
+        explicit JobSystem(uint32_t thread_count = 0);
+        // finishes the jobs already queued
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // the job starts once Run has been called and its dependencies have finished
+        JobHandle Create(Work work);
+        // job does not start before dependency has finished, only before job is run
+        void AddDependency(const JobHandle& job, const JobHandle& dependency);
+        // queue the job once its dependencies have finished
+        void Run(const JobHandle& job);
+        // create and run in one go
+        JobHandle Run(Work work, std::initializer_list<JobHandle> dependencies = {});
+
+        // Run other jobs until job has finished, rethrows its exception or the one
+        // it was skipped for. A null handle returns right away, a job that is
+        // never run never finishes.
+        void Wait(const JobHandle& job);
+        // Split [0, count) into ranges of at least grain items, one job each, and wait for all of them.
+        void ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t worker, uint32_t begin, uint32_t end)>& body);
+
+        void ResetStats();
+        std::vector<WorkerStats> GetStats() const;
+
+    private:
+        void WorkerLoop(uint32_t worker_index);
+        void Push(uint32_t worker_index, JobHandle job);
+        // pop an own job or steal one, false when every deque is empty
+        bool RunOne(uint32_t worker_index);
+        void Execute(uint32_t worker_index, const JobHandle& job);
+        // index of the calling thread, GetThreadCount() outside the pool
+        uint32_t GetWorkerIndex() const;
+
+    public:
+        // getters
+        uint32_t GetThreadCount() const { return thread_count_; }
+        static bool IsFinished(const JobHandle& job);
+        static bool IsFailed(const JobHandle& job);
+    };
+}
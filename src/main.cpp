@@ -1,21 +1,92 @@
 #include "pch.h"
 
-int main()
+// usage: vulkan-demo-2 [--present-mode fifo|fifo-relaxed|mailbox|immediate] [--low-latency] [--no-async-compute]
+//                      [--frame-budget MS] [--no-dynamic-resolution] [--shader-dir DIR]
+
+int main(int argc, char** argv)
 {
     try
     {
         constexpr uint32_t width = 800, height = 600;
+        constexpr uint32_t frames_in_flight = 2;
+
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        bool low_latency = false;
+        bool async_compute = true;
+        // the scene renders at a lower resolution when the gpu takes longer than this
+        double frame_budget_ms = 1000.0 / 60.0;
+        bool dynamic_resolution = true;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--low-latency")
+                low_latency = true;
+            else if (arg == "--no-async-compute")
+                async_compute = false;
+            else if (arg == "--no-dynamic-resolution")
+                dynamic_resolution = false;
+            else if (arg == "--frame-budget" && i + 1 < argc)
+                frame_budget_ms = std::stod(argv[++i]);
+            else if (arg == "--shader-dir" && i + 1 < argc)
+                // .spv files there replace the embedded shaders, without rebuilding
+                util::SetShaderDirectory(argv[++i]);
+            else if (arg == "--present-mode" && i + 1 < argc)
+            {
+                std::string mode = argv[++i];
+                if (mode == "fifo") present_mode = VK_PRESENT_MODE_FIFO_KHR;
+                else if (mode == "fifo-relaxed") present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                else if (mode == "mailbox") present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+                else if (mode == "immediate") present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                else throw std::runtime_error("Unknown present mode: " + mode);
+            }
+            else throw std::runtime_error("Unknown argument: " + arg);
+        }
 
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         GLFWwindow* window = glfwCreateWindow(width, height, "Vulkan window", nullptr, nullptr);
 
-        vk::VulkanManager vk_manager(window, width, height);
-        //vk::Renderer renderer;
-
-        while (!glfwWindowShouldClose(window))
         {
-            glfwPollEvents();
+            vk::VulkanManager vk_manager(window, width, height, frames_in_flight);
+            if (present_mode != VK_PRESENT_MODE_FIFO_KHR)
+                vk_manager.SetPresentMode(present_mode);
+            if (low_latency)
+                vk_manager.SetLowLatency(true);
+            vk_manager.SetAsyncCompute(async_compute);
+            vk_manager.GetDynamicResolution().SetBudget(frame_budget_ms);
+            vk_manager.GetDynamicResolution().SetEnabled(dynamic_resolution);
+            std::cout << "started in " << vk_manager.GetStartupTime() << " ms" << std::endl;
+            for (const auto& phase : vk_manager.GetStartupPhases())
+                std::cout << "  " << phase.name << ": " << phase.ms << " ms at " << phase.start_ms << " ms" << std::endl;
+
+            auto start = std::chrono::steady_clock::now();
+            while (!glfwWindowShouldClose(window))
+            {
+                glfwPollEvents();
+                // spin the test triangle, its transform is pushed with its draw
+                float angle = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+                float c = std::cos(angle), s = std::sin(angle);
+                vk_manager.SetDrawTransform(0, { c, s, 0, 0, -s, c, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 });
+                vk_manager.DrawFrame();
+            }
+
+            vk_manager.WaitIdle();
+            std::cout << "first frame submitted " << vk_manager.GetFirstFrameTime() << " ms after startup began" << std::endl;
+            vk_manager.GetProfiler().PrintSummary(std::cout);
+            if (vk_manager.GetComputeProfiler())
+            {
+                std::cout << "compute queue:" << std::endl;
+                vk_manager.GetComputeProfiler()->PrintSummary(std::cout);
+            }
+
+            // the last entry is this thread, which runs jobs while it waits for a frame's recording
+            auto worker_stats = vk_manager.GetJobSystem().GetStats();
+            const auto& resolution = vk_manager.GetDynamicResolution();
+            std::cout << "render scale " << resolution.GetScale() << " after " << resolution.GetChangeCount() << " changes" << std::endl;
+            std::cout << "worker utilization:";
+            for (const auto& stats : worker_stats)
+                std::cout << " " << std::lround(stats.utilization * 100.0) << "%";
+            std::cout << std::endl;
         }
 
         glfwDestroyWindow(window);
@@ -0,0 +1,409 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        VkDeviceSize AlignDown(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return value / alignment * alignment;
+        }
+
+        // true if the last byte of one resource and the first byte of the next share
+        // a bufferImageGranularity page
+        bool OnSamePage(VkDeviceSize end_of_a, VkDeviceSize start_of_b, VkDeviceSize granularity)
+        {
+            return AlignDown(end_of_a - 1, granularity) == AlignDown(start_of_b, granularity);
+        }
+    }
+
+    struct MemoryBlock
+    {
+        struct Used
+        {
+            VkDeviceSize size;
+            bool linear;
+        };
+
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t memory_type;
+        void* mapped;
+        // holds exactly one resource
+        bool dedicated;
+        // offset -> size
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+        // offset -> used range, needed for the granularity checks
+        std::map<VkDeviceSize, Used> used_ranges;
+    };
+
+    MemoryAllocator::MemoryAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize preferred_block_size,
+        const VkAllocationCallbacks* allocation_callbacks)
+        : physical_device_(physical_device), device_(device), preferred_block_size_(preferred_block_size), allocation_callbacks_(allocation_callbacks)
+    {
+        vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_properties_);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device_, &properties);
+        buffer_image_granularity_ = std::max<VkDeviceSize>(1, properties.limits.bufferImageGranularity);
+        non_coherent_atom_size_ = std::max<VkDeviceSize>(1, properties.limits.nonCoherentAtomSize);
+
+        blocks_.resize(memory_properties_.memoryTypeCount);
+        heap_stats_.resize(memory_properties_.memoryHeapCount);
+        for (uint32_t i = 0; i < memory_properties_.memoryHeapCount; i++)
+            heap_stats_[i].heap_size = memory_properties_.memoryHeaps[i].size;
+    }
+
+    MemoryAllocator::~MemoryAllocator()
+    {
+        for (auto& type_blocks : blocks_)
+        {
+            for (auto& block : type_blocks)
+            {
+                if (!block->used_ranges.empty())
+                    std::cout << "Leaked " << block->used_ranges.size() << " device memory allocations." << std::endl;
+                vkFreeMemory(device_, block->memory, allocation_callbacks_);
+            }
+        }
+    }
+
+    uint32_t MemoryAllocator::FindMemoryType(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+    {
+        // pick the supported type with all required flags and the most preferred flags
+        uint32_t best = UINT32_MAX;
+        int best_score = -1;
+        for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++)
+        {
+            VkMemoryPropertyFlags flags = memory_properties_.memoryTypes[i].propertyFlags;
+            if (!(type_bits & (1u << i)) || (flags & required) != required)
+                continue;
+
+            int score = 0;
+            for (VkMemoryPropertyFlags bits = flags & preferred; bits; bits &= bits - 1)
+                score++;
+            if (score > best_score)
+            {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (best == UINT32_MAX)
+            throw std::runtime_error("Failed to find suitable memory type.");
+        return best;
+    }
+
+    VkDeviceSize MemoryAllocator::BlockSizeFor(uint32_t memory_type) const
+    {
+        // small heaps, like the 256 MiB host visible device local heap, get smaller blocks
+        VkDeviceSize heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type].heapIndex].size;
+        return std::min(preferred_block_size_, std::max<VkDeviceSize>(heap_size / 8, 1 << 20));
+    }
+
+    MemoryBlock* MemoryAllocator::CreateBlock(uint32_t memory_type, VkDeviceSize size)
+    {
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        auto block = std::make_unique<MemoryBlock>();
+        block->size = size;
+        block->memory_type = memory_type;
+        block->mapped = nullptr;
+        block->dedicated = false;
+        if (vkAllocateMemory(device_, &alloc_info, allocation_callbacks_, &block->memory) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate device memory.");
+
+        if (memory_properties_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            if (vkMapMemory(device_, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+                throw std::runtime_error("Failed to map device memory.");
+        }
+
+        block->free_ranges[0] = size;
+
+        HeapStats& stats = heap_stats_[memory_properties_.memoryTypes[memory_type].heapIndex];
+        stats.block_bytes += size;
+        stats.block_count++;
+
+        blocks_[memory_type].push_back(std::move(block));
+        return blocks_[memory_type].back().get();
+    }
+
+    Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear)
+    {
+        VkMemoryPropertyFlags required = 0, preferred = 0;
+        switch (usage)
+        {
+        case MemoryUsage::GpuOnly:
+            preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            break;
+        case MemoryUsage::CpuToGpu:
+            required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            break;
+        case MemoryUsage::GpuToCpu:
+            required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        case MemoryUsage::GpuLazy:
+            preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            break;
+        }
+        uint32_t memory_type = FindMemoryType(requirements.memoryTypeBits, required, preferred);
+        HeapStats& stats = heap_stats_[memory_properties_.memoryTypes[memory_type].heapIndex];
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Allocation allocation;
+        allocation.memory_type = memory_type;
+        allocation.size = requirements.size;
+
+        // large resources get their own memory
+        VkDeviceSize block_size = BlockSizeFor(memory_type);
+        if (requirements.size > block_size / 2)
+        {
+            MemoryBlock* block = CreateBlock(memory_type, requirements.size);
+            block->dedicated = true;
+            block->free_ranges.clear();
+            block->used_ranges[0] = { requirements.size, linear };
+            allocation.memory = block->memory;
+            allocation.mapped = block->mapped;
+            allocation.block = block;
+            stats.used_bytes += allocation.size;
+            stats.allocation_count++;
+            return allocation;
+        }
+
+        // best fit over every block of this memory type
+        MemoryBlock* best_block = nullptr;
+        VkDeviceSize best_offset = 0, best_range_offset = 0, best_waste = UINT64_MAX;
+        auto try_block = [&](MemoryBlock* block)
+        {
+            for (auto& [range_offset, range_size] : block->free_ranges)
+            {
+                VkDeviceSize range_end = range_offset + range_size;
+                VkDeviceSize offset = AlignUp(range_offset, requirements.alignment);
+
+                // keep linear and optimal resources off each other's granularity pages
+                auto next = block->used_ranges.lower_bound(range_offset);
+                if (next != block->used_ranges.begin())
+                {
+                    auto previous = std::prev(next);
+                    if (previous->second.linear != linear &&
+                        OnSamePage(previous->first + previous->second.size, offset, buffer_image_granularity_))
+                        offset = AlignUp(offset, buffer_image_granularity_);
+                }
+                VkDeviceSize end = offset + requirements.size;
+                if (end > range_end)
+                    continue;
+                if (next != block->used_ranges.end() && next->second.linear != linear &&
+                    OnSamePage(end, next->first, buffer_image_granularity_))
+                    continue;
+
+                VkDeviceSize waste = range_size - requirements.size;
+                if (waste < best_waste)
+                {
+                    best_block = block;
+                    best_offset = offset;
+                    best_range_offset = range_offset;
+                    best_waste = waste;
+                }
+            }
+        };
+        for (auto& block : blocks_[memory_type])
+        {
+            if (!block->dedicated)
+                try_block(block.get());
+        }
+        if (!best_block)
+            try_block(CreateBlock(memory_type, block_size));
+        if (!best_block)
+            throw std::runtime_error("Failed to sub-allocate device memory.");
+
+        // split the free range around the allocation
+        VkDeviceSize range_size = best_block->free_ranges[best_range_offset];
+        VkDeviceSize range_end = best_range_offset + range_size;
+        VkDeviceSize end = best_offset + requirements.size;
+        best_block->free_ranges.erase(best_range_offset);
+        if (best_offset > best_range_offset)
+            best_block->free_ranges[best_range_offset] = best_offset - best_range_offset;
+        if (range_end > end)
+            best_block->free_ranges[end] = range_end - end;
+        best_block->used_ranges[best_offset] = { requirements.size, linear };
+
+        allocation.memory = best_block->memory;
+        allocation.offset = best_offset;
+        allocation.mapped = best_block->mapped ? static_cast<char*>(best_block->mapped) + best_offset : nullptr;
+        allocation.block = best_block;
+        stats.used_bytes += allocation.size;
+        stats.allocation_count++;
+        return allocation;
+    }
+
+    void MemoryAllocator::Free(const Allocation& allocation)
+    {
+        if (!allocation.block)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        MemoryBlock* block = allocation.block;
+        HeapStats& stats = heap_stats_[memory_properties_.memoryTypes[block->memory_type].heapIndex];
+        stats.used_bytes -= allocation.size;
+        stats.allocation_count--;
+
+        block->used_ranges.erase(allocation.offset);
+
+        // return the range and merge it with its free neighbours
+        VkDeviceSize offset = allocation.offset;
+        VkDeviceSize size = allocation.size;
+        auto next = block->free_ranges.lower_bound(offset);
+        if (next != block->free_ranges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                block->free_ranges.erase(previous);
+            }
+        }
+        if (next != block->free_ranges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            block->free_ranges.erase(next);
+        }
+        block->free_ranges[offset] = size;
+
+        // release empty blocks, keeping one block per memory type around to avoid thrashing
+        if (!block->used_ranges.empty())
+            return;
+        auto& type_blocks = blocks_[block->memory_type];
+        size_t empty_blocks = std::count_if(type_blocks.begin(), type_blocks.end(),
+            [](const std::unique_ptr<MemoryBlock>& b) { return !b->dedicated && b->used_ranges.empty(); });
+        if (block->dedicated || empty_blocks > 1)
+        {
+            stats.block_bytes -= block->size;
+            stats.block_count--;
+            vkFreeMemory(device_, block->memory, allocation_callbacks_);
+            type_blocks.erase(std::find_if(type_blocks.begin(), type_blocks.end(),
+                [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }));
+        }
+    }
+
+    Allocation MemoryAllocator::CreateBuffer(const VkBufferCreateInfo& create_info, MemoryUsage usage, VkBuffer* buffer)
+    {
+        if (vkCreateBuffer(device_, &create_info, allocation_callbacks_, buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create buffer.");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device_, *buffer, &requirements);
+
+        Allocation allocation = Allocate(requirements, usage, true);
+        if (vkBindBufferMemory(device_, *buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+            throw std::runtime_error("Failed to bind buffer memory.");
+        return allocation;
+    }
+
+    Allocation MemoryAllocator::CreateImage(const VkImageCreateInfo& create_info, MemoryUsage usage, VkImage* image)
+    {
+        if (vkCreateImage(device_, &create_info, allocation_callbacks_, image) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create image.");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device_, *image, &requirements);
+
+        Allocation allocation = Allocate(requirements, usage, create_info.tiling == VK_IMAGE_TILING_LINEAR);
+        if (vkBindImageMemory(device_, *image, allocation.memory, allocation.offset) != VK_SUCCESS)
+            throw std::runtime_error("Failed to bind image memory.");
+        return allocation;
+    }
+
+    void MemoryAllocator::DestroyBuffer(VkBuffer buffer, const Allocation& allocation)
+    {
+        vkDestroyBuffer(device_, buffer, allocation_callbacks_);
+        Free(allocation);
+    }
+
+    void MemoryAllocator::DestroyImage(VkImage image, const Allocation& allocation)
+    {
+        vkDestroyImage(device_, image, allocation_callbacks_);
+        Free(allocation);
+    }
+
+    VkMappedMemoryRange MemoryAllocator::AlignedRange(const Allocation& allocation) const
+    {
+        // ranges must be multiples of nonCoherentAtomSize and stay inside the allocation's memory
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = AlignDown(allocation.offset, non_coherent_atom_size_);
+        VkDeviceSize end = AlignUp(allocation.offset + allocation.size, non_coherent_atom_size_);
+        range.size = std::min(end, allocation.block->size) - range.offset;
+        return range;
+    }
+
+    void MemoryAllocator::Flush(const Allocation& allocation)
+    {
+        if (memory_properties_.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+            return;
+        VkMappedMemoryRange range = AlignedRange(allocation);
+        vkFlushMappedMemoryRanges(device_, 1, &range);
+    }
+
+    void MemoryAllocator::Invalidate(const Allocation& allocation)
+    {
+        if (memory_properties_.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+            return;
+        VkMappedMemoryRange range = AlignedRange(allocation);
+        vkInvalidateMappedMemoryRanges(device_, 1, &range);
+    }
+
+    std::vector<HeapStats> MemoryAllocator::GetHeapStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return heap_stats_;
+    }
+
+    RingBuffer::RingBuffer(MemoryAllocator& allocator, VkDeviceSize frame_size, uint32_t frame_count, VkBufferUsageFlags usage)
+        : allocator_(allocator), frame_count_(frame_count)
+    {
+        // 256 is the largest offset alignment any device requires, keep every segment start aligned
+        frame_size_ = AlignUp(frame_size, 256);
+
+        VkBufferCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        create_info.size = frame_size_ * frame_count_;
+        create_info.usage = usage;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        allocation_ = allocator_.CreateBuffer(create_info, MemoryUsage::CpuToGpu, &buffer_);
+    }
+
+    RingBuffer::~RingBuffer()
+    {
+        allocator_.DestroyBuffer(buffer_, allocation_);
+    }
+
+    RingBuffer::Slice RingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        VkDeviceSize offset = AlignUp(head_, std::max<VkDeviceSize>(alignment, 1));
+        if (offset + size > frame_size_)
+            throw std::runtime_error("Ring buffer frame segment exhausted.");
+        head_ = offset + size;
+
+        VkDeviceSize buffer_offset = frame_ * frame_size_ + offset;
+        return { buffer_, buffer_offset, static_cast<char*>(allocation_.mapped) + buffer_offset };
+    }
+
+    void RingBuffer::BeginFrame(uint32_t frame)
+    {
+        frame_ = frame % frame_count_;
+        head_ = 0;
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+namespace vk
+{
+    enum class MemoryUsage
+    {
+        // device local, never touched by the cpu
+        GpuOnly,
+        // host visible and coherent, written by the cpu every frame or for uploads
+        CpuToGpu,
+        // host visible, preferably cached, for readback
+        GpuToCpu,
+        // transient attachments, lazily allocated where the gpu keeps them on chip
+        GpuLazy,
+    };
+
+    struct MemoryBlock;
+
+    // a range of device memory handed out by MemoryAllocator
+    struct Allocation
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        // persistently mapped pointer to offset, null if not host visible
+        void* mapped = nullptr;
+        uint32_t memory_type = 0;
+        // owning block
+        MemoryBlock* block = nullptr;
+    };
+
+    struct HeapStats
+    {
+        VkDeviceSize heap_size = 0;
+        // bytes allocated from the driver
+        VkDeviceSize block_bytes = 0;
+        // bytes handed out to resources
+        VkDeviceSize used_bytes = 0;
+        uint32_t block_count = 0;
+        uint32_t allocation_count = 0;
+    };
+
+    // Sub-allocates resources from large VkDeviceMemory blocks so that the number
+    // of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+    // Blocks are managed as best-fit free lists, requests larger than half a block
+    // get a dedicated allocation.
+    class MemoryAllocator
+    {
+    private:
+        VkPhysicalDevice physical_device_;
+        VkDevice device_;
+        VkPhysicalDeviceMemoryProperties memory_properties_;
+        VkDeviceSize buffer_image_granularity_;
+        VkDeviceSize non_coherent_atom_size_;
+        VkDeviceSize preferred_block_size_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+
+        std::mutex mutex_;
+        // blocks per memory type
+        std::vector<std::vector<std::unique_ptr<MemoryBlock>>> blocks_;
+        std::vector<HeapStats> heap_stats_;
+
+    public:
+        MemoryAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize preferred_block_size = 64ull << 20,
+            const VkAllocationCallbacks* allocation_callbacks = nullptr);
+        ~MemoryAllocator();
+
+        MemoryAllocator(const MemoryAllocator&) = delete;
+        MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+        // linear is true for buffers and linear tiled images, false for optimal tiled images
+        Allocation Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear);
+        void Free(const Allocation& allocation);
+
+        // create a resource and bind it to a new allocation
+        Allocation CreateBuffer(const VkBufferCreateInfo& create_info, MemoryUsage usage, VkBuffer* buffer);
+        Allocation CreateImage(const VkImageCreateInfo& create_info, MemoryUsage usage, VkImage* image);
+        void DestroyBuffer(VkBuffer buffer, const Allocation& allocation);
+        void DestroyImage(VkImage image, const Allocation& allocation);
+
+        // no-ops on host coherent memory
+        void Flush(const Allocation& allocation);
+        void Invalidate(const Allocation& allocation);
+
+        uint32_t FindMemoryType(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+
+    private:
+        MemoryBlock* CreateBlock(uint32_t memory_type, VkDeviceSize size);
+        VkDeviceSize BlockSizeFor(uint32_t memory_type) const;
+        VkMappedMemoryRange AlignedRange(const Allocation& allocation) const;
+
+    public:
+        // getters
+        std::vector<HeapStats> GetHeapStats();
+        const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return memory_properties_; }
+    };
+
+    // A persistently mapped buffer split into one segment per frame in flight.
+    // Allocations bump a pointer inside the current frame's segment, BeginFrame
+    // switches to a frame's segment and rewinds it once the gpu has retired it.
+    class RingBuffer
+    {
+    private:
+        MemoryAllocator& allocator_;
+        VkBuffer buffer_;
+        Allocation allocation_;
+        VkDeviceSize frame_size_;
+        uint32_t frame_count_;
+        uint32_t frame_ = 0;
+        VkDeviceSize head_ = 0;
+
+    public:
+        struct Slice
+        {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+            void* mapped;
+        };
+
+        RingBuffer(MemoryAllocator& allocator, VkDeviceSize frame_size, uint32_t frame_count, VkBufferUsageFlags usage);
+        ~RingBuffer();
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        // throws if the frame's segment is exhausted
+        Slice Allocate(VkDeviceSize size, VkDeviceSize alignment);
+        void BeginFrame(uint32_t frame);
+
+    public:
+        // getters
+        VkBuffer GetBuffer() const { return buffer_; }
+        VkDeviceSize GetFrameSize() const { return frame_size_; }
+        VkDeviceSize GetFrameUsage() const { return head_; }
+    };
+}
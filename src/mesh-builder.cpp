@@ -0,0 +1,492 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // modelled cache for the triangle order, larger than most hardware so the order stays good on all of it
+        constexpr uint32_t kOptimizerCacheSize = 32;
+        // cache size the clusters are measured with
+        constexpr uint32_t kClusterCacheSize = 16;
+        // small clusters never amortize their cold cache
+        constexpr uint32_t kMinClusterTriangles = 16;
+        constexpr uint32_t kMaxGridResolution = 1024;
+
+        float VertexScore(int cache_position, uint32_t live_triangles)
+        {
+            if (live_triangles == 0)
+                return -1.0f;
+
+            float score = 0.0f;
+            if (cache_position >= 0)
+            {
+                // the last triangle's vertices score the same so that strips are not favoured over fans
+                if (cache_position < 3)
+                    score = 0.75f;
+                else
+                    score = std::pow(1.0f - (float)(cache_position - 3) / (kOptimizerCacheSize - 3), 1.5f);
+            }
+            // finish off vertices with few triangles left, they would otherwise leave holes
+            return score + 2.0f / std::sqrt((float)live_triangles);
+        }
+
+        // Forsyth, "Linear-Speed Vertex Cache Optimisation"
+        std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertex_count)
+        {
+            size_t triangle_count = indices.size() / 3;
+
+            // triangles of each vertex
+            std::vector<uint32_t> offsets(vertex_count + 1, 0);
+            for (uint32_t index : indices)
+                offsets[index + 1]++;
+            for (uint32_t v = 0; v < vertex_count; v++)
+                offsets[v + 1] += offsets[v];
+            std::vector<uint32_t> adjacency(indices.size());
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+            std::vector<uint32_t> live(vertex_count);
+            for (uint32_t v = 0; v < vertex_count; v++)
+                live[v] = offsets[v + 1] - offsets[v];
+            std::vector<int> cache_position(vertex_count, -1);
+            std::vector<float> vertex_score(vertex_count);
+            for (uint32_t v = 0; v < vertex_count; v++)
+                vertex_score[v] = VertexScore(-1, live[v]);
+
+            std::vector<float> triangle_score(triangle_count);
+            std::vector<bool> emitted(triangle_count, false);
+            for (size_t t = 0; t < triangle_count; t++)
+                triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            // room for the emitted triangle's vertices before they push others out
+            std::vector<uint32_t> cache;
+            cache.reserve(kOptimizerCacheSize + 3);
+            size_t scan = 0;
+
+            for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+            {
+                // best triangle touching the cache, or the first remaining one after a cache miss
+                size_t best = SIZE_MAX;
+                float best_score = -FLT_MAX;
+                for (uint32_t v : cache)
+                {
+                    for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+                    {
+                        uint32_t t = adjacency[a];
+                        if (!emitted[t] && triangle_score[t] > best_score)
+                        {
+                            best = t;
+                            best_score = triangle_score[t];
+                        }
+                    }
+                }
+                if (best == SIZE_MAX)
+                {
+                    while (emitted[scan])
+                        scan++;
+                    best = scan;
+                }
+
+                emitted[best] = true;
+                std::vector<uint32_t> next_cache;
+                next_cache.reserve(kOptimizerCacheSize + 3);
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t v = indices[best * 3 + corner];
+                    result.push_back(v);
+                    live[v]--;
+                    next_cache.push_back(v);
+                }
+                for (uint32_t v : cache)
+                {
+                    if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end())
+                        next_cache.push_back(v);
+                }
+
+                // vertices pushed out of the cache lose their position score
+                for (size_t i = kOptimizerCacheSize; i < next_cache.size(); i++)
+                {
+                    uint32_t v = next_cache[i];
+                    cache_position[v] = -1;
+                    vertex_score[v] = VertexScore(-1, live[v]);
+                }
+                next_cache.resize(std::min<size_t>(next_cache.size(), kOptimizerCacheSize));
+                cache.swap(next_cache);
+
+                for (size_t i = 0; i < cache.size(); i++)
+                {
+                    uint32_t v = cache[i];
+                    cache_position[v] = static_cast<int>(i);
+                    vertex_score[v] = VertexScore(static_cast<int>(i), live[v]);
+                }
+                for (uint32_t v : cache)
+                {
+                    for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+                    {
+                        uint32_t t = adjacency[a];
+                        if (!emitted[t])
+                            triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+                    }
+                }
+            }
+            return result;
+        }
+
+        // cache misses of a triangle range with a fifo cache
+        class CacheModel
+        {
+        private:
+            std::vector<uint32_t> timestamps_;
+            uint32_t time_;
+            uint32_t cache_size_;
+
+        public:
+            CacheModel(uint32_t vertex_count, uint32_t cache_size)
+                : timestamps_(vertex_count, 0), time_(cache_size + 1), cache_size_(cache_size)
+            {
+            }
+
+            void Reset() { time_ += cache_size_ + 1; }
+
+            uint32_t Triangle(const uint32_t* triangle)
+            {
+                uint32_t misses = 0;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t& timestamp = timestamps_[triangle[corner]];
+                    if (time_ - timestamp > cache_size_)
+                    {
+                        timestamp = time_++;
+                        misses++;
+                    }
+                }
+                return misses;
+            }
+        };
+
+        // Reorder clusters of a cache optimized triangle list so that outward
+        // facing ones come first. Clusters start with a cold cache, they end once
+        // their miss ratio is within the threshold of the whole list's.
+        std::vector<uint32_t> OptimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+        {
+            size_t triangle_count = indices.size() / 3;
+            if (triangle_count <= kMinClusterTriangles)
+                return indices;
+
+            float target = ComputeAcmr(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()), kClusterCacheSize) * threshold;
+
+            std::vector<size_t> cluster_starts;
+            CacheModel cache(static_cast<uint32_t>(vertices.size()), kClusterCacheSize);
+            size_t start = 0;
+            uint32_t misses = 0;
+            cluster_starts.push_back(0);
+            for (size_t t = 0; t < triangle_count; t++)
+            {
+                misses += cache.Triangle(&indices[t * 3]);
+                size_t size = t + 1 - start;
+                if (size >= kMinClusterTriangles && (float)misses / size <= target && t + 1 < triangle_count)
+                {
+                    start = t + 1;
+                    misses = 0;
+                    cache.Reset();
+                    cluster_starts.push_back(start);
+                }
+            }
+            cluster_starts.push_back(triangle_count);
+
+            // mesh centroid, weighted by area so dense regions do not pull it
+            double mesh_centroid[3] = {};
+            double mesh_area = 0.0;
+            struct Cluster
+            {
+                size_t first;
+                size_t last;
+                float centroid[3];
+                float normal[3];
+                float sort_key;
+            };
+            std::vector<Cluster> clusters;
+            for (size_t c = 0; c + 1 < cluster_starts.size(); c++)
+            {
+                Cluster cluster{};
+                cluster.first = cluster_starts[c];
+                cluster.last = cluster_starts[c + 1];
+
+                double centroid[3] = {};
+                double area_sum = 0.0;
+                for (size_t t = cluster.first; t < cluster.last; t++)
+                {
+                    const float* p0 = vertices[indices[t * 3]].position;
+                    const float* p1 = vertices[indices[t * 3 + 1]].position;
+                    const float* p2 = vertices[indices[t * 3 + 2]].position;
+                    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                    // twice the area in its length
+                    float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                    float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    for (int i = 0; i < 3; i++)
+                    {
+                        centroid[i] += (p0[i] + p1[i] + p2[i]) / 3.0 * area;
+                        cluster.normal[i] += n[i];
+                    }
+                    area_sum += area;
+                }
+
+                for (int i = 0; i < 3; i++)
+                {
+                    mesh_centroid[i] += centroid[i];
+                    cluster.centroid[i] = area_sum > 0.0 ? (float)(centroid[i] / area_sum) : vertices[indices[cluster.first * 3]].position[i];
+                }
+                mesh_area += area_sum;
+
+                float length = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+                if (length > 0.0f)
+                {
+                    for (int i = 0; i < 3; i++)
+                        cluster.normal[i] /= length;
+                }
+                clusters.push_back(cluster);
+            }
+            if (mesh_area > 0.0)
+            {
+                for (int i = 0; i < 3; i++)
+                    mesh_centroid[i] /= mesh_area;
+            }
+
+            // clusters facing away from the center occlude the rest from most directions
+            for (auto& cluster : clusters)
+            {
+                cluster.sort_key = 0.0f;
+                for (int i = 0; i < 3; i++)
+                    cluster.sort_key += (cluster.centroid[i] - (float)mesh_centroid[i]) * cluster.normal[i];
+            }
+            std::stable_sort(clusters.begin(), clusters.end(),
+                [](const Cluster& a, const Cluster& b) { return a.sort_key > b.sort_key; });
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            for (const auto& cluster : clusters)
+                result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+            return result;
+        }
+
+        // collapse every vertex onto its cell's representative, error is the largest distance moved
+        std::vector<uint32_t> ClusterVertices(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+            const float min[3], float cell_size, float& error)
+        {
+            std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+            std::vector<bool> used(vertices.size(), false);
+            for (uint32_t index : indices)
+                used[index] = true;
+
+            for (uint32_t v = 0; v < vertices.size(); v++)
+            {
+                if (!used[v])
+                    continue;
+                uint64_t cell = 0;
+                for (int i = 0; i < 3; i++)
+                {
+                    uint64_t coordinate = (uint64_t)((vertices[v].position[i] - min[i]) / cell_size);
+                    cell = (cell << 21) | std::min<uint64_t>(coordinate, (1u << 21) - 1);
+                }
+                cells[cell].push_back(v);
+            }
+
+            std::vector<uint32_t> remap(vertices.size());
+            error = 0.0f;
+            for (const auto& [cell, members] : cells)
+            {
+                float average[3] = {};
+                for (uint32_t v : members)
+                {
+                    for (int i = 0; i < 3; i++)
+                        average[i] += vertices[v].position[i] / members.size();
+                }
+
+                uint32_t representative = members[0];
+                float best = FLT_MAX;
+                for (uint32_t v : members)
+                {
+                    float dx = vertices[v].position[0] - average[0];
+                    float dy = vertices[v].position[1] - average[1];
+                    float dz = vertices[v].position[2] - average[2];
+                    float distance = dx * dx + dy * dy + dz * dz;
+                    if (distance < best)
+                    {
+                        best = distance;
+                        representative = v;
+                    }
+                }
+
+                const float* r = vertices[representative].position;
+                for (uint32_t v : members)
+                {
+                    remap[v] = representative;
+                    float dx = vertices[v].position[0] - r[0];
+                    float dy = vertices[v].position[1] - r[1];
+                    float dz = vertices[v].position[2] - r[2];
+                    error = std::max(error, std::sqrt(dx * dx + dy * dy + dz * dz));
+                }
+            }
+
+            // drop triangles that collapsed and the duplicates collapsing leaves behind
+            std::set<std::array<uint32_t, 3>> seen;
+            std::vector<uint32_t> result;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+
+                // rotate the smallest index first, keeping the winding
+                std::array<uint32_t, 3> key = { a, b, c };
+                if (b < a && b < c)
+                    key = { b, c, a };
+                else if (c < a && c < b)
+                    key = { c, a, b };
+                if (!seen.insert(key).second)
+                    continue;
+
+                result.insert(result.end(), { a, b, c });
+            }
+            return result;
+        }
+    }
+
+    MeshBuilder::MeshBuilder(const Config& config)
+        : config_(config)
+    {
+    }
+
+    void MeshBuilder::Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        if (indices.size() % 3 != 0)
+            throw std::runtime_error("Mesh indices are not a triangle list.");
+        for (uint32_t index : indices)
+        {
+            if (index >= vertices.size())
+                throw std::runtime_error("Mesh index out of range.");
+        }
+
+        uint32_t vertex_count = static_cast<uint32_t>(vertices.size());
+        std::vector<std::vector<uint32_t>> lod_indices = { indices };
+        std::vector<float> lod_errors = { 0.0f };
+
+        float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const auto& vertex : vertices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                min[i] = std::min(min[i], vertex.position[i]);
+                max[i] = std::max(max[i], vertex.position[i]);
+            }
+        }
+        float extent = 0.0f;
+        for (int i = 0; i < 3; i++)
+            extent = std::max(extent, max[i] - min[i]);
+
+        for (uint32_t lod = 0; lod < config_.lod_count && extent > 0.0f; lod++)
+        {
+            const auto& previous = lod_indices.back();
+            size_t target = previous.size() / 2;
+
+            // finest grid that halves the triangles, the count falls with the resolution
+            uint32_t low = 1, high = kMaxGridResolution;
+            std::vector<uint32_t> best;
+            float best_error = 0.0f;
+            while (low <= high)
+            {
+                uint32_t resolution = (low + high) / 2;
+                float error;
+                auto candidate = ClusterVertices(lod_indices[0], vertices, min, extent / resolution * 1.0001f, error);
+                if (candidate.size() <= target && !candidate.empty())
+                {
+                    best.swap(candidate);
+                    best_error = error;
+                    low = resolution + 1;
+                }
+                else
+                    high = resolution - 1;
+            }
+
+            if (best.empty() || best.size() > previous.size() * config_.lod_max_ratio)
+                break;
+            lod_indices.push_back(std::move(best));
+            lod_errors.push_back(best_error);
+        }
+
+        for (auto& lod : lod_indices)
+            lod = OptimizeOverdraw(OptimizeVertexCache(lod, vertex_count), vertices, config_.overdraw_threshold);
+
+        // number vertices by first use, finest lod first
+        std::vector<uint32_t> remap(vertex_count, ~0u);
+        vertices_.clear();
+        indices_.clear();
+        lods_.clear();
+        for (size_t l = 0; l < lod_indices.size(); l++)
+        {
+            MeshFileLod lod{};
+            lod.first_index = static_cast<uint32_t>(indices_.size());
+            lod.index_count = static_cast<uint32_t>(lod_indices[l].size());
+            lod.error = lod_errors[l];
+            lods_.push_back(lod);
+
+            for (uint32_t index : lod_indices[l])
+            {
+                if (remap[index] == ~0u)
+                {
+                    remap[index] = static_cast<uint32_t>(vertices_.size());
+                    vertices_.push_back(vertices[index]);
+                }
+                indices_.push_back(remap[index]);
+            }
+        }
+    }
+
+    void MeshBuilder::Write(const std::string& path) const
+    {
+        MeshFileHeader header{};
+        std::copy(std::begin(kMeshFileMagic), std::end(kMeshFileMagic), header.magic);
+        header.version = kMeshFileVersion;
+        header.vertex_count = static_cast<uint32_t>(vertices_.size());
+        header.index_count = static_cast<uint32_t>(indices_.size());
+        header.lod_count = static_cast<uint32_t>(lods_.size());
+        header.quantization = ComputeQuantization(vertices_);
+        ComputeBoundingSphere(vertices_, header.sphere);
+        header.vertex_data = sizeof(MeshFileHeader) + lods_.size() * sizeof(MeshFileLod);
+        // the vertices stay aligned to their size inside the mapping
+        header.vertex_data = (header.vertex_data + sizeof(PackedVertex) - 1) / sizeof(PackedVertex) * sizeof(PackedVertex);
+        header.index_data = header.vertex_data + vertices_.size() * sizeof(PackedVertex);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open mesh file: " + path);
+
+        auto packed = PackVertices(vertices_, header.quantization);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(lods_.data()), lods_.size() * sizeof(MeshFileLod));
+        std::vector<char> padding(header.vertex_data - sizeof(MeshFileHeader) - lods_.size() * sizeof(MeshFileLod), 0);
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(PackedVertex));
+        file.write(reinterpret_cast<const char*>(indices_.data()), indices_.size() * sizeof(uint32_t));
+
+        if (!file)
+            throw std::runtime_error("Failed to write mesh file: " + path);
+    }
+
+    float ComputeAcmr(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size)
+    {
+        if (index_count < 3)
+            return 0.0f;
+
+        CacheModel cache(vertex_count, cache_size);
+        uint32_t misses = 0;
+        for (size_t t = 0; t + 2 < index_count; t += 3)
+            misses += cache.Triangle(indices + t);
+        return (float)misses / (index_count / 3);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+namespace vk
+{
+    // Turns an indexed triangle mesh into a mesh file, offline.
+    //
+    // Simplified lods are generated by clustering vertices on a grid whose cells
+    // grow until the triangle count halves; each cell collapses onto its vertex
+    // closest to the cell's average, so every lod indexes the full resolution
+    // vertices. Each lod's triangles are then reordered for the post transform
+    // cache (Forsyth's linear speed algorithm) and split into clusters at points
+    // where the cache has warmed up again, which are sorted so that outward
+    // facing clusters are drawn first to cut overdraw. Finally vertices are
+    // reordered by first use for vertex fetch locality and unused ones dropped.
+    class MeshBuilder
+    {
+    public:
+        struct Config
+        {
+            // lods after the full resolution one
+            uint32_t lod_count = 3;
+            // a lod must keep less than this fraction of the previous lod's triangles
+            float lod_max_ratio = 0.8f;
+            // allowed cache miss ratio of a cluster over the whole lod, above 1 trades cache hits for less overdraw
+            float overdraw_threshold = 1.05f;
+        };
+
+    private:
+        Config config_;
+        std::vector<Vertex> vertices_;
+        std::vector<uint32_t> indices_;
+        std::vector<MeshFileLod> lods_;
+
+    public:
+        explicit MeshBuilder(const Config& config);
+
+        // Replace the built mesh. Indices are triangle lists.
+        void Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+        void Write(const std::string& path) const;
+
+    public:
+        // getters
+        const std::vector<Vertex>& GetVertices() const { return vertices_; }
+        const std::vector<uint32_t>& GetIndices() const { return indices_; }
+        const std::vector<MeshFileLod>& GetLods() const { return lods_; }
+    };
+
+    // average cache misses per triangle of a fifo post transform cache, 0.5 is ideal for regular grids
+    float ComputeAcmr(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+}
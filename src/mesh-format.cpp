@@ -0,0 +1,147 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        int16_t PackSnorm16(float value)
+        {
+            value = std::max(-1.0f, std::min(1.0f, value));
+            return static_cast<int16_t>(std::lround(value * 32767.0f));
+        }
+
+        // round to nearest even, overflow becomes infinity and tiny values flush to zero
+        uint16_t PackHalf(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+
+            uint32_t sign = (bits >> 16) & 0x8000;
+            uint32_t magnitude = bits & 0x7fffffff;
+            if (magnitude >= 0x7f800000)
+                return static_cast<uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+            if (magnitude >= 0x477ff000)
+                return static_cast<uint16_t>(sign | 0x7c00);
+            if (magnitude < 0x38800000)
+            {
+                // subnormal half
+                if (magnitude < 0x33000000)
+                    return static_cast<uint16_t>(sign);
+                uint32_t exponent = magnitude >> 23;
+                uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+                uint32_t shift = 126 - exponent;
+                uint32_t half = mantissa >> shift;
+                uint32_t remainder = mantissa & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if (remainder > halfway || (remainder == halfway && (half & 1)))
+                    half++;
+                return static_cast<uint16_t>(sign | half);
+            }
+
+            uint32_t half = (magnitude - 0x38000000) >> 13;
+            uint32_t remainder = magnitude & 0x1fff;
+            if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+                half++;
+            return static_cast<uint16_t>(sign | half);
+        }
+    }
+
+    Quantization ComputeQuantization(const std::vector<Vertex>& vertices)
+    {
+        float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const auto& vertex : vertices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                min[i] = std::min(min[i], vertex.position[i]);
+                max[i] = std::max(max[i], vertex.position[i]);
+            }
+        }
+
+        Quantization quantization{};
+        if (vertices.empty())
+        {
+            quantization.scale = 1.0f;
+            return quantization;
+        }
+
+        // one scale for all axes keeps the instance transform's normals and culling radius valid
+        float extent = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            quantization.offset[i] = (min[i] + max[i]) * 0.5f;
+            extent = std::max(extent, (max[i] - min[i]) * 0.5f);
+        }
+        quantization.scale = extent > 0.0f ? extent : 1.0f;
+        return quantization;
+    }
+
+    void ComputeBoundingSphere(const std::vector<Vertex>& vertices, float sphere[4])
+    {
+        float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const auto& vertex : vertices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                min[i] = std::min(min[i], vertex.position[i]);
+                max[i] = std::max(max[i], vertex.position[i]);
+            }
+        }
+        float center[3] = { (min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f };
+        float radius_squared = 0.0f;
+        for (const auto& vertex : vertices)
+        {
+            float dx = vertex.position[0] - center[0];
+            float dy = vertex.position[1] - center[1];
+            float dz = vertex.position[2] - center[2];
+            radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+        }
+
+        if (vertices.empty())
+            center[0] = center[1] = center[2] = 0.0f;
+        sphere[0] = center[0];
+        sphere[1] = center[1];
+        sphere[2] = center[2];
+        sphere[3] = std::sqrt(radius_squared);
+    }
+
+    PackedVertex PackVertex(const Vertex& vertex, const Quantization& quantization)
+    {
+        PackedVertex packed{};
+        for (int i = 0; i < 3; i++)
+            packed.position[i] = PackSnorm16((vertex.position[i] - quantization.offset[i]) / quantization.scale);
+
+        // project onto the octahedron and fold the lower half over the upper one
+        float nx = vertex.normal[0], ny = vertex.normal[1], nz = vertex.normal[2];
+        float length = std::abs(nx) + std::abs(ny) + std::abs(nz);
+        if (length > 0.0f)
+        {
+            nx /= length;
+            ny /= length;
+            if (nz < 0.0f)
+            {
+                float x = (1.0f - std::abs(ny)) * (nx >= 0.0f ? 1.0f : -1.0f);
+                float y = (1.0f - std::abs(nx)) * (ny >= 0.0f ? 1.0f : -1.0f);
+                nx = x;
+                ny = y;
+            }
+        }
+        packed.normal[0] = PackSnorm16(nx);
+        packed.normal[1] = PackSnorm16(ny);
+
+        packed.uv[0] = PackHalf(vertex.uv[0]);
+        packed.uv[1] = PackHalf(vertex.uv[1]);
+        return packed;
+    }
+
+    std::vector<PackedVertex> PackVertices(const std::vector<Vertex>& vertices, const Quantization& quantization)
+    {
+        std::vector<PackedVertex> packed;
+        packed.reserve(vertices.size());
+        for (const auto& vertex : vertices)
+            packed.push_back(PackVertex(vertex, quantization));
+        return packed;
+    }
+}
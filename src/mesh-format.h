@@ -0,0 +1,79 @@
+#pragma once
+
+namespace vk
+{
+    // authoring format, meshes are packed before they reach the gpu
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        float uv[2];
+    };
+
+    // Half the size of Vertex and what the vertex shader fetches.
+    //
+    // Positions are snorm16 inside a cube around the mesh, normals are octahedral
+    // snorm16 and uvs are half floats. A mesh's Quantization maps the positions
+    // back to object space and is folded into its instances' transforms, so the
+    // shader only has to normalize.
+    struct PackedVertex
+    {
+        // w is unused, three component 16 bit formats are not required for vertex input
+        int16_t position[4];
+        int16_t normal[2];
+        uint16_t uv[2];
+    };
+
+    // object space position = snorm position * scale + offset
+    struct Quantization
+    {
+        float offset[3];
+        float scale;
+    };
+
+    // Binary mesh file, little endian and laid out for memory mapping:
+    //
+    //     MeshFileHeader
+    //     MeshFileLod[lod_count], finest first
+    //     PackedVertex[vertex_count] at vertex_data
+    //     uint32_t[index_count] at index_data, the indices of every lod
+    //
+    // Every lod indexes the same vertices. Vertices are ordered by first use and
+    // each lod's triangles are ordered for the post transform cache and overdraw,
+    // so a loader only has to copy the two blocks into gpu buffers.
+    struct MeshFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t lod_count;
+        uint32_t padding;
+        Quantization quantization;
+        // object space bounding sphere, xyz center and w radius
+        float sphere[4];
+        // byte offsets from the start of the file
+        uint64_t vertex_data;
+        uint64_t index_data;
+    };
+
+    struct MeshFileLod
+    {
+        // relative to the first index of the file
+        uint32_t first_index;
+        uint32_t index_count;
+        // object space distance the lod's vertices may have moved
+        float error;
+        uint32_t padding;
+    };
+
+    constexpr char kMeshFileMagic[4] = { 'V', 'M', 'S', 'H' };
+    constexpr uint32_t kMeshFileVersion = 1;
+
+    // cube around the mesh's bounding box, never degenerate
+    Quantization ComputeQuantization(const std::vector<Vertex>& vertices);
+    // bounding sphere around the center of the bounding box
+    void ComputeBoundingSphere(const std::vector<Vertex>& vertices, float sphere[4]);
+    PackedVertex PackVertex(const Vertex& vertex, const Quantization& quantization);
+    std::vector<PackedVertex> PackVertices(const std::vector<Vertex>& vertices, const Quantization& quantization);
+}
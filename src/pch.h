@@ -2,8 +2,38 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <filesystem>
 #include <vector>
 #include <set>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <array>
+#include <chrono>
+#include <type_traits>
+
+// memory mapped files
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // GLFW
 #define GLFW_INCLUDE_VULKAN
@@ -16,6 +46,25 @@
 //#include <glm/mat4x4.hpp>
 
 #include "file.h"
+#include "shader-code.h"
+#include "thread-pool.h"
+#include "job-system.h"
+#include "deletion-queue.h"
 
-#include "vulkan-manager.h"
+#include "host-allocator.h"
+#include "memory-allocator.h"
+#include "uniform-ring.h"
+#include "bindless-heap.h"
+#include "pipeline-cache.h"
+#include "pipeline-library.h"
+#include "profiler.h"
+#include "render-graph.h"
+#include "dynamic-resolution.h"
+#include "post-processor.h"
+#include "upload-manager.h"
+#include "asset-streamer.h"
+#include "frame-capture.h"
+#include "mesh-format.h"
+#include "mesh-builder.h"
 #include "renderer.h"
+#include "vulkan-manager.h"
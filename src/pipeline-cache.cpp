@@ -0,0 +1,73 @@
+#include "pch.h"
+
+namespace vk
+{
+    PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path,
+        const VkAllocationCallbacks* allocation_callbacks)
+        : device_(device), allocation_callbacks_(allocation_callbacks), path_(path)
+    {
+        std::vector<char> data;
+        if (std::filesystem::exists(path_))
+        {
+            data = util::ReadFile(path_);
+            if (IsCompatible(data, properties))
+                warm_ = true;
+            else
+            {
+                std::cout << "Discarding stale pipeline cache: " << path_ << std::endl;
+                data.clear();
+            }
+        }
+
+        VkPipelineCacheCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = data.size();
+        create_info.pInitialData = data.empty() ? nullptr : data.data();
+
+        if (vkCreatePipelineCache(device_, &create_info, allocation_callbacks_, &cache_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline cache.");
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        vkDestroyPipelineCache(device_, cache_, allocation_callbacks_);
+    }
+
+    void PipelineCache::Save()
+    {
+        size_t size = 0;
+        if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS || size == 0)
+            return;
+
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS)
+            throw std::runtime_error("Failed to get pipeline cache data.");
+
+        // write to a temporary file and rename over the old cache so a crash
+        // mid-write never leaves a truncated cache behind
+        std::string temp_path = path_ + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                throw std::runtime_error("Failed to write pipeline cache: " + temp_path);
+            file.write(data.data(), size);
+            if (!file)
+                throw std::runtime_error("Failed to write pipeline cache: " + temp_path);
+        }
+        std::filesystem::rename(temp_path, path_);
+    }
+
+    bool PipelineCache::IsCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties)
+    {
+        VkPipelineCacheHeaderVersionOne header;
+        if (data.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        return header.headerSize >= sizeof(header) &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+}
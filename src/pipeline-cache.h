@@ -0,0 +1,34 @@
+#pragma once
+
+namespace vk
+{
+    // VkPipelineCache persisted to disk between runs
+    class PipelineCache
+    {
+    private:
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        VkPipelineCache cache_;
+        std::string path_;
+        // true if the cache was seeded from a valid file
+        bool warm_ = false;
+
+    public:
+        PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path,
+            const VkAllocationCallbacks* allocation_callbacks = nullptr);
+        ~PipelineCache();
+
+        PipelineCache(const PipelineCache&) = delete;
+        PipelineCache& operator=(const PipelineCache&) = delete;
+
+        void Save();
+
+    private:
+        static bool IsCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties);
+
+    public:
+        // getters
+        VkPipelineCache Get() const { return cache_; }
+        bool IsWarm() const { return warm_; }
+    };
+}
@@ -0,0 +1,512 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // bump when the manifest line layout changes, older manifests are ignored
+        constexpr const char* kManifestHeader = "pipeline-manifest 2";
+
+        // fnv-1a
+        struct Hasher
+        {
+            uint64_t value = 14695981039346656037ull;
+
+            void Add(const void* data, size_t size)
+            {
+                auto bytes = static_cast<const uint8_t*>(data);
+                for (size_t i = 0; i < size; i++)
+                {
+                    value ^= bytes[i];
+                    value *= 1099511628211ull;
+                }
+            }
+
+            void Add(uint64_t v) { Add(&v, sizeof(v)); }
+            void Add(const std::string& s) { Add(s.size()); Add(s.data(), s.size()); }
+        };
+    }
+
+    bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc& other) const
+    {
+        auto same_bindings = [](const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b)
+        {
+            return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+        };
+        auto same_attributes = [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b)
+        {
+            return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+        };
+
+        return vertex_shader == other.vertex_shader && fragment_shader == other.fragment_shader &&
+            layout == other.layout && render_pass == other.render_pass && subpass == other.subpass &&
+            std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(), same_bindings) &&
+            std::equal(attributes.begin(), attributes.end(), other.attributes.begin(), other.attributes.end(), same_attributes) &&
+            topology == other.topology && cull_mode == other.cull_mode && front_face == other.front_face &&
+            depth_test == other.depth_test && depth_write == other.depth_write && depth_compare == other.depth_compare &&
+            blend == other.blend;
+    }
+
+    size_t GraphicsPipelineDesc::Hash() const
+    {
+        Hasher hasher;
+        hasher.Add(vertex_shader);
+        hasher.Add(fragment_shader);
+        hasher.Add((uint64_t)layout);
+        hasher.Add((uint64_t)render_pass);
+        hasher.Add(subpass);
+        hasher.Add(bindings.size());
+        for (const auto& b : bindings)
+        {
+            hasher.Add(b.binding);
+            hasher.Add(b.stride);
+            hasher.Add(b.inputRate);
+        }
+        hasher.Add(attributes.size());
+        for (const auto& a : attributes)
+        {
+            hasher.Add(a.location);
+            hasher.Add(a.binding);
+            hasher.Add(a.format);
+            hasher.Add(a.offset);
+        }
+        hasher.Add(topology);
+        hasher.Add(cull_mode);
+        hasher.Add(front_face);
+        hasher.Add(depth_test);
+        hasher.Add(depth_write);
+        hasher.Add(depth_compare);
+        hasher.Add(blend);
+        return static_cast<size_t>(hasher.value);
+    }
+
+    PipelineLibrary::PipelineLibrary(const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), pipeline_cache_(config.pipeline_cache),
+        manifest_path_(config.manifest_path)
+    {
+        workers_ = std::make_unique<util::ThreadPool>(std::max(1u, config.worker_threads));
+    }
+
+    PipelineLibrary::~PipelineLibrary()
+    {
+        // compiles in flight write into the entries
+        workers_.reset();
+
+        for (const auto& entry : entries_)
+        {
+            if (entry.pipeline != VK_NULL_HANDLE)
+                vkDestroyPipeline(device_, entry.pipeline, allocation_callbacks_);
+        }
+        for (const auto& [path, module] : shader_modules_)
+            vkDestroyShaderModule(device_, module, allocation_callbacks_);
+    }
+
+    void PipelineLibrary::RegisterLayout(const std::string& name, VkPipelineLayout layout)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        layouts_[name] = layout;
+    }
+
+    void PipelineLibrary::RegisterRenderPass(const std::string& name, VkRenderPass render_pass)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        render_passes_[name] = render_pass;
+    }
+
+    uint32_t PipelineLibrary::Request(const GraphicsPipelineDesc& desc, uint32_t fallback)
+    {
+        return Add(desc, fallback, true);
+    }
+
+    uint32_t PipelineLibrary::Add(const GraphicsPipelineDesc& desc, uint32_t fallback, bool requested)
+    {
+        size_t hash = desc.Hash();
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& ids = index_[hash];
+            for (uint32_t existing : ids)
+            {
+                Entry& entry = entries_[existing];
+                if (entry.desc == desc)
+                {
+                    entry.requested = entry.requested || requested;
+                    // a prewarmed variant has no fallback yet; one whose chain leads back
+                    // here would make Get loop forever while neither is compiled
+                    if (entry.fallback == kNoPipeline && !FallsBackTo(fallback, existing))
+                        entry.fallback = fallback;
+                    return existing;
+                }
+            }
+
+            id = static_cast<uint32_t>(entries_.size());
+            Entry entry{};
+            entry.desc = desc;
+            entry.fallback = fallback;
+            entry.requested = requested;
+            entries_.push_back(std::move(entry));
+            ids.push_back(id);
+            pending_++;
+            if (!requested)
+                prewarmed_count_++;
+        }
+
+        workers_->Submit([this, id](uint32_t) { Compile(id); });
+        return id;
+    }
+
+    bool PipelineLibrary::FallsBackTo(uint32_t id, uint32_t target) const
+    {
+        for (; id != kNoPipeline; id = entries_.at(id).fallback)
+        {
+            if (id == target)
+                return true;
+        }
+        return false;
+    }
+
+    VkPipeline PipelineLibrary::Get(uint32_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // fallbacks can chain across several resizes, the newest ready one wins
+        while (id != kNoPipeline)
+        {
+            const Entry& entry = entries_.at(id);
+            if (entry.pipeline != VK_NULL_HANDLE)
+                return entry.pipeline;
+            id = entry.fallback;
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    void PipelineLibrary::Wait()
+    {
+        workers_->Wait();
+    }
+
+    void PipelineLibrary::Compile(uint32_t id)
+    {
+        // the description never changes once added and the deque keeps it in place
+        const GraphicsPipelineDesc* desc_pointer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            desc_pointer = &entries_[id].desc;
+        }
+        const GraphicsPipelineDesc& desc = *desc_pointer;
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try
+        {
+            VkPipelineShaderStageCreateInfo shader_stages[2]{};
+            shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+            shader_stages[0].module = GetShaderModule(desc.vertex_shader);
+            shader_stages[0].pName = "main";
+            shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            shader_stages[1].module = GetShaderModule(desc.fragment_shader);
+            shader_stages[1].pName = "main";
+
+            VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+            vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.bindings.size());
+            vertex_input_info.pVertexBindingDescriptions = desc.bindings.data();
+            vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.attributes.size());
+            vertex_input_info.pVertexAttributeDescriptions = desc.attributes.data();
+
+            VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+            input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+            input_assembly.topology = desc.topology;
+            input_assembly.primitiveRestartEnable = VK_FALSE;
+
+            // set while recording, see RenderGraph::SetViewport
+            VkPipelineViewportStateCreateInfo viewport_state{};
+            viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+            viewport_state.viewportCount = 1;
+            viewport_state.scissorCount = 1;
+
+            VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+            VkPipelineDynamicStateCreateInfo dynamic_state{};
+            dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+            dynamic_state.dynamicStateCount = 2;
+            dynamic_state.pDynamicStates = dynamic_states;
+
+            VkPipelineRasterizationStateCreateInfo rasterizer{};
+            rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+            rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+            rasterizer.lineWidth = 1.0f;
+            rasterizer.cullMode = desc.cull_mode;
+            rasterizer.frontFace = desc.front_face;
+
+            VkPipelineMultisampleStateCreateInfo multisampling{};
+            multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+            multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+            depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+            depth_stencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+            depth_stencil.depthWriteEnable = desc.depth_write ? VK_TRUE : VK_FALSE;
+            depth_stencil.depthCompareOp = desc.depth_compare;
+
+            VkPipelineColorBlendAttachmentState color_blend_attachment{};
+            color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            color_blend_attachment.blendEnable = desc.blend ? VK_TRUE : VK_FALSE;
+            color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+            color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+            color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+            VkPipelineColorBlendStateCreateInfo color_blending{};
+            color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+            color_blending.logicOpEnable = VK_FALSE;
+            color_blending.attachmentCount = 1;
+            color_blending.pAttachments = &color_blend_attachment;
+
+            VkGraphicsPipelineCreateInfo pipeline_info{};
+            pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            pipeline_info.stageCount = 2;
+            pipeline_info.pStages = shader_stages;
+            pipeline_info.pVertexInputState = &vertex_input_info;
+            pipeline_info.pInputAssemblyState = &input_assembly;
+            pipeline_info.pViewportState = &viewport_state;
+            pipeline_info.pRasterizationState = &rasterizer;
+            pipeline_info.pMultisampleState = &multisampling;
+            pipeline_info.pDepthStencilState = &depth_stencil;
+            pipeline_info.pColorBlendState = &color_blending;
+            pipeline_info.pDynamicState = &dynamic_state;
+            pipeline_info.layout = desc.layout;
+            pipeline_info.renderPass = desc.render_pass;
+            pipeline_info.subpass = desc.subpass;
+
+            // the pipeline cache is internally synchronized, workers share it
+            if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_info, allocation_callbacks_, &pipeline) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create graphics pipeline: " + desc.vertex_shader + ", " + desc.fragment_shader);
+        }
+        catch (const std::exception& e)
+        {
+            // draws keep using the fallback or stay skipped
+            std::cout << e.what() << std::endl;
+            pipeline = VK_NULL_HANDLE;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entries_[id];
+        entry.pipeline = pipeline;
+        entry.failed = pipeline == VK_NULL_HANDLE;
+        compile_ms_ += ms;
+        pending_--;
+    }
+
+    VkShaderModule PipelineLibrary::GetShaderModule(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(shader_mutex_);
+        auto it = shader_modules_.find(path);
+        if (it != shader_modules_.end())
+            return it->second;
+
+        auto code = util::LoadShaderCode(path);
+
+        VkShaderModuleCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        create_info.codeSize = code.size() * sizeof(uint32_t);
+        create_info.pCode = code.data();
+
+        VkShaderModule shader_module;
+        if (vkCreateShaderModule(device_, &create_info, allocation_callbacks_, &shader_module) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create shader module: " + path);
+
+        shader_modules_[path] = shader_module;
+        return shader_module;
+    }
+
+    uint32_t PipelineLibrary::LoadShaders()
+    {
+        std::ifstream file(manifest_path_);
+        std::string line;
+        if (!file.is_open() || !std::getline(file, line) || line != kManifestHeader)
+            return 0;
+
+        // every variant starts with its two shader paths
+        std::set<std::string> paths;
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string vertex_shader, fragment_shader;
+            if (stream >> vertex_shader >> fragment_shader)
+            {
+                paths.insert(vertex_shader);
+                paths.insert(fragment_shader);
+            }
+        }
+
+        uint32_t loaded = 0;
+        for (const auto& path : paths)
+        {
+            try
+            {
+                GetShaderModule(path);
+                loaded++;
+            }
+            catch (const std::exception& e)
+            {
+                // the variant fails again when compiled, with the same message
+                std::cout << e.what() << std::endl;
+            }
+        }
+        return loaded;
+    }
+
+    uint32_t PipelineLibrary::Prewarm()
+    {
+        std::ifstream file(manifest_path_);
+        if (!file.is_open())
+            return 0;
+
+        std::string line;
+        if (!std::getline(file, line) || line != kManifestHeader)
+        {
+            std::cout << "Ignoring stale pipeline manifest: " << manifest_path_ << std::endl;
+            return 0;
+        }
+
+        uint32_t added = 0;
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            GraphicsPipelineDesc desc;
+            std::string layout, render_pass;
+            uint32_t topology, cull_mode, front_face, depth_test, depth_write, depth_compare, blend;
+            size_t binding_count, attribute_count;
+
+            stream >> desc.vertex_shader >> desc.fragment_shader >> layout >> render_pass >> desc.subpass
+                >> topology >> cull_mode >> front_face >> depth_test >> depth_write >> depth_compare >> blend >> binding_count;
+            desc.bindings.resize(stream ? binding_count : 0);
+            for (auto& b : desc.bindings)
+            {
+                uint32_t input_rate;
+                stream >> b.binding >> b.stride >> input_rate;
+                b.inputRate = (VkVertexInputRate)input_rate;
+            }
+            stream >> attribute_count;
+            desc.attributes.resize(stream ? attribute_count : 0);
+            for (auto& a : desc.attributes)
+            {
+                uint32_t format;
+                stream >> a.location >> a.binding >> format >> a.offset;
+                a.format = (VkFormat)format;
+            }
+            if (!stream)
+                continue;
+
+            desc.topology = (VkPrimitiveTopology)topology;
+            desc.cull_mode = cull_mode;
+            desc.front_face = (VkFrontFace)front_face;
+            desc.depth_test = depth_test != 0;
+            desc.depth_write = depth_write != 0;
+            desc.depth_compare = (VkCompareOp)depth_compare;
+            desc.blend = blend != 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto layout_it = layouts_.find(layout);
+                auto render_pass_it = render_passes_.find(render_pass);
+                if (layout_it == layouts_.end() || render_pass_it == render_passes_.end())
+                    continue;
+                desc.layout = layout_it->second;
+                desc.render_pass = render_pass_it->second;
+            }
+
+            uint32_t before = GetPipelineCount();
+            Add(desc, kNoPipeline, false);
+            added += GetPipelineCount() - before;
+        }
+        return added;
+    }
+
+    void PipelineLibrary::SaveManifest()
+    {
+        std::ostringstream manifest;
+        manifest << kManifestHeader << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : entries_)
+            {
+                // what only a previous run wanted drops out here
+                const GraphicsPipelineDesc& desc = entry.desc;
+                std::string layout = GetLayoutName(desc.layout);
+                std::string render_pass = GetRenderPassName(desc.render_pass);
+                if (!entry.requested || entry.failed || layout.empty() || render_pass.empty())
+                    continue;
+
+                manifest << desc.vertex_shader << " " << desc.fragment_shader << " " << layout << " " << render_pass << " "
+                    << desc.subpass << " " << desc.topology << " " << desc.cull_mode << " " << desc.front_face << " "
+                    << desc.depth_test << " " << desc.depth_write << " " << desc.depth_compare << " " << desc.blend << " "
+                    << desc.bindings.size();
+                for (const auto& b : desc.bindings)
+                    manifest << " " << b.binding << " " << b.stride << " " << b.inputRate;
+                manifest << " " << desc.attributes.size();
+                for (const auto& a : desc.attributes)
+                    manifest << " " << a.location << " " << a.binding << " " << a.format << " " << a.offset;
+                manifest << "\n";
+            }
+        }
+
+        // same temporary file dance as the pipeline cache
+        std::string temp_path = manifest_path_ + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            if (!file.is_open())
+                throw std::runtime_error("Failed to write pipeline manifest: " + temp_path);
+            file << manifest.str();
+            if (!file)
+                throw std::runtime_error("Failed to write pipeline manifest: " + temp_path);
+        }
+        std::filesystem::rename(temp_path, manifest_path_);
+    }
+
+    std::string PipelineLibrary::GetLayoutName(VkPipelineLayout layout) const
+    {
+        for (const auto& [name, registered] : layouts_)
+        {
+            if (registered == layout)
+                return name;
+        }
+        return "";
+    }
+
+    std::string PipelineLibrary::GetRenderPassName(VkRenderPass render_pass) const
+    {
+        for (const auto& [name, registered] : render_passes_)
+        {
+            if (registered == render_pass)
+                return name;
+        }
+        return "";
+    }
+
+    uint32_t PipelineLibrary::GetPipelineCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(entries_.size());
+    }
+
+    uint32_t PipelineLibrary::GetPendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_;
+    }
+
+    uint32_t PipelineLibrary::GetPrewarmedCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return prewarmed_count_;
+    }
+
+    double PipelineLibrary::GetCompileTime()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compile_ms_;
+    }
+}
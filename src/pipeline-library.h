@@ -0,0 +1,133 @@
+#pragma once
+
+namespace vk
+{
+    // everything that tells two graphics pipelines apart
+    struct GraphicsPipelineDesc
+    {
+        // spir-v paths, entry point main
+        std::string vertex_shader;
+        std::string fragment_shader;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+        bool depth_test = false;
+        bool depth_write = false;
+        VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
+        // one color attachment, blended over or written
+        bool blend = false;
+
+        bool operator==(const GraphicsPipelineDesc& other) const;
+        size_t Hash() const;
+    };
+
+    // Graphics pipelines by description, compiled on worker threads.
+    //
+    // Requesting a description returns an id right away; an equal description
+    // returns the same id and the pipeline is only compiled once. Viewport and
+    // scissor are dynamic, so nothing depends on the target size. Until it is
+    // ready Get returns the fallback given with the request, if that one is
+    // ready, or null so the caller skips the draw for the frame. Nothing ever
+    // compiles on the thread recording frames.
+    //
+    // Every description requested during a run is written to a manifest, and
+    // Prewarm compiles the manifest's variants at startup so that variants the
+    // previous run needed mid-frame are ready before the first frame. Layouts
+    // and render passes are stored by the name they were registered under,
+    // variants whose names are not registered in this run are skipped.
+    class PipelineLibrary
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            VkPipelineCache pipeline_cache;
+            uint32_t worker_threads = 2;
+            std::string manifest_path;
+        };
+
+        static constexpr uint32_t kNoPipeline = ~0u;
+
+    private:
+        struct Entry
+        {
+            GraphicsPipelineDesc desc;
+            uint32_t fallback = kNoPipeline;
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            bool failed = false;
+            // requested by the application this run rather than only prewarmed
+            bool requested = false;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        VkPipelineCache pipeline_cache_;
+        std::string manifest_path_;
+
+        std::mutex mutex_;
+        // deque so that entries stay put while workers compile them
+        std::deque<Entry> entries_;
+        // ids by description hash
+        std::unordered_map<size_t, std::vector<uint32_t>> index_;
+        std::map<std::string, VkPipelineLayout> layouts_;
+        std::map<std::string, VkRenderPass> render_passes_;
+        uint32_t pending_ = 0;
+        uint32_t prewarmed_count_ = 0;
+        double compile_ms_ = 0.0;
+
+        // loaded on first use and kept, variants usually share their shaders
+        std::mutex shader_mutex_;
+        std::unordered_map<std::string, VkShaderModule> shader_modules_;
+
+        std::unique_ptr<util::ThreadPool> workers_;
+
+    public:
+        explicit PipelineLibrary(const Config& config);
+        // finishes queued compiles first
+        ~PipelineLibrary();
+
+        PipelineLibrary(const PipelineLibrary&) = delete;
+        PipelineLibrary& operator=(const PipelineLibrary&) = delete;
+
+        // names identify handles in the manifest, register before Prewarm and SaveManifest
+        void RegisterLayout(const std::string& name, VkPipelineLayout layout);
+        void RegisterRenderPass(const std::string& name, VkRenderPass render_pass);
+
+        // Queue a compile unless an equal description exists. fallback is drawn
+        // with while this one compiles, typically the variant it replaces.
+        uint32_t Request(const GraphicsPipelineDesc& desc, uint32_t fallback = kNoPipeline);
+        // the pipeline, else its ready fallback, else null; safe from any thread
+        VkPipeline Get(uint32_t id);
+        // create the manifest's shader modules ahead of Prewarm, before any render pass exists;
+        // returns how many were loaded
+        uint32_t LoadShaders();
+        // queue every variant of the manifest, returns how many were new
+        uint32_t Prewarm();
+        // block until every queued compile has finished
+        void Wait();
+        void SaveManifest();
+
+    private:
+        uint32_t Add(const GraphicsPipelineDesc& desc, uint32_t fallback, bool requested);
+        // id or one of its fallbacks is target, the mutex must be held
+        bool FallsBackTo(uint32_t id, uint32_t target) const;
+        void Compile(uint32_t id);
+        VkShaderModule GetShaderModule(const std::string& path);
+        std::string GetLayoutName(VkPipelineLayout layout) const;
+        std::string GetRenderPassName(VkRenderPass render_pass) const;
+
+    public:
+        // getters
+        uint32_t GetPipelineCount();
+        uint32_t GetPendingCount();
+        uint32_t GetPrewarmedCount();
+        // summed over workers
+        double GetCompileTime();
+    };
+}
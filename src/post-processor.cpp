@@ -0,0 +1,506 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // workgroup size of both shaders
+        constexpr uint32_t kGroupSize = 8;
+
+        VkShaderModule CreateShaderModule(VkDevice device, const VkAllocationCallbacks* allocation_callbacks, const std::string& filename)
+        {
+            auto code = util::LoadShaderCode(filename);
+
+            VkShaderModuleCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            create_info.codeSize = code.size() * sizeof(uint32_t);
+            create_info.pCode = code.data();
+
+            VkShaderModule shader_module;
+            if (vkCreateShaderModule(device, &create_info, allocation_callbacks, &shader_module) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create shader module.");
+
+            return shader_module;
+        }
+
+        VkImageMemoryBarrier ImageBarrier(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+            VkAccessFlags src_access, VkAccessFlags dst_access)
+        {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = src_access;
+            barrier.dstAccessMask = dst_access;
+            barrier.oldLayout = old_layout;
+            barrier.newLayout = new_layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            return barrier;
+        }
+
+        uint32_t GroupCount(uint32_t size)
+        {
+            return (size + kGroupSize - 1) / kGroupSize;
+        }
+    }
+
+    PostProcessor::PostProcessor(MemoryAllocator& allocator, const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), allocator_(allocator),
+        deletion_queue_(*config.deletion_queue),
+        async_available_(config.compute_queue_family_index != config.graphics_queue_family_index), extent_(config.extent),
+        render_extent_(config.extent)
+    {
+        queue_family_indices_.push_back(config.graphics_queue_family_index);
+        if (async_available_)
+            queue_family_indices_.push_back(config.compute_queue_family_index);
+
+        push_constants_.threshold = config.bloom_threshold;
+        push_constants_.intensity = config.bloom_intensity;
+        push_constants_.exposure = config.exposure;
+
+        slots_.resize(config.frames_in_flight + 1);
+        CreateSampler();
+        CreatePipelines(config.pipeline_cache);
+        CreateSlots();
+        if (async_available_)
+            CreateCommandPools(config.compute_queue_family_index);
+        CreateSemaphores();
+    }
+
+    PostProcessor::~PostProcessor()
+    {
+        DestroySlots(nullptr);
+        for (auto& slot : slots_)
+        {
+            if (slot.command_pool != VK_NULL_HANDLE)
+                vkDestroyCommandPool(device_, slot.command_pool, allocation_callbacks_);
+        }
+        vkDestroyPipeline(device_, tone_map_pipeline_, allocation_callbacks_);
+        vkDestroyPipeline(device_, bloom_pipeline_, allocation_callbacks_);
+        vkDestroyPipelineLayout(device_, pipeline_layout_, allocation_callbacks_);
+        vkDestroyDescriptorSetLayout(device_, set_layout_, allocation_callbacks_);
+        vkDestroySampler(device_, sampler_, allocation_callbacks_);
+    }
+
+    void PostProcessor::CreateSampler()
+    {
+        // bilinear taps do the downsample and the upsample of the bloom
+        VkSamplerCreateInfo sampler_info{};
+        sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_info.magFilter = VK_FILTER_LINEAR;
+        sampler_info.minFilter = VK_FILTER_LINEAR;
+        sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+        if (vkCreateSampler(device_, &sampler_info, allocation_callbacks_, &sampler_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing sampler.");
+    }
+
+    void PostProcessor::CreatePipelines(VkPipelineCache pipeline_cache)
+    {
+        // scene, bloom storage pair, filtered bloom, output
+        VkDescriptorSetLayoutBinding bindings[4]{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = 1;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = 2;
+        bindings[2].binding = 2;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[2].descriptorCount = 1;
+        bindings[3].binding = 3;
+        bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[3].descriptorCount = 1;
+        for (auto& binding : bindings)
+            binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo set_layout_info{};
+        set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        set_layout_info.bindingCount = 4;
+        set_layout_info.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device_, &set_layout_info, allocation_callbacks_, &set_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing descriptor set layout.");
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &set_layout_;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, allocation_callbacks_, &pipeline_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing pipeline layout.");
+
+        std::pair<const char*, VkPipeline*> pipelines[] = {
+            { "src/shaders/bloom_comp.spv", &bloom_pipeline_ },
+            { "src/shaders/tonemap_comp.spv", &tone_map_pipeline_ },
+        };
+        for (auto [path, pipeline] : pipelines)
+        {
+            VkShaderModule compute_shader = CreateShaderModule(device_, allocation_callbacks_, path);
+
+            VkComputePipelineCreateInfo pipeline_info{};
+            pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            pipeline_info.stage.module = compute_shader;
+            pipeline_info.stage.pName = "main";
+            pipeline_info.layout = pipeline_layout_;
+
+            VkResult result = vkCreateComputePipelines(device_, pipeline_cache, 1, &pipeline_info, allocation_callbacks_, pipeline);
+            vkDestroyShaderModule(device_, compute_shader, allocation_callbacks_);
+            if (result != VK_SUCCESS)
+                throw std::runtime_error(std::string("Failed to create post processing pipeline from ") + path);
+        }
+    }
+
+    void PostProcessor::CreateSlots()
+    {
+        uint32_t slot_count = static_cast<uint32_t>(slots_.size());
+        VkDescriptorPoolSize pool_sizes[2]{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_sizes[0].descriptorCount = 2 * slot_count;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pool_sizes[1].descriptorCount = 3 * slot_count;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = slot_count;
+        pool_info.poolSizeCount = 2;
+        pool_info.pPoolSizes = pool_sizes;
+
+        if (vkCreateDescriptorPool(device_, &pool_info, allocation_callbacks_, &descriptor_pool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing descriptor pool.");
+
+        VkExtent2D bloom_extent = { std::max(1u, (extent_.width + 1) / 2), std::max(1u, (extent_.height + 1) / 2) };
+        for (auto& slot : slots_)
+        {
+            slot.scene = CreateImage(kSceneFormat, extent_, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+            for (auto& bloom : slot.bloom)
+                bloom = CreateImage(kSceneFormat, bloom_extent, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+            slot.output = CreateImage(kOutputFormat, extent_, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+            VkDescriptorSetAllocateInfo allocate_info{};
+            allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocate_info.descriptorPool = descriptor_pool_;
+            allocate_info.descriptorSetCount = 1;
+            allocate_info.pSetLayouts = &set_layout_;
+
+            if (vkAllocateDescriptorSets(device_, &allocate_info, &slot.descriptor_set) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate post processing descriptor set.");
+
+            // storage images and the filtered bloom stay in the general layout
+            VkDescriptorImageInfo scene_info = { sampler_, slot.scene.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+            VkDescriptorImageInfo bloom_infos[2] = {
+                { VK_NULL_HANDLE, slot.bloom[0].view, VK_IMAGE_LAYOUT_GENERAL },
+                { VK_NULL_HANDLE, slot.bloom[1].view, VK_IMAGE_LAYOUT_GENERAL },
+            };
+            VkDescriptorImageInfo filtered_info = { sampler_, slot.bloom[0].view, VK_IMAGE_LAYOUT_GENERAL };
+            VkDescriptorImageInfo output_info = { VK_NULL_HANDLE, slot.output.view, VK_IMAGE_LAYOUT_GENERAL };
+
+            VkWriteDescriptorSet writes[4]{};
+            const VkDescriptorImageInfo* infos[4] = { &scene_info, bloom_infos, &filtered_info, &output_info };
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[i].dstSet = slot.descriptor_set;
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = i == 1 ? 2 : 1;
+                writes[i].descriptorType = i == 0 || i == 2 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                writes[i].pImageInfo = infos[i];
+            }
+            vkUpdateDescriptorSets(device_, 4, writes, 0, nullptr);
+        }
+    }
+
+    void PostProcessor::CreateCommandPools(uint32_t queue_family_index)
+    {
+        // reset as a whole when the slot comes around again
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex = queue_family_index;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        for (auto& slot : slots_)
+        {
+            if (vkCreateCommandPool(device_, &pool_info, allocation_callbacks_, &slot.command_pool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create post processing command pool.");
+
+            VkCommandBufferAllocateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            info.commandPool = slot.command_pool;
+            info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            info.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device_, &info, &slot.command_buffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate post processing command buffer.");
+        }
+    }
+
+    void PostProcessor::CreateSemaphores()
+    {
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext = &type_info;
+
+        if (vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks_, scene_semaphore_.Replace(device_, allocation_callbacks_)) != VK_SUCCESS ||
+            vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks_, post_semaphore_.Replace(device_, allocation_callbacks_)) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing timeline semaphores.");
+    }
+
+    PostProcessor::Image PostProcessor::CreateImage(VkFormat format, VkExtent2D extent, VkImageUsageFlags usage)
+    {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = format;
+        image_info.extent = { extent.width, extent.height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = usage;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // both queues touch every image depending on the mode, and the mode can change
+        // between frames, concurrent sharing saves the ownership transfers
+        if (queue_family_indices_.size() > 1)
+        {
+            image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            image_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_family_indices_.size());
+            image_info.pQueueFamilyIndices = queue_family_indices_.data();
+        }
+        else image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        Image image;
+        image.allocation = allocator_.CreateImage(image_info, MemoryUsage::GpuOnly, &image.image);
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = format;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device_, &view_info, allocation_callbacks_, &image.view) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post processing image view.");
+        return image;
+    }
+
+    void PostProcessor::DestroySlots(DeletionQueue* deletion_queue)
+    {
+        std::vector<Image> images;
+        for (auto& slot : slots_)
+        {
+            images.push_back(slot.scene);
+            images.push_back(slot.bloom[0]);
+            images.push_back(slot.bloom[1]);
+            images.push_back(slot.output);
+            slot.scene = slot.bloom[0] = slot.bloom[1] = slot.output = Image{};
+            slot.descriptor_set = VK_NULL_HANDLE;
+        }
+
+        // the pool frees the sets with it
+        auto destroy = [device = device_, allocation_callbacks = allocation_callbacks_, &allocator = allocator_, images = std::move(images),
+            pool = descriptor_pool_]
+        {
+            for (const auto& image : images)
+            {
+                vkDestroyImageView(device, image.view, allocation_callbacks);
+                allocator.DestroyImage(image.image, image.allocation);
+            }
+            vkDestroyDescriptorPool(device, pool, allocation_callbacks);
+        };
+        descriptor_pool_ = VK_NULL_HANDLE;
+
+        if (deletion_queue)
+            deletion_queue->Defer(std::move(destroy));
+        else destroy();
+    }
+
+    uint64_t PostProcessor::BeginFrame()
+    {
+        frame_++;
+        slot_ = static_cast<uint32_t>(frame_ % slots_.size());
+        return frame_;
+    }
+
+    void PostProcessor::Record(VkCommandBuffer command_buffer, Profiler* profiler)
+    {
+        const Slot& slot = slots_[slot_];
+        VkExtent2D bloom_extent = { std::max(1u, (render_extent_.width + 1) / 2), std::max(1u, (render_extent_.height + 1) / 2) };
+
+        // the previous contents of the slot are never read
+        VkImageMemoryBarrier barriers[3] = {
+            ImageBarrier(slot.bloom[0].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT),
+            ImageBarrier(slot.bloom[1].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT),
+            ImageBarrier(slot.output.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT),
+        };
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 3, barriers);
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &slot.descriptor_set, 0, nullptr);
+
+        uint32_t zone = profiler ? profiler->BeginGpuZone(command_buffer, "Bloom") : ~0u;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, bloom_pipeline_);
+        for (uint32_t pass = 0; pass < 3; pass++)
+        {
+            PushConstants push_constants = push_constants_;
+            push_constants.pass = pass;
+            push_constants.width = render_extent_.width;
+            push_constants.height = render_extent_.height;
+            vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+            vkCmdDispatch(command_buffer, GroupCount(bloom_extent.width), GroupCount(bloom_extent.height), 1);
+
+            // each pass reads what the one before it wrote, the last one is read by the tone map
+            VkImage written = slot.bloom[pass == 1 ? 1 : 0].image;
+            VkImageMemoryBarrier barrier = ImageBarrier(written, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        if (profiler)
+            profiler->EndGpuZone(command_buffer, zone);
+
+        zone = profiler ? profiler->BeginGpuZone(command_buffer, "ToneMap") : ~0u;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, tone_map_pipeline_);
+        PushConstants push_constants = push_constants_;
+        push_constants.pass = 0;
+        push_constants.width = render_extent_.width;
+        push_constants.height = render_extent_.height;
+        vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, GroupCount(render_extent_.width), GroupCount(render_extent_.height), 1);
+        if (profiler)
+            profiler->EndGpuZone(command_buffer, zone);
+
+        // ready for the composite blit, on whichever queue records it
+        VkImageMemoryBarrier barrier = ImageBarrier(slot.output.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        output_.image = slot.output.image;
+        output_.extent = render_extent_;
+    }
+
+    VkCommandBuffer PostProcessor::RecordAsync(Profiler* profiler)
+    {
+        if (!async_available_)
+            throw std::runtime_error("No separate compute queue to post process on.");
+
+        // the slot's last submission has retired, see the class comment
+        const Slot& slot = slots_[slot_];
+        vkResetCommandPool(device_, slot.command_pool, 0);
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(slot.command_buffer, &begin_info) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record post processing command buffer.");
+        if (profiler)
+            profiler->BeginGpuFrame(slot.command_buffer);
+        Record(slot.command_buffer, profiler);
+        if (profiler)
+            profiler->EndGpuFrame(slot.command_buffer);
+        if (vkEndCommandBuffer(slot.command_buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record post processing command buffer.");
+
+        unwaited_value_ = frame_;
+        return slot.command_buffer;
+    }
+
+    void PostProcessor::RecordComposite(VkCommandBuffer command_buffer, VkImage target, VkExtent2D target_extent, VkImageLayout final_layout,
+        VkPipelineStageFlags final_stages, VkAccessFlags final_access)
+    {
+        // the stage an acquire is waited on, so the transition happens after it
+        VkImageMemoryBarrier barrier = ImageBarrier(target, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.levelCount = 1;
+        range.layerCount = 1;
+        if (output_.image == VK_NULL_HANDLE)
+        {
+            VkClearColorValue black = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+            vkCmdClearColorImage(command_buffer, target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+        }
+        else
+        {
+            // scales when the target was resized after the output was rendered
+            VkImageBlit blit{};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.layerCount = 1;
+            blit.srcOffsets[1] = { (int32_t)output_.extent.width, (int32_t)output_.extent.height, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.layerCount = 1;
+            blit.dstOffsets[1] = { (int32_t)target_extent.width, (int32_t)target_extent.height, 1 };
+            vkCmdBlitImage(command_buffer, output_.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        }
+        output_ = Output{};
+
+        barrier = ImageBarrier(target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, final_layout, VK_ACCESS_TRANSFER_WRITE_BIT, final_access);
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, final_stages, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    void PostProcessor::Resize(VkExtent2D extent)
+    {
+        // a pending output keeps its old image and extent, the composite scales it
+        extent_ = extent;
+        render_extent_ = extent;
+        DestroySlots(&deletion_queue_);
+        CreateSlots();
+    }
+
+    void PostProcessor::SetRenderExtent(VkExtent2D extent)
+    {
+        render_extent_.width = std::clamp(extent.width, 1u, extent_.width);
+        render_extent_.height = std::clamp(extent.height, 1u, extent_.height);
+    }
+
+    uint64_t PostProcessor::TakePostWait()
+    {
+        uint64_t value = unwaited_value_;
+        unwaited_value_ = 0;
+        return value;
+    }
+
+    std::vector<VkImage> PostProcessor::GetSceneImages() const
+    {
+        std::vector<VkImage> images;
+        for (const auto& slot : slots_)
+            images.push_back(slot.scene.image);
+        return images;
+    }
+
+    std::vector<VkImageView> PostProcessor::GetSceneViews() const
+    {
+        std::vector<VkImageView> views;
+        for (const auto& slot : slots_)
+            views.push_back(slot.scene.view);
+        return views;
+    }
+}
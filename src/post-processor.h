@@ -0,0 +1,177 @@
+#pragma once
+
+namespace vk
+{
+    // Compute post-processing between the scene and the swapchain: a thresholded
+    // half resolution bloom, then tone mapping into an 8 bit image that the
+    // composite blits onto the target.
+    //
+    // The scene is rendered into one of the processor's HDR images. Post
+    // processing is recorded either into the frame's own command buffer, or on
+    // its own into a command buffer for a separate compute queue. In that case
+    // the frame's graphics submission signals the scene semaphore, the compute
+    // submission waits on it and signals the post semaphore, and the composite
+    // is recorded into the next frame, so the post processing of one frame
+    // overlaps the geometry of the next at the cost of a frame of latency.
+    //
+    // Images come in frames_in_flight + 1 slots because of that extra frame:
+    // a slot is reused once the frame that composited it has retired, which
+    // also covers its compute submission. Semaphore values are frame numbers.
+    //
+    // The scene may cover only the top left render extent of its image, for
+    // dynamic resolution. Both passes then work on that part only and the
+    // composite blit scales it up to the target.
+    class PostProcessor
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            VkPipelineCache pipeline_cache;
+            DeletionQueue* deletion_queue;
+            uint32_t frames_in_flight;
+            uint32_t graphics_queue_family_index;
+            // the graphics family when there is no separate compute family
+            uint32_t compute_queue_family_index;
+            VkExtent2D extent;
+            float exposure = 1.0f;
+            // scene brightness above which pixels bloom
+            float bloom_threshold = 1.0f;
+            float bloom_intensity = 0.5f;
+        };
+
+        static constexpr VkFormat kSceneFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+        static constexpr VkFormat kOutputFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+    private:
+        struct Image
+        {
+            VkImage image = VK_NULL_HANDLE;
+            Allocation allocation{};
+            VkImageView view = VK_NULL_HANDLE;
+        };
+
+        struct Slot
+        {
+            // rendered to by the graph, sampled by both passes
+            Image scene;
+            // half resolution, the blur ping-pongs between them
+            Image bloom[2];
+            Image output;
+            VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+            // async only, on the compute family
+            VkCommandPool command_pool = VK_NULL_HANDLE;
+            VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+        };
+
+        // matches the push constants of bloom.comp and tonemap.comp
+        struct PushConstants
+        {
+            uint32_t pass;
+            float threshold;
+            float intensity;
+            float exposure;
+            // render extent of the scene
+            uint32_t width;
+            uint32_t height;
+        };
+
+        // what the next composite blits from
+        struct Output
+        {
+            VkImage image = VK_NULL_HANDLE;
+            VkExtent2D extent{};
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        MemoryAllocator& allocator_;
+        DeletionQueue& deletion_queue_;
+        std::vector<uint32_t> queue_family_indices_;
+        bool async_available_;
+        VkExtent2D extent_;
+        // part of the scene images rendered to, at most extent_
+        VkExtent2D render_extent_;
+        PushConstants push_constants_{};
+
+        VkSampler sampler_;
+        VkDescriptorSetLayout set_layout_;
+        VkPipelineLayout pipeline_layout_;
+        VkPipeline bloom_pipeline_;
+        VkPipeline tone_map_pipeline_;
+        // one pool per size, retired as a whole on resize
+        VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+
+        std::vector<Slot> slots_;
+        uint64_t frame_ = 0;
+        uint32_t slot_ = 0;
+        Output output_;
+
+        // timeline semaphores, values are frame numbers
+        UniqueSemaphore scene_semaphore_;
+        UniqueSemaphore post_semaphore_;
+        // last post semaphore value no graphics submission has waited for yet
+        uint64_t unwaited_value_ = 0;
+
+    public:
+        PostProcessor(MemoryAllocator& allocator, const Config& config);
+        // the device must be idle
+        ~PostProcessor();
+
+        PostProcessor(const PostProcessor&) = delete;
+        PostProcessor& operator=(const PostProcessor&) = delete;
+
+        // Move to the next slot, returns the frame number. Call once the frame
+        // slot has retired and the frame is certain to be submitted.
+        uint64_t BeginFrame();
+
+        // Post process the current slot on the graphics queue, after the scene
+        // has reached the sampled layout in the compute stage.
+        void Record(VkCommandBuffer command_buffer, Profiler* profiler);
+        // Same as Record into the slot's compute command buffer, which waits on
+        // the scene semaphore and signals the post semaphore with the frame number.
+        VkCommandBuffer RecordAsync(Profiler* profiler);
+        // Blit the last finished output onto target, which ends in final_layout and
+        // is made visible to final_stages and final_access. Waits in the transfer
+        // stage, so acquires should be waited on there.
+        void RecordComposite(VkCommandBuffer command_buffer, VkImage target, VkExtent2D target_extent, VkImageLayout final_layout,
+            VkPipelineStageFlags final_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VkAccessFlags final_access = 0);
+
+        // Recreate every slot, the old images live on for the frames still using them.
+        // Imports of the scene images need to be updated afterwards. Also resets
+        // the render extent to the full extent.
+        void Resize(VkExtent2D extent);
+        // Post process only this much of the scene from the next Record on, clamped to the image extent.
+        void SetRenderExtent(VkExtent2D extent);
+
+        // post semaphore value the next graphics submission has to wait for, 0 for none
+        uint64_t TakePostWait();
+
+    private:
+        void CreateSampler();
+        void CreatePipelines(VkPipelineCache pipeline_cache);
+        void CreateSlots();
+        void CreateCommandPools(uint32_t queue_family_index);
+        void CreateSemaphores();
+        void DestroySlots(DeletionQueue* deletion_queue);
+        Image CreateImage(VkFormat format, VkExtent2D extent, VkImageUsageFlags usage);
+
+    public:
+        // getters
+        bool IsAsyncAvailable() const { return async_available_; }
+        VkExtent2D GetRenderExtent() const { return render_extent_; }
+        // a composite has something to blit
+        bool HasOutput() const { return output_.image != VK_NULL_HANDLE; }
+        uint32_t GetSlotCount() const { return static_cast<uint32_t>(slots_.size()); }
+        uint32_t GetSlot() const { return slot_; }
+        std::vector<VkImage> GetSceneImages() const;
+        std::vector<VkImageView> GetSceneViews() const;
+        VkSemaphore GetSceneSemaphore() const { return scene_semaphore_.Get(); }
+        VkSemaphore GetPostSemaphore() const { return post_semaphore_.Get(); }
+
+        // setters
+        void SetExposure(float exposure) { push_constants_.exposure = exposure; }
+        void SetBloom(float threshold, float intensity) { push_constants_.threshold = threshold; push_constants_.intensity = intensity; }
+    };
+}
@@ -0,0 +1,290 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        constexpr uint32_t kMaxGpuZones = 64;
+        constexpr uint32_t kQueriesPerFrame = kMaxGpuZones * 2;
+        // samples per zone in the rolling summary
+        constexpr size_t kHistorySize = 240;
+        // per thread, bounds the memory of a forgotten capture
+        constexpr size_t kMaxCaptureEvents = 1 << 20;
+        // threads use the graphics and the compute profiler at most
+        constexpr size_t kCachedBuffers = 4;
+
+        std::atomic<uint64_t> next_profiler_id{ 1 };
+    }
+
+    Profiler::CpuZone::CpuZone(Profiler& profiler, const char* name)
+        : profiler_(profiler), name_(name), start_us_(profiler.NowUs())
+    {
+    }
+
+    Profiler::CpuZone::~CpuZone()
+    {
+        profiler_.AddEvent(name_, false, start_us_, profiler_.NowUs() - start_us_);
+    }
+
+    Profiler::Profiler(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestamp_valid_bits, uint32_t frames_in_flight,
+        const VkAllocationCallbacks* allocation_callbacks)
+        : device_(device), allocation_callbacks_(allocation_callbacks), gpu_timestamps_(timestamp_valid_bits > 0),
+        timestamp_period_ns_(properties.limits.timestampPeriod),
+        timestamp_mask_(timestamp_valid_bits >= 64 ? ~0ull : (1ull << timestamp_valid_bits) - 1),
+        start_(std::chrono::steady_clock::now()), frames_(frames_in_flight), id_(next_profiler_id++)
+    {
+        if (!gpu_timestamps_)
+            return;
+
+        VkQueryPoolCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        create_info.queryCount = kQueriesPerFrame;
+
+        for (auto& frame : frames_)
+        {
+            if (vkCreateQueryPool(device_, &create_info, allocation_callbacks_, &frame.query_pool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create timestamp query pool.");
+        }
+        query_results_.resize(kQueriesPerFrame);
+    }
+
+    Profiler::~Profiler()
+    {
+        for (auto& frame : frames_)
+        {
+            if (frame.query_pool != VK_NULL_HANDLE)
+                vkDestroyQueryPool(device_, frame.query_pool, allocation_callbacks_);
+        }
+    }
+
+    void Profiler::BeginFrame(uint32_t frame_index)
+    {
+        recording_frame_ = frame_index;
+        Frame& frame = frames_[frame_index];
+        if (!gpu_timestamps_ || frame.zones.empty())
+            return;
+
+        // no wait flag, the fence has signalled so the results are there unless a zone was left open
+        VkResult result = vkGetQueryPoolResults(device_, frame.query_pool, 0, frame.query_count,
+            frame.query_count * sizeof(uint64_t), query_results_.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            // the first zone is the whole frame
+            uint64_t base = query_results_[frame.zones[0].begin_query] & timestamp_mask_;
+            for (const auto& zone : frame.zones)
+            {
+                uint64_t begin = query_results_[zone.begin_query] & timestamp_mask_;
+                uint64_t end = query_results_[zone.end_query] & timestamp_mask_;
+                double start_us = frame.anchor_us + (double)(begin - base) * timestamp_period_ns_ / 1000.0;
+                double duration_us = end > begin ? (double)(end - begin) * timestamp_period_ns_ / 1000.0 : 0.0;
+                AddEvent(zone.name, true, start_us, duration_us);
+            }
+            uint64_t end = query_results_[frame.zones[0].end_query] & timestamp_mask_;
+            last_gpu_frame_ms_ = end > base ? (double)(end - base) * timestamp_period_ns_ / 1e6 : 0.0;
+        }
+
+        frame.zones.clear();
+        frame.query_count = 0;
+    }
+
+    void Profiler::BeginGpuFrame(VkCommandBuffer command_buffer)
+    {
+        Frame& frame = frames_[recording_frame_];
+        frame.zones.clear();
+        frame.query_count = 0;
+        frame.anchor_us = NowUs();
+        if (!gpu_timestamps_)
+            return;
+
+        vkCmdResetQueryPool(command_buffer, frame.query_pool, 0, kQueriesPerFrame);
+        BeginGpuZone(command_buffer, "Frame");
+    }
+
+    void Profiler::EndGpuFrame(VkCommandBuffer command_buffer)
+    {
+        EndGpuZone(command_buffer, 0);
+    }
+
+    uint32_t Profiler::BeginGpuZone(VkCommandBuffer command_buffer, const char* name)
+    {
+        Frame& frame = frames_[recording_frame_];
+        if (!gpu_timestamps_ || frame.query_count + 2 > kQueriesPerFrame)
+            return ~0u;
+
+        GpuZone zone{};
+        zone.name = name;
+        zone.begin_query = frame.query_count++;
+        zone.end_query = frame.query_count++;
+        frame.zones.push_back(zone);
+
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.query_pool, zone.begin_query);
+        return static_cast<uint32_t>(frame.zones.size() - 1);
+    }
+
+    void Profiler::EndGpuZone(VkCommandBuffer command_buffer, uint32_t zone)
+    {
+        Frame& frame = frames_[recording_frame_];
+        if (zone >= frame.zones.size())
+            return;
+
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.query_pool, frame.zones[zone].end_query);
+    }
+
+    void Profiler::StartCapture()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [id, buffer] : thread_buffers_)
+        {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffer->events.clear();
+        }
+        capturing_ = true;
+    }
+
+    void Profiler::WriteTrace(const std::string& path)
+    {
+        std::vector<Event> events;
+        std::vector<uint32_t> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capturing_ = false;
+            for (const auto& [id, buffer] : thread_buffers_)
+            {
+                std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+                events.insert(events.end(), buffer->events.begin(), buffer->events.end());
+                buffer->events.clear();
+                threads.push_back(buffer->thread);
+            }
+        }
+
+        std::ofstream file(path);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open trace file: " + path);
+
+        // Chrome trace event format, complete events with microsecond timestamps
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}";
+        for (uint32_t thread : threads)
+        {
+            file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread
+                << ", \"args\": {\"name\": \"CPU " << thread << "\"}}";
+        }
+        for (const auto& event : events)
+        {
+            file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+                << ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us << "}";
+        }
+        file << "\n]}\n";
+    }
+
+    std::vector<ZoneStats> Profiler::GetSummary()
+    {
+        // zones of the same name from different threads are summarized together
+        std::map<std::pair<bool, std::string>, std::vector<double>> samples;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& [id, buffer] : thread_buffers_)
+            {
+                std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+                for (bool gpu : { false, true })
+                {
+                    for (const auto& [name, history] : gpu ? buffer->gpu_histories : buffer->cpu_histories)
+                    {
+                        auto& zone_samples = samples[{ gpu, name }];
+                        zone_samples.insert(zone_samples.end(), history.samples_ms.begin(), history.samples_ms.end());
+                    }
+                }
+            }
+        }
+
+        std::vector<ZoneStats> summary;
+        for (const auto& [key, zone_samples] : samples)
+        {
+            ZoneStats stats{};
+            stats.gpu = key.first;
+            stats.name = key.second;
+            stats.count = static_cast<uint32_t>(zone_samples.size());
+            stats.min_ms = *std::min_element(zone_samples.begin(), zone_samples.end());
+            stats.max_ms = *std::max_element(zone_samples.begin(), zone_samples.end());
+            double sum = 0.0;
+            for (double sample : zone_samples)
+                sum += sample;
+            stats.avg_ms = sum / stats.count;
+            summary.push_back(stats);
+        }
+        return summary;
+    }
+
+    void Profiler::PrintSummary(std::ostream& out)
+    {
+        for (const auto& stats : GetSummary())
+        {
+            out << (stats.gpu ? "gpu " : "cpu ") << stats.name
+                << ": avg " << stats.avg_ms << " ms, min " << stats.min_ms << " ms, max " << stats.max_ms
+                << " ms (" << stats.count << " samples)" << std::endl;
+        }
+    }
+
+    double Profiler::NowUs() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    Profiler::ThreadBuffer& Profiler::GetThreadBuffer()
+    {
+        struct CachedBuffer
+        {
+            uint64_t profiler;
+            ThreadBuffer* buffer;
+        };
+        thread_local std::array<CachedBuffer, kCachedBuffers> cache{};
+        thread_local size_t next_entry = 0;
+
+        for (const auto& entry : cache)
+        {
+            if (entry.profiler == id_)
+                return *entry.buffer;
+        }
+
+        // first event of this thread on this profiler, or evicted
+        ThreadBuffer* buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& slot = thread_buffers_[std::this_thread::get_id()];
+            if (!slot)
+            {
+                slot = std::make_unique<ThreadBuffer>();
+                slot->thread = static_cast<uint32_t>(thread_buffers_.size());
+            }
+            buffer = slot.get();
+        }
+        cache[next_entry] = { id_, buffer };
+        next_entry = (next_entry + 1) % kCachedBuffers;
+        return *buffer;
+    }
+
+    void Profiler::AddEvent(const char* name, bool gpu, double start_us, double duration_us)
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+
+        // names are string literals, the same pointer every time
+        History& history = (gpu ? buffer.gpu_histories : buffer.cpu_histories)[name];
+        if (history.samples_ms.size() < kHistorySize)
+        {
+            if (history.samples_ms.empty())
+                history.samples_ms.reserve(kHistorySize);
+            history.samples_ms.push_back(duration_us / 1000.0);
+        }
+        else
+        {
+            history.samples_ms[history.next] = duration_us / 1000.0;
+            history.next = (history.next + 1) % kHistorySize;
+        }
+
+        if (!capturing_ || buffer.events.size() >= kMaxCaptureEvents)
+            return;
+        buffer.events.push_back({ name, gpu ? 0 : buffer.thread, start_us, duration_us });
+    }
+}
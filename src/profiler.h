@@ -0,0 +1,152 @@
+#pragma once
+
+namespace vk
+{
+    // rolling statistics of one zone over the last samples
+    struct ZoneStats
+    {
+        std::string name;
+        bool gpu;
+        uint32_t count;
+        double min_ms;
+        double avg_ms;
+        double max_ms;
+    };
+
+    // Collects scoped CPU zones from any thread and GPU timestamp zones from the
+    // frame's primary command buffer.
+    //
+    // Every frame in flight owns a query pool. Its timestamps are read back in
+    // BeginFrame once the frame has retired, so results arrive
+    // frames_in_flight frames late and reading them never waits on the gpu.
+    // GPU zones are placed on the CPU timeline relative to the moment the frame
+    // started recording; durations and ordering are exact, the offset is not.
+    //
+    // Zones feed a rolling min/avg/max summary and, while capturing, a Chrome
+    // trace that chrome://tracing and Perfetto can open. Every thread records
+    // into its own buffer, keyed by the zone name's pointer, so ending a zone
+    // neither allocates nor contends once the thread has seen the name; the
+    // buffers are only merged when a summary or trace is read.
+    class Profiler
+    {
+    public:
+        class CpuZone
+        {
+        private:
+            Profiler& profiler_;
+            const char* name_;
+            double start_us_;
+
+        public:
+            // name must outlive the profiler, string literals are fine
+            CpuZone(Profiler& profiler, const char* name);
+            ~CpuZone();
+
+            CpuZone(const CpuZone&) = delete;
+            CpuZone& operator=(const CpuZone&) = delete;
+        };
+
+    private:
+        struct Event
+        {
+            const char* name;
+            // 0 is the gpu track
+            uint32_t thread;
+            double start_us;
+            double duration_us;
+        };
+
+        struct GpuZone
+        {
+            const char* name;
+            uint32_t begin_query;
+            uint32_t end_query;
+        };
+
+        struct Frame
+        {
+            VkQueryPool query_pool = VK_NULL_HANDLE;
+            uint32_t query_count = 0;
+            std::vector<GpuZone> zones;
+            // cpu time the frame started recording
+            double anchor_us = 0.0;
+        };
+
+        struct History
+        {
+            std::vector<double> samples_ms;
+            // next sample to overwrite once the history is full
+            size_t next = 0;
+        };
+
+        struct ThreadBuffer
+        {
+            // only contended while a summary or trace is read
+            std::mutex mutex;
+            // trace track, 0 is the gpu track
+            uint32_t thread;
+            std::unordered_map<const char*, History> cpu_histories;
+            std::unordered_map<const char*, History> gpu_histories;
+            std::vector<Event> events;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        // gpu zones are disabled when the graphics queue has no timestamps
+        bool gpu_timestamps_;
+        double timestamp_period_ns_;
+        uint64_t timestamp_mask_;
+        std::chrono::steady_clock::time_point start_;
+
+        std::vector<Frame> frames_;
+        uint32_t recording_frame_ = 0;
+        std::vector<uint64_t> query_results_;
+        // whole frame zone of the latest frame read back
+        double last_gpu_frame_ms_ = 0.0;
+
+        // tells profilers apart in the per thread lookup, addresses may be reused
+        uint64_t id_;
+        std::mutex mutex_;
+        std::map<std::thread::id, std::unique_ptr<ThreadBuffer>> thread_buffers_;
+        std::atomic<bool> capturing_{ false };
+
+    public:
+        // timestamp_valid_bits of the graphics queue family, 0 disables gpu zones
+        Profiler(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestamp_valid_bits, uint32_t frames_in_flight,
+            const VkAllocationCallbacks* allocation_callbacks = nullptr);
+        ~Profiler();
+
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        // Read the frame's previous timestamps. Call once its last submission has retired.
+        void BeginFrame(uint32_t frame);
+
+        // Reset the frame's queries and open the frame's gpu zone. Must be the
+        // first commands of the frame's primary command buffer.
+        void BeginGpuFrame(VkCommandBuffer command_buffer);
+        void EndGpuFrame(VkCommandBuffer command_buffer);
+        // returns the zone to end, ~0u when gpu zones are off or the pool is full
+        uint32_t BeginGpuZone(VkCommandBuffer command_buffer, const char* name);
+        void EndGpuZone(VkCommandBuffer command_buffer, uint32_t zone);
+
+        // record events for a trace until WriteTrace
+        void StartCapture();
+        // stop capturing and write the events as Chrome trace JSON
+        void WriteTrace(const std::string& path);
+
+        std::vector<ZoneStats> GetSummary();
+        void PrintSummary(std::ostream& out);
+
+    private:
+        double NowUs() const;
+        ThreadBuffer& GetThreadBuffer();
+        void AddEvent(const char* name, bool gpu, double start_us, double duration_us);
+
+    public:
+        // getters
+        bool HasGpuTimestamps() const { return gpu_timestamps_; }
+        // 0 until the first frame has been read back, or without gpu timestamps
+        double GetLastGpuFrameTime() const { return last_gpu_frame_ms_; }
+    };
+}
@@ -0,0 +1,1009 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        bool IsDepthFormat(VkFormat format)
+        {
+            switch (format)
+            {
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_X8_D24_UNORM_PACK32:
+            case VK_FORMAT_D32_SFLOAT:
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        bool HasStencil(VkFormat format)
+        {
+            return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+        }
+
+        VkImageAspectFlags AspectMask(VkFormat format)
+        {
+            if (!IsDepthFormat(format))
+                return VK_IMAGE_ASPECT_COLOR_BIT;
+            return VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        }
+    }
+
+    RenderGraph::RenderGraph(MemoryAllocator& allocator, const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), allocator_(allocator), profiler_(config.profiler),
+          deletion_queue_(config.deletion_queue), merge_subpasses_(config.merge_subpasses)
+    {
+    }
+
+    RenderGraph::~RenderGraph()
+    {
+        DestroyCompiled(nullptr);
+        for (const auto& [key, render_pass] : render_passes_)
+            vkDestroyRenderPass(device_, render_pass, allocation_callbacks_);
+    }
+
+    uint32_t RenderGraph::ImportImages(const char* name, VkFormat format, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+        VkImageLayout final_layout, VkPipelineStageFlags final_stages, VkAccessFlags final_access)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.desc.format = format;
+        resource.imported = true;
+        resource.final_layout = final_layout;
+        resource.final_stages = final_stages;
+        resource.final_access = final_access;
+        resources_.push_back(resource);
+
+        uint32_t id = static_cast<uint32_t>(resources_.size() - 1);
+        SetImportedImages(id, images, views);
+        return id;
+    }
+
+    void RenderGraph::SetImportedImages(uint32_t resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views)
+    {
+        if (images.empty() || images.size() != views.size())
+            throw std::runtime_error("Imported images need one view each.");
+
+        resources_.at(resource).images = images;
+        resources_.at(resource).views = views;
+    }
+
+    uint32_t RenderGraph::CreateImage(const char* name, const ImageDesc& desc)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.desc = desc;
+        resource.imported = false;
+        resources_.push_back(resource);
+        return static_cast<uint32_t>(resources_.size() - 1);
+    }
+
+    uint32_t RenderGraph::AddPass(const char* name, PassType type, RecordFunction record)
+    {
+        Pass pass{};
+        pass.name = name;
+        pass.type = type;
+        pass.record = std::move(record);
+        passes_.push_back(std::move(pass));
+        return static_cast<uint32_t>(passes_.size() - 1);
+    }
+
+    void RenderGraph::WriteColor(uint32_t pass, uint32_t resource, const VkClearColorValue* clear)
+    {
+        VkClearValue clear_value{};
+        if (clear)
+            clear_value.color = *clear;
+        AddUse(pass, resource, UseType::ColorAttachment, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, clear ? &clear_value : nullptr);
+    }
+
+    void RenderGraph::WriteDepth(uint32_t pass, uint32_t resource, const VkClearDepthStencilValue* clear)
+    {
+        VkClearValue clear_value{};
+        if (clear)
+            clear_value.depthStencil = *clear;
+        AddUse(pass, resource, UseType::DepthAttachment, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            clear ? &clear_value : nullptr);
+    }
+
+    void RenderGraph::ReadInputAttachment(uint32_t pass, uint32_t resource)
+    {
+        AddUse(pass, resource, UseType::InputAttachment, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, nullptr);
+    }
+
+    void RenderGraph::ReadSampled(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages)
+    {
+        AddUse(pass, resource, UseType::Sampled, stages, nullptr);
+    }
+
+    void RenderGraph::ReadStorage(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages)
+    {
+        AddUse(pass, resource, UseType::StorageRead, stages, nullptr);
+    }
+
+    void RenderGraph::WriteStorage(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages)
+    {
+        AddUse(pass, resource, UseType::StorageWrite, stages, nullptr);
+    }
+
+    void RenderGraph::SetSideEffect(uint32_t pass)
+    {
+        passes_.at(pass).side_effect = true;
+    }
+
+    void RenderGraph::SetSubpassContents(uint32_t pass, VkSubpassContents contents)
+    {
+        passes_.at(pass).contents = contents;
+    }
+
+    void RenderGraph::AddUse(uint32_t pass_index, uint32_t resource, UseType type, VkPipelineStageFlags stages, const VkClearValue* clear)
+    {
+        Pass& pass = passes_.at(pass_index);
+        bool depth = IsDepthFormat(resources_.at(resource).desc.format);
+        bool attachment = type == UseType::ColorAttachment || type == UseType::DepthAttachment || type == UseType::InputAttachment;
+        if (attachment && pass.type != PassType::Graphics)
+            throw std::runtime_error(std::string("Attachments need a graphics pass: ") + pass.name);
+        if ((type == UseType::ColorAttachment && depth) || (type == UseType::DepthAttachment && !depth))
+            throw std::runtime_error(std::string("Attachment format does not match its use: ") + resources_[resource].name);
+        for (const auto& use : pass.uses)
+        {
+            // feedback loops would need the general layout
+            if (use.resource == resource)
+                throw std::runtime_error(std::string("Image used twice by one pass: ") + resources_[resource].name);
+        }
+
+        Use use{};
+        use.resource = resource;
+        use.type = type;
+        use.stages = stages;
+        use.clear = clear != nullptr;
+        if (clear)
+            use.clear_value = *clear;
+
+        switch (type)
+        {
+        case UseType::ColorAttachment:
+            use.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            use.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            use.write = true;
+            break;
+        case UseType::DepthAttachment:
+            use.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            use.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            use.write = true;
+            break;
+        case UseType::InputAttachment:
+            use.layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            use.access = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+            break;
+        case UseType::Sampled:
+            use.layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            use.access = VK_ACCESS_SHADER_READ_BIT;
+            break;
+        case UseType::StorageRead:
+            use.layout = VK_IMAGE_LAYOUT_GENERAL;
+            use.access = VK_ACCESS_SHADER_READ_BIT;
+            break;
+        case UseType::StorageWrite:
+            use.layout = VK_IMAGE_LAYOUT_GENERAL;
+            use.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            use.write = true;
+            break;
+        }
+        pass.uses.push_back(use);
+    }
+
+    void RenderGraph::Compile()
+    {
+        DestroyCompiled(deletion_queue_);
+
+        for (auto& resource : resources_)
+        {
+            if (resource.imported || (resource.desc.extent.width == 0 && resource.desc.extent.height == 0))
+            {
+                float scale = resource.imported ? 1.0f : resource.desc.scale;
+                resource.extent = { std::max(1u, (uint32_t)(extent_.width * scale)), std::max(1u, (uint32_t)(extent_.height * scale)) };
+            }
+            else resource.extent = resource.desc.extent;
+        }
+
+        Cull();
+        BuildSteps();
+        CreateTransientImages();
+        CreateBarriers();
+        for (auto& step : steps_)
+        {
+            if (passes_[step.passes[0]].type != PassType::Graphics)
+                continue;
+            CreateRenderPass(step);
+            CreateFramebuffers(step);
+        }
+    }
+
+    void RenderGraph::Cull()
+    {
+        // walk backwards from the imported images, a pass is needed when it writes
+        // something needed and then needs whatever it reads or loads
+        std::vector<bool> needed(resources_.size(), false);
+        for (size_t i = 0; i < resources_.size(); i++)
+            needed[i] = resources_[i].imported;
+
+        culled_pass_count_ = 0;
+        for (size_t p = passes_.size(); p-- > 0;)
+        {
+            Pass& pass = passes_[p];
+            bool keep = pass.side_effect;
+            for (const auto& use : pass.uses)
+                keep |= use.write && needed[use.resource];
+
+            pass.culled = !keep;
+            if (!keep)
+            {
+                culled_pass_count_++;
+                continue;
+            }
+            for (const auto& use : pass.uses)
+            {
+                if (!use.clear)
+                    needed[use.resource] = true;
+            }
+        }
+    }
+
+    bool RenderGraph::CanMerge(const Step& step, const Pass& pass) const
+    {
+        auto is_attachment = [](UseType type)
+        {
+            return type == UseType::ColorAttachment || type == UseType::DepthAttachment || type == UseType::InputAttachment;
+        };
+
+        for (const auto& use : pass.uses)
+        {
+            if (is_attachment(use.type) &&
+                (resources_[use.resource].extent.width != step.extent.width || resources_[use.resource].extent.height != step.extent.height))
+                return false;
+
+            // anything the step touches must stay an attachment, other reads need the render pass to end
+            for (uint32_t other : step.passes)
+            {
+                for (const auto& other_use : passes_[other].uses)
+                {
+                    if (other_use.resource == use.resource && (!is_attachment(use.type) || !is_attachment(other_use.type)))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void RenderGraph::BuildSteps()
+    {
+        steps_.clear();
+        for (auto& resource : resources_)
+        {
+            resource.first_step = ~0u;
+            resource.last_step = 0;
+        }
+
+        std::vector<bool> written(resources_.size(), false);
+        for (uint32_t p = 0; p < passes_.size(); p++)
+        {
+            Pass& pass = passes_[p];
+            pass.subpass = kNoSubpass;
+            if (pass.culled)
+                continue;
+
+            for (const auto& use : pass.uses)
+            {
+                const Resource& resource = resources_[use.resource];
+                if (!use.write && !resource.imported && !written[use.resource])
+                    throw std::runtime_error(std::string("Pass ") + pass.name + " reads " + resource.name + " before anything writes it.");
+            }
+
+            bool graphics = pass.type == PassType::Graphics;
+            bool merge = graphics && merge_subpasses_ && !steps_.empty() &&
+                passes_[steps_.back().passes[0]].type == PassType::Graphics && CanMerge(steps_.back(), pass);
+            if (!merge)
+            {
+                Step step{};
+                if (graphics)
+                {
+                    // attachments of one pass must agree on their size
+                    bool sized = false;
+                    for (const auto& use : pass.uses)
+                    {
+                        if (use.type != UseType::ColorAttachment && use.type != UseType::DepthAttachment && use.type != UseType::InputAttachment)
+                            continue;
+                        VkExtent2D extent = resources_[use.resource].extent;
+                        if (sized && (extent.width != step.extent.width || extent.height != step.extent.height))
+                            throw std::runtime_error(std::string("Attachments of different sizes in pass ") + pass.name);
+                        step.extent = extent;
+                        sized = true;
+                    }
+                    if (!sized)
+                        step.extent = extent_;
+                }
+                steps_.push_back(step);
+            }
+
+            Step& step = steps_.back();
+            uint32_t step_index = static_cast<uint32_t>(steps_.size() - 1);
+            if (graphics)
+                pass.subpass = static_cast<uint32_t>(step.passes.size());
+            pass.step = step_index;
+            step.passes.push_back(p);
+
+            for (const auto& use : pass.uses)
+            {
+                Resource& resource = resources_[use.resource];
+                resource.first_step = std::min(resource.first_step, step_index);
+                resource.last_step = step_index;
+                written[use.resource] = written[use.resource] || use.write;
+            }
+        }
+    }
+
+    void RenderGraph::CreateTransientImages()
+    {
+        images_.assign(resources_.size(), VK_NULL_HANDLE);
+        views_.assign(resources_.size(), VK_NULL_HANDLE);
+        transient_bytes_ = 0;
+        unaliased_bytes_ = 0;
+
+        struct Candidate
+        {
+            uint32_t resource;
+            VkMemoryRequirements requirements;
+        };
+        std::vector<Candidate> candidates;
+
+        for (uint32_t r = 0; r < resources_.size(); r++)
+        {
+            Resource& resource = resources_[r];
+            resource.memory = ~0u;
+            resource.previous_occupant = ~0u;
+            resource.memoryless = false;
+            if (resource.imported || resource.first_step == ~0u)
+                continue;
+
+            // usage from every surviving use, attachments that live and die inside one render pass need no memory
+            resource.usage = 0;
+            bool attachments_only = true;
+            for (const auto& pass : passes_)
+            {
+                if (pass.culled)
+                    continue;
+                for (const auto& use : pass.uses)
+                {
+                    if (use.resource != r)
+                        continue;
+                    switch (use.type)
+                    {
+                    case UseType::ColorAttachment: resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+                    case UseType::DepthAttachment: resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+                    case UseType::InputAttachment: resource.usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT; break;
+                    case UseType::Sampled: resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; attachments_only = false; break;
+                    case UseType::StorageRead:
+                    case UseType::StorageWrite: resource.usage |= VK_IMAGE_USAGE_STORAGE_BIT; attachments_only = false; break;
+                    }
+                }
+            }
+            resource.memoryless = attachments_only && resource.first_step == resource.last_step;
+            if (resource.memoryless)
+                resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+            VkImageCreateInfo image_info{};
+            image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_info.imageType = VK_IMAGE_TYPE_2D;
+            image_info.format = resource.desc.format;
+            image_info.extent = { resource.extent.width, resource.extent.height, 1 };
+            image_info.mipLevels = 1;
+            image_info.arrayLayers = 1;
+            image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_info.usage = resource.usage;
+            image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (resource.memoryless)
+            {
+                resource.memory = static_cast<uint32_t>(memory_.size());
+                memory_.push_back(allocator_.CreateImage(image_info, MemoryUsage::GpuLazy, &images_[r]));
+                transient_bytes_ += memory_.back().size;
+                unaliased_bytes_ += memory_.back().size;
+                resource.previous_occupant = r;
+                continue;
+            }
+
+            if (vkCreateImage(device_, &image_info, allocation_callbacks_, &images_[r]) != VK_SUCCESS)
+                throw std::runtime_error(std::string("Failed to create render graph image: ") + resource.name);
+
+            Candidate candidate{};
+            candidate.resource = r;
+            vkGetImageMemoryRequirements(device_, images_[r], &candidate.requirements);
+            unaliased_bytes_ += candidate.requirements.size;
+            candidates.push_back(candidate);
+        }
+
+        // largest first, each image joins the first group it fits in without overlapping lifetimes
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) { return a.requirements.size > b.requirements.size; });
+
+        struct Group
+        {
+            VkMemoryRequirements requirements;
+            std::vector<uint32_t> resources;
+        };
+        std::vector<Group> groups;
+        for (const auto& candidate : candidates)
+        {
+            const Resource& resource = resources_[candidate.resource];
+            Group* target = nullptr;
+            for (auto& group : groups)
+            {
+                if (!(group.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits))
+                    continue;
+                bool overlaps = false;
+                for (uint32_t other : group.resources)
+                {
+                    const Resource& o = resources_[other];
+                    overlaps |= resource.first_step <= o.last_step && o.first_step <= resource.last_step;
+                }
+                if (!overlaps)
+                {
+                    target = &group;
+                    break;
+                }
+            }
+
+            if (!target)
+            {
+                groups.push_back({ candidate.requirements, {} });
+                target = &groups.back();
+            }
+            else
+            {
+                target->requirements.size = std::max(target->requirements.size, candidate.requirements.size);
+                target->requirements.alignment = std::max(target->requirements.alignment, candidate.requirements.alignment);
+                target->requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+            }
+            target->resources.push_back(candidate.resource);
+        }
+
+        for (auto& group : groups)
+        {
+            uint32_t memory = static_cast<uint32_t>(memory_.size());
+            memory_.push_back(allocator_.Allocate(group.requirements, MemoryUsage::GpuOnly, false));
+            transient_bytes_ += group.requirements.size;
+
+            // in order of use, the first one follows the last one of the previous frame
+            std::sort(group.resources.begin(), group.resources.end(),
+                [this](uint32_t a, uint32_t b) { return resources_[a].first_step < resources_[b].first_step; });
+            for (size_t i = 0; i < group.resources.size(); i++)
+            {
+                Resource& resource = resources_[group.resources[i]];
+                resource.memory = memory;
+                resource.previous_occupant = group.resources[(i + group.resources.size() - 1) % group.resources.size()];
+                if (vkBindImageMemory(device_, images_[group.resources[i]], memory_[memory].memory, memory_[memory].offset) != VK_SUCCESS)
+                    throw std::runtime_error(std::string("Failed to bind render graph image: ") + resource.name);
+            }
+        }
+
+        for (uint32_t r = 0; r < resources_.size(); r++)
+        {
+            if (images_[r] == VK_NULL_HANDLE)
+                continue;
+
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = images_[r];
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = resources_[r].desc.format;
+            view_info.subresourceRange.aspectMask = AspectMask(resources_[r].desc.format);
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.layerCount = 1;
+            if (vkCreateImageView(device_, &view_info, allocation_callbacks_, &views_[r]) != VK_SUCCESS)
+                throw std::runtime_error(std::string("Failed to create render graph image view: ") + resources_[r].name);
+        }
+    }
+
+    void RenderGraph::CreateBarriers()
+    {
+        struct State
+        {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            VkAccessFlags access = 0;
+            bool write = false;
+        };
+
+        // the last use of every resource, which is where the previous frame left it
+        std::vector<State> last_use(resources_.size());
+        for (const auto& step : steps_)
+        {
+            for (uint32_t p : step.passes)
+            {
+                for (const auto& use : passes_[p].uses)
+                    last_use[use.resource] = { use.layout, use.stages, use.access, use.write };
+            }
+        }
+
+        std::vector<State> states(resources_.size());
+        std::vector<bool> touched(resources_.size(), false);
+        std::vector<bool> has_contents(resources_.size(), false);
+        for (uint32_t r = 0; r < resources_.size(); r++)
+        {
+            if (!resources_[r].imported)
+                continue;
+            // imported images arrive with their contents, where the last frame handed them over
+            states[r].layout = resources_[r].final_layout;
+            has_contents[r] = true;
+            // swapchain images arrive with the acquire semaphore, waited on at color output
+            states[r].stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+
+        for (uint32_t s = 0; s < steps_.size(); s++)
+        {
+            Step& step = steps_[s];
+            bool render_pass = passes_[step.passes[0]].type == PassType::Graphics;
+            step.barriers.clear();
+            step.attachments.clear();
+            step.load_ops.clear();
+            step.store_ops.clear();
+            step.clear_values.clear();
+
+            // first use of each resource in the step decides its barrier
+            std::vector<const Use*> first_uses;
+            std::vector<const Use*> last_uses;
+            for (uint32_t p : step.passes)
+            {
+                for (const auto& use : passes_[p].uses)
+                {
+                    auto it = std::find_if(first_uses.begin(), first_uses.end(), [&](const Use* u) { return u->resource == use.resource; });
+                    if (it == first_uses.end())
+                    {
+                        first_uses.push_back(&use);
+                        last_uses.push_back(&use);
+                    }
+                    else last_uses[it - first_uses.begin()] = &use;
+                }
+            }
+
+            for (size_t i = 0; i < first_uses.size(); i++)
+            {
+                const Use& use = *first_uses[i];
+                const Resource& resource = resources_[use.resource];
+                bool attachment = use.type == UseType::ColorAttachment || use.type == UseType::DepthAttachment || use.type == UseType::InputAttachment;
+
+                // contents the step does not load can be discarded by the transition
+                bool load = has_contents[use.resource];
+                if (attachment)
+                {
+                    VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                    if (use.clear)
+                        load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                    else if (has_contents[use.resource])
+                        load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+                    load = load_op == VK_ATTACHMENT_LOAD_OP_LOAD;
+
+                    bool store = resource.imported || resource.last_step > s;
+                    step.attachments.push_back(use.resource);
+                    step.load_ops.push_back(load_op);
+                    step.store_ops.push_back(store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
+                    step.clear_values.push_back(use.clear_value);
+                }
+
+                State previous = states[use.resource];
+                if (!touched[use.resource] && !resource.imported)
+                {
+                    // the first use this frame waits for whoever used the memory last
+                    previous = last_use[resource.previous_occupant];
+                    previous.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                }
+
+                // read after read in the same layout needs nothing
+                if (previous.layout != use.layout || previous.write || use.write || !touched[use.resource])
+                {
+                    Barrier barrier{};
+                    barrier.resource = use.resource;
+                    barrier.old_layout = load ? previous.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                    barrier.new_layout = use.layout;
+                    barrier.src_stages = previous.stages;
+                    // write after read only needs the execution dependency
+                    barrier.src_access = previous.write ? previous.access : 0;
+                    barrier.dst_stages = use.stages;
+                    barrier.dst_access = use.access;
+                    step.barriers.push_back(barrier);
+                }
+                touched[use.resource] = true;
+            }
+
+            for (size_t i = 0; i < first_uses.size(); i++)
+            {
+                const Use& use = *last_uses[i];
+                bool written = false;
+                for (uint32_t p : step.passes)
+                {
+                    for (const auto& u : passes_[p].uses)
+                        written |= u.resource == use.resource && u.write;
+                }
+                states[use.resource] = { use.layout, use.stages, use.access, written || use.write };
+                has_contents[use.resource] = has_contents[use.resource] || written;
+            }
+
+            if (!render_pass)
+                step.attachments.clear();
+        }
+
+        // hand imported images over in the layout their owner expects
+        final_barriers_.clear();
+        for (uint32_t r = 0; r < resources_.size(); r++)
+        {
+            const Resource& resource = resources_[r];
+            if (!resource.imported)
+                continue;
+
+            const State& state = states[r];
+            if (state.layout == resource.final_layout && !state.write)
+                continue;
+
+            Barrier barrier{};
+            barrier.resource = r;
+            barrier.old_layout = state.layout;
+            barrier.new_layout = resource.final_layout;
+            barrier.src_stages = state.stages;
+            barrier.src_access = state.write ? state.access : 0;
+            barrier.dst_stages = resource.final_stages;
+            barrier.dst_access = resource.final_access;
+            final_barriers_.push_back(barrier);
+        }
+    }
+
+    void RenderGraph::CreateRenderPass(Step& step)
+    {
+        auto attachment_index = [&](uint32_t resource)
+        {
+            return static_cast<uint32_t>(std::find(step.attachments.begin(), step.attachments.end(), resource) - step.attachments.begin());
+        };
+
+        std::vector<VkAttachmentDescription> attachments(step.attachments.size());
+        for (size_t i = 0; i < step.attachments.size(); i++)
+        {
+            VkFormat format = resources_[step.attachments[i]].desc.format;
+            VkAttachmentDescription& attachment = attachments[i];
+            attachment.format = format;
+            attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment.loadOp = step.load_ops[i];
+            attachment.storeOp = step.store_ops[i];
+            attachment.stencilLoadOp = HasStencil(format) ? step.load_ops[i] : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = HasStencil(format) ? step.store_ops[i] : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+
+        // the barriers before the step already did the transition into the first layout,
+        // the last layout is kept so that the barriers after it know where it is
+        std::vector<bool> seen(attachments.size(), false);
+        for (uint32_t p : step.passes)
+        {
+            for (const auto& use : passes_[p].uses)
+            {
+                uint32_t index = attachment_index(use.resource);
+                if (index == attachments.size())
+                    continue;
+                if (!seen[index])
+                    attachments[index].initialLayout = use.layout;
+                attachments[index].finalLayout = use.layout;
+                seen[index] = true;
+            }
+        }
+
+        struct SubpassRefs
+        {
+            std::vector<VkAttachmentReference> colors;
+            std::vector<VkAttachmentReference> inputs;
+            VkAttachmentReference depth{ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED };
+            std::vector<uint32_t> preserves;
+        };
+        std::vector<SubpassRefs> refs(step.passes.size());
+        std::vector<VkSubpassDependency> dependencies;
+
+        for (uint32_t k = 0; k < step.passes.size(); k++)
+        {
+            const Pass& pass = passes_[step.passes[k]];
+            for (const auto& use : pass.uses)
+            {
+                uint32_t index = attachment_index(use.resource);
+                if (index == attachments.size())
+                    continue;
+
+                if (use.type == UseType::ColorAttachment)
+                    refs[k].colors.push_back({ index, use.layout });
+                else if (use.type == UseType::DepthAttachment)
+                    refs[k].depth = { index, use.layout };
+                else
+                    refs[k].inputs.push_back({ index, use.layout });
+
+                // depend on the last earlier subpass that used the attachment
+                for (uint32_t j = k; j-- > 0;)
+                {
+                    const Pass& earlier = passes_[step.passes[j]];
+                    auto it = std::find_if(earlier.uses.begin(), earlier.uses.end(), [&](const Use& u) { return u.resource == use.resource; });
+                    if (it == earlier.uses.end())
+                        continue;
+
+                    auto dependency = std::find_if(dependencies.begin(), dependencies.end(),
+                        [&](const VkSubpassDependency& d) { return d.srcSubpass == j && d.dstSubpass == k; });
+                    if (dependency == dependencies.end())
+                    {
+                        VkSubpassDependency d{};
+                        d.srcSubpass = j;
+                        d.dstSubpass = k;
+                        d.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+                        dependencies.push_back(d);
+                        dependency = dependencies.end() - 1;
+                    }
+                    dependency->srcStageMask |= it->stages;
+                    dependency->srcAccessMask |= it->write ? it->access : 0;
+                    dependency->dstStageMask |= use.stages;
+                    dependency->dstAccessMask |= use.access;
+                    break;
+                }
+            }
+
+            // attachments used before and after this subpass but not in it
+            for (uint32_t index = 0; index < attachments.size(); index++)
+            {
+                uint32_t resource = step.attachments[index];
+                auto uses = [&](uint32_t subpass)
+                {
+                    const auto& u = passes_[step.passes[subpass]].uses;
+                    return std::any_of(u.begin(), u.end(), [&](const Use& use) { return use.resource == resource; });
+                };
+                bool before = false, after = false;
+                for (uint32_t j = 0; j < k; j++)
+                    before |= uses(j);
+                for (uint32_t j = k + 1; j < step.passes.size(); j++)
+                    after |= uses(j);
+                if (before && after && !uses(k))
+                    refs[k].preserves.push_back(index);
+            }
+        }
+
+        std::vector<VkSubpassDescription> subpasses(step.passes.size());
+        for (size_t k = 0; k < subpasses.size(); k++)
+        {
+            subpasses[k].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpasses[k].colorAttachmentCount = static_cast<uint32_t>(refs[k].colors.size());
+            subpasses[k].pColorAttachments = refs[k].colors.data();
+            subpasses[k].inputAttachmentCount = static_cast<uint32_t>(refs[k].inputs.size());
+            subpasses[k].pInputAttachments = refs[k].inputs.data();
+            subpasses[k].pDepthStencilAttachment = refs[k].depth.attachment != VK_ATTACHMENT_UNUSED ? &refs[k].depth : nullptr;
+            subpasses[k].preserveAttachmentCount = static_cast<uint32_t>(refs[k].preserves.size());
+            subpasses[k].pPreserveAttachments = refs[k].preserves.data();
+        }
+
+        // everything that makes the render pass what it is, equal keys reuse the same object
+        std::vector<uint32_t> key;
+        for (const auto& a : attachments)
+            key.insert(key.end(), { (uint32_t)a.format, (uint32_t)a.loadOp, (uint32_t)a.storeOp, (uint32_t)a.stencilLoadOp,
+                (uint32_t)a.stencilStoreOp, (uint32_t)a.initialLayout, (uint32_t)a.finalLayout });
+        for (const auto& r : refs)
+        {
+            key.push_back(~0u);
+            for (const auto& c : r.colors)
+                key.insert(key.end(), { c.attachment, (uint32_t)c.layout });
+            key.push_back(~0u);
+            for (const auto& i : r.inputs)
+                key.insert(key.end(), { i.attachment, (uint32_t)i.layout });
+            key.insert(key.end(), { ~0u, r.depth.attachment, (uint32_t)r.depth.layout, ~0u });
+            key.insert(key.end(), r.preserves.begin(), r.preserves.end());
+        }
+        for (const auto& d : dependencies)
+        {
+            key.insert(key.end(), { ~1u, d.srcSubpass, d.dstSubpass, d.srcStageMask, d.dstStageMask, d.srcAccessMask, d.dstAccessMask,
+                d.dependencyFlags });
+        }
+
+        auto it = render_passes_.find(key);
+        if (it != render_passes_.end())
+        {
+            step.render_pass = it->second;
+            return;
+        }
+
+        VkRenderPassCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+        create_info.pAttachments = attachments.data();
+        create_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+        create_info.pSubpasses = subpasses.data();
+        create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        create_info.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device_, &create_info, allocation_callbacks_, &step.render_pass) != VK_SUCCESS)
+            throw std::runtime_error(std::string("Failed to create render pass for ") + passes_[step.passes[0]].name);
+        render_passes_[key] = step.render_pass;
+    }
+
+    void RenderGraph::CreateFramebuffers(Step& step)
+    {
+        // one framebuffer per image of the imports it renders to
+        uint32_t count = 1;
+        for (uint32_t resource : step.attachments)
+        {
+            if (resources_[resource].imported)
+                count = std::max(count, static_cast<uint32_t>(resources_[resource].views.size()));
+        }
+
+        step.framebuffers.resize(count);
+        std::vector<VkImageView> views(step.attachments.size());
+        for (uint32_t i = 0; i < count; i++)
+        {
+            for (size_t a = 0; a < step.attachments.size(); a++)
+                views[a] = GetView(step.attachments[a], i);
+
+            VkFramebufferCreateInfo framebuffer_info{};
+            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_info.renderPass = step.render_pass;
+            framebuffer_info.attachmentCount = static_cast<uint32_t>(views.size());
+            framebuffer_info.pAttachments = views.data();
+            framebuffer_info.width = step.extent.width;
+            framebuffer_info.height = step.extent.height;
+            framebuffer_info.layers = 1;
+
+            if (vkCreateFramebuffer(device_, &framebuffer_info, allocation_callbacks_, &step.framebuffers[i]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create framebuffer.");
+        }
+    }
+
+    void RenderGraph::Execute(VkCommandBuffer command_buffer, uint32_t image_index)
+    {
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        auto emit = [&](const std::vector<Barrier>& barriers)
+        {
+            if (barriers.empty())
+                return;
+
+            image_barriers.clear();
+            VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+            for (const auto& barrier : barriers)
+            {
+                VkImageMemoryBarrier image_barrier{};
+                image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                image_barrier.srcAccessMask = barrier.src_access;
+                image_barrier.dstAccessMask = barrier.dst_access;
+                image_barrier.oldLayout = barrier.old_layout;
+                image_barrier.newLayout = barrier.new_layout;
+                image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.image = GetImage(barrier.resource, image_index);
+                image_barrier.subresourceRange.aspectMask = AspectMask(resources_[barrier.resource].desc.format);
+                image_barrier.subresourceRange.levelCount = 1;
+                image_barrier.subresourceRange.layerCount = 1;
+                image_barriers.push_back(image_barrier);
+                src_stages |= barrier.src_stages;
+                dst_stages |= barrier.dst_stages;
+            }
+            vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+        };
+
+        for (const auto& step : steps_)
+        {
+            emit(step.barriers);
+
+            const Pass& first = passes_[step.passes[0]];
+            uint32_t zone = profiler_ ? profiler_->BeginGpuZone(command_buffer, first.name) : ~0u;
+
+            PassContext context{};
+            context.command_buffer = command_buffer;
+            context.image_index = image_index;
+            context.subpass = kNoSubpass;
+            if (step.render_pass == VK_NULL_HANDLE)
+                first.record(context);
+            else
+            {
+                context.render_pass = step.render_pass;
+                context.framebuffer = step.framebuffers[image_index % step.framebuffers.size()];
+                context.extent = step.extent;
+
+                VkRenderPassBeginInfo begin_info{};
+                begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+                begin_info.renderPass = step.render_pass;
+                begin_info.framebuffer = context.framebuffer;
+                begin_info.renderArea.extent = step.extent;
+                begin_info.clearValueCount = static_cast<uint32_t>(step.clear_values.size());
+                begin_info.pClearValues = step.clear_values.data();
+
+                for (uint32_t k = 0; k < step.passes.size(); k++)
+                {
+                    const Pass& pass = passes_[step.passes[k]];
+                    if (k == 0)
+                        vkCmdBeginRenderPass(command_buffer, &begin_info, pass.contents);
+                    else
+                        vkCmdNextSubpass(command_buffer, pass.contents);
+                    if (pass.contents == VK_SUBPASS_CONTENTS_INLINE)
+                        SetViewport(command_buffer, step.extent);
+                    context.subpass = k;
+                    pass.record(context);
+                }
+                vkCmdEndRenderPass(command_buffer);
+            }
+
+            if (profiler_)
+                profiler_->EndGpuZone(command_buffer, zone);
+        }
+
+        emit(final_barriers_);
+    }
+
+    void RenderGraph::DestroyCompiled(DeletionQueue* deletion_queue)
+    {
+        std::vector<VkFramebuffer> framebuffers;
+        for (auto& step : steps_)
+            framebuffers.insert(framebuffers.end(), step.framebuffers.begin(), step.framebuffers.end());
+        steps_.clear();
+        final_barriers_.clear();
+
+        auto destroy = [device = device_, allocation_callbacks = allocation_callbacks_, &allocator = allocator_, framebuffers, images = std::move(images_), views = std::move(views_),
+            memory = std::move(memory_)]
+        {
+            for (auto framebuffer : framebuffers)
+                vkDestroyFramebuffer(device, framebuffer, allocation_callbacks);
+            for (size_t r = 0; r < images.size(); r++)
+            {
+                if (views[r] != VK_NULL_HANDLE)
+                    vkDestroyImageView(device, views[r], allocation_callbacks);
+                if (images[r] != VK_NULL_HANDLE)
+                    vkDestroyImage(device, images[r], allocation_callbacks);
+            }
+            for (const auto& allocation : memory)
+                allocator.Free(allocation);
+        };
+        images_.clear();
+        views_.clear();
+        memory_.clear();
+
+        // frames in flight may still use the previous compile's objects
+        if (deletion_queue)
+            deletion_queue->Defer(std::move(destroy));
+        else destroy();
+    }
+
+    void RenderGraph::SetViewport(VkCommandBuffer command_buffer, VkExtent2D extent)
+    {
+        VkViewport viewport{};
+        viewport.width = (float)extent.width;
+        viewport.height = (float)extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = extent;
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    }
+
+    VkImage RenderGraph::GetImage(uint32_t resource, uint32_t image_index) const
+    {
+        const Resource& r = resources_[resource];
+        return r.imported ? r.images[image_index % r.images.size()] : images_[resource];
+    }
+
+    VkImageView RenderGraph::GetView(uint32_t resource, uint32_t image_index) const
+    {
+        const Resource& r = resources_[resource];
+        return r.imported ? r.views[image_index % r.views.size()] : views_[resource];
+    }
+
+    uint32_t RenderGraph::GetRenderPassCount() const
+    {
+        uint32_t count = 0;
+        for (const auto& step : steps_)
+            count += step.render_pass != VK_NULL_HANDLE ? 1 : 0;
+        return count;
+    }
+}
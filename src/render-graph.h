@@ -0,0 +1,254 @@
+#pragma once
+
+namespace vk
+{
+    // Frame graph over the images a frame renders to.
+    //
+    // Passes are declared in execution order together with the images they read
+    // and write; recording is left to a callback. Compile turns the declarations
+    // into render passes, framebuffers, transient images and barriers once, so a
+    // frame only replays them:
+    //
+    // - Passes that contribute nothing to an imported image and have no side
+    //   effects are culled.
+    // - Consecutive graphics passes of the same size whose reads of each other's
+    //   output are input attachments become subpasses of one render pass, so tile
+    //   based gpus keep those attachments on chip.
+    // - Layout transitions and memory dependencies are derived from each use and
+    //   the one before it; load and store ops from whether the contents are needed.
+    // - Transient images never loaded or stored are created lazily allocated, the
+    //   others share memory with transient images whose lifetimes do not overlap.
+    //
+    // Buffers are not tracked, passes synchronize their own buffer accesses.
+    class RenderGraph
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            // times every step as a gpu zone named after its first pass
+            Profiler* profiler = nullptr;
+            // recompiling defers destroying the previous objects instead of requiring an idle gpu
+            DeletionQueue* deletion_queue = nullptr;
+            // off to get one render pass per graphics pass, for comparisons
+            bool merge_subpasses = true;
+        };
+
+        enum class PassType
+        {
+            Graphics,
+            Compute,
+        };
+
+        // what a pass's callback needs to record, and to inherit for secondaries
+        struct PassContext
+        {
+            VkCommandBuffer command_buffer;
+            // null for compute passes
+            VkRenderPass render_pass;
+            uint32_t subpass;
+            VkFramebuffer framebuffer;
+            // render area, zero for compute passes
+            VkExtent2D extent;
+            uint32_t image_index;
+        };
+
+        using RecordFunction = std::function<void(const PassContext& context)>;
+
+        // a zero extent follows the graph's extent
+        struct ImageDesc
+        {
+            VkFormat format;
+            VkExtent2D extent{};
+            float scale = 1.0f;
+        };
+
+        static constexpr uint32_t kNoSubpass = ~0u;
+
+    private:
+        enum class UseType
+        {
+            ColorAttachment,
+            DepthAttachment,
+            InputAttachment,
+            Sampled,
+            StorageRead,
+            StorageWrite,
+        };
+
+        struct Use
+        {
+            uint32_t resource;
+            UseType type;
+            VkImageLayout layout;
+            VkPipelineStageFlags stages;
+            VkAccessFlags access;
+            bool write;
+            // attachment writes only
+            bool clear;
+            VkClearValue clear_value;
+        };
+
+        struct Pass
+        {
+            const char* name;
+            PassType type;
+            RecordFunction record;
+            std::vector<Use> uses;
+            bool side_effect = false;
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+            // set by Compile
+            bool culled = false;
+            uint32_t step = 0;
+            uint32_t subpass = kNoSubpass;
+        };
+
+        struct Resource
+        {
+            const char* name;
+            ImageDesc desc;
+            bool imported;
+            // imported images, picked by the image index passed to Execute
+            std::vector<VkImage> images;
+            std::vector<VkImageView> views;
+            VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags final_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            VkAccessFlags final_access = 0;
+            // set by Compile for transient images
+            VkExtent2D extent{};
+            VkImageUsageFlags usage = 0;
+            bool memoryless = false;
+            uint32_t memory = ~0u;
+            // transient image that last used the memory before this one, possibly itself in the previous frame
+            uint32_t previous_occupant = ~0u;
+            uint32_t first_step = ~0u;
+            uint32_t last_step = 0;
+        };
+
+        struct Barrier
+        {
+            uint32_t resource;
+            VkImageLayout old_layout;
+            VkImageLayout new_layout;
+            VkPipelineStageFlags src_stages;
+            VkAccessFlags src_access;
+            VkPipelineStageFlags dst_stages;
+            VkAccessFlags dst_access;
+        };
+
+        // a compute pass or a render pass made of one or more graphics passes
+        struct Step
+        {
+            std::vector<uint32_t> passes;
+            std::vector<Barrier> barriers;
+            VkRenderPass render_pass = VK_NULL_HANDLE;
+            VkExtent2D extent{};
+            // resource of every attachment, in attachment order
+            std::vector<uint32_t> attachments;
+            std::vector<VkAttachmentLoadOp> load_ops;
+            std::vector<VkAttachmentStoreOp> store_ops;
+            std::vector<VkClearValue> clear_values;
+            // one per image index when an attachment is imported
+            std::vector<VkFramebuffer> framebuffers;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        MemoryAllocator& allocator_;
+        Profiler* profiler_;
+        DeletionQueue* deletion_queue_;
+        bool merge_subpasses_;
+        VkExtent2D extent_{};
+
+        std::vector<Pass> passes_;
+        std::vector<Resource> resources_;
+
+        std::vector<Step> steps_;
+        std::vector<Barrier> final_barriers_;
+        // shared by the transient images whose memory index points here
+        std::vector<Allocation> memory_;
+        std::vector<VkImage> images_;
+        std::vector<VkImageView> views_;
+        // render passes by description, kept across compiles so pipelines stay valid
+        std::map<std::vector<uint32_t>, VkRenderPass> render_passes_;
+        VkDeviceSize transient_bytes_ = 0;
+        VkDeviceSize unaliased_bytes_ = 0;
+        uint32_t culled_pass_count_ = 0;
+
+    public:
+        RenderGraph(MemoryAllocator& allocator, const Config& config);
+        ~RenderGraph();
+
+        RenderGraph(const RenderGraph&) = delete;
+        RenderGraph& operator=(const RenderGraph&) = delete;
+
+        // Images owned outside the graph, one per image index. Their contents
+        // leave the graph in final_layout, ready for final_stages and final_access,
+        // and are expected back in that layout; the first use keeps them unless it clears.
+        // Names must outlive the graph, string literals are fine.
+        uint32_t ImportImages(const char* name, VkFormat format, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+            VkImageLayout final_layout, VkPipelineStageFlags final_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VkAccessFlags final_access = 0);
+        // replace the images of an import, takes effect on the next compile
+        void SetImportedImages(uint32_t resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+        // an image that lives only within a frame
+        uint32_t CreateImage(const char* name, const ImageDesc& desc);
+
+        // Passes run in the order they are added.
+        uint32_t AddPass(const char* name, PassType type, RecordFunction record);
+        // with a clear the previous contents are discarded instead of loaded
+        void WriteColor(uint32_t pass, uint32_t resource, const VkClearColorValue* clear = nullptr);
+        void WriteDepth(uint32_t pass, uint32_t resource, const VkClearDepthStencilValue* clear = nullptr);
+        // reads the pixel being shaded only, lets the writer share the render pass
+        void ReadInputAttachment(uint32_t pass, uint32_t resource);
+        void ReadSampled(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        void ReadStorage(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        void WriteStorage(uint32_t pass, uint32_t resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        // never culled, for passes that write buffers or other state outside the graph
+        void SetSideEffect(uint32_t pass);
+        // may change every frame, the callback must record accordingly
+        void SetSubpassContents(uint32_t pass, VkSubpassContents contents);
+
+        // Build everything the passes need. Call again after the extent or an
+        // import changed; without a deletion queue only once the gpu is done
+        // with the previous frames.
+        void Compile();
+        // Record every pass that survived culling. Inline graphics passes start
+        // with the viewport and scissor covering the render area.
+        void Execute(VkCommandBuffer command_buffer, uint32_t image_index);
+
+        // for secondary command buffers, which inherit no dynamic state
+        static void SetViewport(VkCommandBuffer command_buffer, VkExtent2D extent);
+
+    private:
+        void AddUse(uint32_t pass, uint32_t resource, UseType type, VkPipelineStageFlags stages, const VkClearValue* clear);
+        void Cull();
+        void BuildSteps();
+        void CreateTransientImages();
+        void CreateRenderPass(Step& step);
+        void CreateBarriers();
+        void CreateFramebuffers(Step& step);
+        // null destroys right away
+        void DestroyCompiled(DeletionQueue* deletion_queue);
+        bool CanMerge(const Step& step, const Pass& pass) const;
+        VkImage GetImage(uint32_t resource, uint32_t image_index) const;
+        VkImageView GetView(uint32_t resource, uint32_t image_index) const;
+
+    public:
+        // getters
+        VkRenderPass GetRenderPass(uint32_t pass) const { return steps_.at(passes_.at(pass).step).render_pass; }
+        uint32_t GetSubpass(uint32_t pass) const { return passes_.at(pass).subpass; }
+        bool IsCulled(uint32_t pass) const { return passes_.at(pass).culled; }
+        uint32_t GetPassCount() const { return static_cast<uint32_t>(passes_.size()); }
+        uint32_t GetCulledPassCount() const { return culled_pass_count_; }
+        uint32_t GetRenderPassCount() const;
+        // memory of the transient images after aliasing, lazily allocated images count fully
+        VkDeviceSize GetTransientBytes() const { return transient_bytes_; }
+        // what the transient images would take without aliasing
+        VkDeviceSize GetUnaliasedBytes() const { return unaliased_bytes_; }
+
+        // setters
+        // takes effect on the next compile
+        void SetExtent(VkExtent2D extent) { extent_ = extent; }
+    };
+}
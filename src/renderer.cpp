@@ -2,4 +2,793 @@
 
 namespace vk
 {
+    namespace
+    {
+        constexpr uint32_t kCullGroupSize = 64;
+        // instance command of buckets whose mesh is not drawable yet
+        constexpr uint32_t kNoCommand = ~0u;
+
+        // the frame's storage buffer slots in the bindless heap, same order as in cull.comp
+        constexpr uint32_t kInstancesSlot = 0;
+        constexpr uint32_t kInstanceCommandsSlot = 1;
+        constexpr uint32_t kCullCommandsSlot = 2;
+        constexpr uint32_t kCountersSlot = 3;
+        constexpr uint32_t kVisibleInstancesSlot = 4;
+        constexpr uint32_t kDrawsSlot = 5;
+        constexpr uint32_t kFrameSlotCount = 6;
+
+        // matches the push constants in instanced.vert
+        struct DrawPushConstants
+        {
+            Matrix4 view_projection;
+            // bindless slot of the instance buffer
+            uint32_t instances;
+        };
+
+        // matches the push constants in cull.comp
+        struct CullPushConstants
+        {
+            float planes[6][4];
+            uint32_t instance_count;
+            uint32_t command_count;
+            uint32_t batch_count;
+            uint32_t pass;
+            uint32_t compact;
+            // first of the frame's bindless slots
+            uint32_t descriptors;
+        };
+
+        // frustum planes of a column major view projection with 0 to 1 depth,
+        // normals point inwards
+        void ExtractFrustumPlanes(const Matrix4& m, float planes[6][4])
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                float r0 = m[i * 4 + 0], r1 = m[i * 4 + 1], r2 = m[i * 4 + 2], r3 = m[i * 4 + 3];
+                planes[0][i] = r3 + r0;
+                planes[1][i] = r3 - r0;
+                planes[2][i] = r3 + r1;
+                planes[3][i] = r3 - r1;
+                planes[4][i] = r2;
+                planes[5][i] = r3 - r2;
+            }
+            for (int p = 0; p < 6; p++)
+            {
+                float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+                if (length > 0.0f)
+                {
+                    for (int i = 0; i < 4; i++)
+                        planes[p][i] /= length;
+                }
+            }
+        }
+
+        VkShaderModule CreateShaderModule(VkDevice device, const VkAllocationCallbacks* allocation_callbacks, const std::string& filename)
+        {
+            auto code = util::LoadShaderCode(filename);
+
+            VkShaderModuleCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            create_info.codeSize = code.size() * sizeof(uint32_t);
+            create_info.pCode = code.data();
+
+            VkShaderModule shader_module;
+            if (vkCreateShaderModule(device, &create_info, allocation_callbacks, &shader_module) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create shader module.");
+
+            return shader_module;
+        }
+
+        // transform * the matrix that maps a mesh's quantized positions to object space
+        Matrix4 Dequantize(const Matrix4& transform, const Quantization& quantization)
+        {
+            Matrix4 result = transform;
+            for (int row = 0; row < 4; row++)
+            {
+                for (int column = 0; column < 3; column++)
+                    result[column * 4 + row] = transform[column * 4 + row] * quantization.scale;
+                result[12 + row] = transform[row] * quantization.offset[0] + transform[4 + row] * quantization.offset[1] +
+                    transform[8 + row] * quantization.offset[2] + transform[12 + row];
+            }
+            return result;
+        }
+    }
+
+    Renderer::Renderer(MemoryAllocator& allocator, UploadManager& upload_manager, BindlessHeap& bindless_heap, PipelineLibrary& pipeline_library,
+        const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), allocator_(allocator), upload_manager_(upload_manager),
+        bindless_heap_(bindless_heap), pipeline_library_(pipeline_library),
+        multi_draw_indirect_(config.multi_draw_indirect),
+        draw_indirect_count_(config.draw_indirect_count && config.multi_draw_indirect),
+        gpu_culling_(config.draw_indirect_first_instance),
+        render_pass_(config.render_pass), subpass_(config.subpass), pipeline_cache_(config.pipeline_cache),
+        vertex_capacity_(config.vertex_capacity), index_capacity_(config.index_capacity),
+        frames_(config.frames_in_flight)
+    {
+        // dirty flags are a bit per frame in flight
+        if (config.frames_in_flight > 32)
+            throw std::runtime_error("Renderer supports at most 32 frames in flight.");
+
+        view_projection_ = kIdentityMatrix;
+
+        // slots are written once the frame's buffers exist
+        for (auto& frame : frames_)
+            frame.descriptors = bindless_heap_.AllocateStorageBuffers(kFrameSlotCount);
+
+        CreatePipelineLayout();
+        RequestPipelines();
+        if (gpu_culling_)
+            CreateCullingPipeline();
+        CreateMeshBuffers();
+    }
+
+    Renderer::~Renderer()
+    {
+        for (auto& frame : frames_)
+        {
+            DestroyBuffer(frame.instances);
+            DestroyBuffer(frame.instance_commands);
+            DestroyBuffer(frame.cull_commands);
+            DestroyBuffer(frame.visible_instances);
+            DestroyBuffer(frame.draws);
+            DestroyBuffer(frame.counters);
+            DestroyBuffer(frame.readback);
+            bindless_heap_.FreeStorageBuffers(frame.descriptors, kFrameSlotCount);
+        }
+        allocator_.DestroyBuffer(index_buffer_, index_allocation_);
+        allocator_.DestroyBuffer(vertex_buffer_, vertex_allocation_);
+        if (gpu_culling_)
+        {
+            vkDestroyPipeline(device_, cull_pipeline_, allocation_callbacks_);
+            vkDestroyPipelineLayout(device_, cull_pipeline_layout_, allocation_callbacks_);
+        }
+        // the pipelines belong to the library
+        vkDestroyPipelineLayout(device_, pipeline_layout_, allocation_callbacks_);
+    }
+
+    void Renderer::CreatePipelineLayout()
+    {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(DrawPushConstants);
+
+        VkDescriptorSetLayout set_layout = bindless_heap_.GetSetLayout();
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, allocation_callbacks_, &pipeline_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline layout.");
+        pipeline_library_.RegisterLayout("Renderer", pipeline_layout_);
+    }
+
+    void Renderer::RequestPipelines()
+    {
+        GraphicsPipelineDesc desc{};
+        desc.vertex_shader = "src/shaders/instanced_vert.spv";
+        desc.fragment_shader = "src/shaders/instanced_frag.spv";
+        desc.layout = pipeline_layout_;
+        desc.render_pass = render_pass_;
+        desc.subpass = subpass_;
+        // the shared vertex buffer, instances are read from the bindless heap
+        desc.bindings = { { 0, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX } };
+        // all three formats are required for vertex input
+        desc.attributes = {
+            { 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, position) },
+            { 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal) },
+            { 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv) },
+        };
+        desc.depth_test = true;
+        desc.depth_write = true;
+
+        // single sided and double sided variants, double sided draws culled until it is ready
+        pipelines_.resize(2);
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            desc.cull_mode = i ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+            pipelines_[i] = pipeline_library_.Request(desc, i ? pipelines_[0] : PipelineLibrary::kNoPipeline);
+        }
+    }
+
+    void Renderer::CreateCullingPipeline()
+    {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(CullPushConstants);
+
+        VkDescriptorSetLayout set_layout = bindless_heap_.GetSetLayout();
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, allocation_callbacks_, &cull_pipeline_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling pipeline layout.");
+
+        VkShaderModule compute_shader = CreateShaderModule(device_, allocation_callbacks_, "src/shaders/cull_comp.spv");
+
+        VkComputePipelineCreateInfo pipeline_info{};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_info.stage.module = compute_shader;
+        pipeline_info.stage.pName = "main";
+        pipeline_info.layout = cull_pipeline_layout_;
+
+        if (vkCreateComputePipelines(device_, pipeline_cache_, 1, &pipeline_info, allocation_callbacks_, &cull_pipeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling pipeline.");
+
+        vkDestroyShaderModule(device_, compute_shader, allocation_callbacks_);
+    }
+
+    void Renderer::CreateMeshBuffers()
+    {
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        buffer_info.size = (VkDeviceSize)vertex_capacity_ * sizeof(PackedVertex);
+        buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        vertex_allocation_ = allocator_.CreateBuffer(buffer_info, MemoryUsage::GpuOnly, &vertex_buffer_);
+
+        buffer_info.size = (VkDeviceSize)index_capacity_ * sizeof(uint32_t);
+        buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        index_allocation_ = allocator_.CreateBuffer(buffer_info, MemoryUsage::GpuOnly, &index_buffer_);
+    }
+
+    uint32_t Renderer::CreateMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        if (vertices.size() > vertex_capacity_ - vertex_count_ || indices.size() > index_capacity_ - index_count_)
+            throw std::runtime_error("Renderer mesh buffers are full.");
+
+        Quantization quantization = ComputeQuantization(vertices);
+        float sphere[4];
+        ComputeBoundingSphere(vertices, sphere);
+        auto packed = PackVertices(vertices, quantization);
+
+        uint64_t vertex_ticket, index_ticket;
+        uint32_t vertex_offset = AppendVertices(packed.data(), static_cast<uint32_t>(packed.size()), vertex_ticket);
+        uint32_t first_index = AppendIndices(indices.data(), static_cast<uint32_t>(indices.size()), index_ticket);
+        return AddMesh(first_index, static_cast<uint32_t>(indices.size()), vertex_offset, quantization, sphere,
+            std::max(vertex_ticket, index_ticket));
+    }
+
+    std::vector<uint32_t> Renderer::LoadMesh(const std::string& path)
+    {
+        util::MappedFile file(path);
+        const char* data = file.GetData();
+        size_t size = file.GetSize();
+
+        MeshFileHeader header;
+        if (size < sizeof(header))
+            throw std::runtime_error("Invalid mesh file: " + path);
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kMeshFileMagic, sizeof(kMeshFileMagic)) != 0 || header.version != kMeshFileVersion)
+            throw std::runtime_error("Invalid mesh file: " + path);
+
+        // every range must lie inside the file and every index inside the vertices
+        uint64_t lod_end = sizeof(header) + (uint64_t)header.lod_count * sizeof(MeshFileLod);
+        if (header.lod_count == 0 || lod_end > size ||
+            header.vertex_data % sizeof(PackedVertex) != 0 || header.vertex_data > size ||
+            (uint64_t)header.vertex_count * sizeof(PackedVertex) > size - header.vertex_data ||
+            header.index_data % sizeof(uint32_t) != 0 || header.index_data > size ||
+            (uint64_t)header.index_count * sizeof(uint32_t) > size - header.index_data)
+            throw std::runtime_error("Corrupt mesh file: " + path);
+
+        std::vector<MeshFileLod> lods(header.lod_count);
+        std::memcpy(lods.data(), data + sizeof(header), lods.size() * sizeof(MeshFileLod));
+        for (const auto& lod : lods)
+        {
+            if (lod.first_index > header.index_count || lod.index_count > header.index_count - lod.first_index)
+                throw std::runtime_error("Corrupt mesh file: " + path);
+        }
+
+        auto vertices = reinterpret_cast<const PackedVertex*>(data + header.vertex_data);
+        auto indices = reinterpret_cast<const uint32_t*>(data + header.index_data);
+        for (uint32_t i = 0; i < header.index_count; i++)
+        {
+            if (indices[i] >= header.vertex_count)
+                throw std::runtime_error("Corrupt mesh file: " + path);
+        }
+
+        if (header.vertex_count > vertex_capacity_ - vertex_count_ || header.index_count > index_capacity_ - index_count_)
+            throw std::runtime_error("Renderer mesh buffers are full.");
+
+        // the file is already in the gpu's format, copy it from the mapping into the staging ring
+        uint64_t vertex_ticket, index_ticket;
+        uint32_t vertex_offset = AppendVertices(vertices, header.vertex_count, vertex_ticket);
+        uint32_t first_index = AppendIndices(indices, header.index_count, index_ticket);
+        uint64_t ticket = std::max(vertex_ticket, index_ticket);
+
+        std::vector<uint32_t> meshes;
+        for (const auto& lod : lods)
+            meshes.push_back(AddMesh(first_index + lod.first_index, lod.index_count, vertex_offset, header.quantization, header.sphere, ticket));
+        return meshes;
+    }
+
+    uint32_t Renderer::AppendVertices(const PackedVertex* vertices, uint32_t count, uint64_t& ticket)
+    {
+        uint32_t offset = vertex_count_;
+        ticket = upload_manager_.UploadBuffer(vertex_buffer_, (VkDeviceSize)offset * sizeof(PackedVertex),
+            vertices, (VkDeviceSize)count * sizeof(PackedVertex));
+        vertex_count_ += count;
+        return offset;
+    }
+
+    uint32_t Renderer::AppendIndices(const uint32_t* indices, uint32_t count, uint64_t& ticket)
+    {
+        uint32_t first = index_count_;
+        ticket = upload_manager_.UploadBuffer(index_buffer_, (VkDeviceSize)first * sizeof(uint32_t),
+            indices, (VkDeviceSize)count * sizeof(uint32_t));
+        index_count_ += count;
+        return first;
+    }
+
+    uint32_t Renderer::AddMesh(uint32_t first_index, uint32_t index_count, uint32_t vertex_offset,
+        const Quantization& quantization, const float sphere[4], uint64_t ticket)
+    {
+        Mesh mesh{};
+        mesh.first_index = first_index;
+        mesh.index_count = index_count;
+        mesh.vertex_offset = static_cast<int32_t>(vertex_offset);
+        mesh.quantization = quantization;
+        for (int i = 0; i < 3; i++)
+            mesh.sphere[i] = (sphere[i] - quantization.offset[i]) / quantization.scale;
+        mesh.sphere[3] = sphere[3] / quantization.scale;
+        mesh.ticket = ticket;
+
+        uint32_t id = static_cast<uint32_t>(meshes_.size());
+        meshes_.push_back(mesh);
+        pending_meshes_.push_back(id);
+        return id;
+    }
+
+    uint32_t Renderer::CreateMaterial(const Material& material)
+    {
+        if (materials_.size() >= (1u << 24))
+            throw std::runtime_error("Too many materials.");
+
+        materials_.push_back(material);
+        return static_cast<uint32_t>(materials_.size() - 1);
+    }
+
+    uint32_t Renderer::AddObject(uint32_t mesh, uint32_t material, const Matrix4& transform)
+    {
+        if (mesh >= meshes_.size())
+            throw std::runtime_error("Invalid mesh id.");
+        if (material >= materials_.size())
+            throw std::runtime_error("Invalid material id.");
+
+        const Material& mat = materials_[material];
+        uint32_t pipeline = mat.double_sided ? 1 : 0;
+        uint64_t key = SortKey(pipeline, material, mesh);
+
+        uint32_t id;
+        if (!free_objects_.empty())
+        {
+            id = free_objects_.back();
+            free_objects_.pop_back();
+        }
+        else
+        {
+            id = static_cast<uint32_t>(objects_.size());
+            objects_.emplace_back();
+        }
+
+        auto [it, inserted] = buckets_.try_emplace(key);
+        Bucket& bucket = it->second;
+        if (inserted)
+        {
+            bucket.pipeline = pipeline;
+            bucket.mesh = mesh;
+        }
+
+        InstanceData instance{};
+        instance.transform = Dequantize(transform, meshes_[mesh].quantization);
+        std::copy(std::begin(mat.color), std::end(mat.color), instance.color);
+
+        objects_[id] = { key, static_cast<uint32_t>(bucket.instances.size()), 0, true };
+        bucket.instances.push_back(instance);
+        bucket.objects.push_back(id);
+        object_count_++;
+        layout_version_++;
+        return id;
+    }
+
+    void Renderer::SetTransform(uint32_t object, const Matrix4& transform)
+    {
+        if (object >= objects_.size() || !objects_[object].alive)
+            throw std::runtime_error("Invalid object id.");
+
+        Object& obj = objects_[object];
+        Bucket& bucket = buckets_.at(obj.key);
+        bucket.instances[obj.index].transform = Dequantize(transform, meshes_[bucket.mesh].quantization);
+
+        // queue the instance once per frame that has not seen it yet
+        for (uint32_t i = 0; i < frames_.size(); i++)
+        {
+            uint32_t bit = 1u << i;
+            if (!(obj.dirty_frames & bit))
+            {
+                obj.dirty_frames |= bit;
+                frames_[i].dirty_objects.push_back(object);
+            }
+        }
+    }
+
+    void Renderer::RemoveObject(uint32_t object)
+    {
+        if (object >= objects_.size() || !objects_[object].alive)
+            throw std::runtime_error("Invalid object id.");
+
+        Object& obj = objects_[object];
+        auto it = buckets_.find(obj.key);
+        Bucket& bucket = it->second;
+
+        // swap with the bucket's last instance
+        uint32_t last = static_cast<uint32_t>(bucket.instances.size() - 1);
+        if (obj.index != last)
+        {
+            bucket.instances[obj.index] = bucket.instances[last];
+            bucket.objects[obj.index] = bucket.objects[last];
+            objects_[bucket.objects[obj.index]].index = obj.index;
+        }
+        bucket.instances.pop_back();
+        bucket.objects.pop_back();
+        if (bucket.instances.empty())
+            buckets_.erase(it);
+
+        obj.alive = false;
+        free_objects_.push_back(object);
+        object_count_--;
+        layout_version_++;
+    }
+
+    void Renderer::Prepare(uint32_t frame_index)
+    {
+        Frame& frame = frames_[frame_index];
+        uint32_t bit = 1u << frame_index;
+
+        // the frame's last submission has retired, pick up its visible count
+        if (frame.culled)
+        {
+            allocator_.Invalidate(frame.readback.allocation);
+            visible_instance_count_ = *static_cast<const uint32_t*>(frame.readback.allocation.mapped);
+            frame.culled = false;
+        }
+
+        // meshes can be drawn once their ownership acquire has been recorded
+        for (size_t i = 0; i < pending_meshes_.size();)
+        {
+            Mesh& mesh = meshes_[pending_meshes_[i]];
+            if (upload_manager_.IsReady(mesh.ticket))
+            {
+                mesh.ticket = 0;
+                pending_meshes_[i] = pending_meshes_.back();
+                pending_meshes_.pop_back();
+                layout_version_++;
+            }
+            else i++;
+        }
+
+        if (built_version_ != layout_version_)
+            BuildLayout();
+
+        if (frame.layout_version != layout_version_)
+        {
+            // instances moved, rewrite everything
+            ReserveFrameBuffers(frame);
+
+            auto instances = static_cast<InstanceData*>(frame.instances.allocation.mapped);
+            for (const auto& [key, bucket] : buckets_)
+                std::memcpy(instances + bucket.first_instance, bucket.instances.data(), bucket.instances.size() * sizeof(InstanceData));
+            allocator_.Flush(frame.instances.allocation);
+
+            if (gpu_culling_)
+            {
+                auto instance_commands = static_cast<uint32_t*>(frame.instance_commands.allocation.mapped);
+                for (const auto& [key, bucket] : buckets_)
+                    std::fill_n(instance_commands + bucket.first_instance, bucket.instances.size(), bucket.command);
+                std::memcpy(frame.cull_commands.allocation.mapped, cull_commands_.data(), cull_commands_.size() * sizeof(CullCommand));
+
+                allocator_.Flush(frame.instance_commands.allocation);
+                allocator_.Flush(frame.cull_commands.allocation);
+            }
+
+            for (auto object : frame.dirty_objects)
+                objects_[object].dirty_frames &= ~bit;
+            frame.dirty_objects.clear();
+            frame.layout_version = layout_version_;
+        }
+        else if (!frame.dirty_objects.empty())
+        {
+            // only transforms changed, copy just those instances
+            auto instances = static_cast<InstanceData*>(frame.instances.allocation.mapped);
+            for (auto object : frame.dirty_objects)
+            {
+                Object& obj = objects_[object];
+                obj.dirty_frames &= ~bit;
+                const Bucket& bucket = buckets_.at(obj.key);
+                instances[bucket.first_instance + obj.index] = bucket.instances[obj.index];
+            }
+            frame.dirty_objects.clear();
+
+            allocator_.Flush(frame.instances.allocation);
+        }
+    }
+
+    void Renderer::RecordCulling(VkCommandBuffer command_buffer, uint32_t frame_index)
+    {
+        if (!gpu_culling_ || commands_.empty())
+            return;
+
+        Frame& frame = frames_[frame_index];
+        uint32_t command_count = static_cast<uint32_t>(commands_.size());
+        uint32_t batch_count = static_cast<uint32_t>(batches_.size());
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        // counters start at zero every frame
+        vkCmdFillBuffer(command_buffer, frame.counters.buffer, 0, (VkDeviceSize)(1 + batch_count + command_count) * sizeof(uint32_t), 0);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        CullPushConstants push_constants{};
+        ExtractFrustumPlanes(view_projection_, push_constants.planes);
+        push_constants.instance_count = object_count_;
+        push_constants.command_count = command_count;
+        push_constants.batch_count = batch_count;
+        push_constants.compact = draw_indirect_count_ ? 1 : 0;
+        push_constants.descriptors = frame.descriptors;
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_);
+        bindless_heap_.Bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_);
+
+        // pass 0 culls instances and compacts the survivors of each command
+        push_constants.pass = 0;
+        vkCmdPushConstants(command_buffer, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, (object_count_ + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        // pass 1 writes the draw commands
+        push_constants.pass = 1;
+        vkCmdPushConstants(command_buffer, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, (command_count + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        // visible total for the stats, read once the frame has retired
+        VkBufferCopy region{};
+        region.size = sizeof(uint32_t);
+        vkCmdCopyBuffer(command_buffer, frame.counters.buffer, frame.readback.buffer, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        frame.culled = true;
+    }
+
+    void Renderer::Record(VkCommandBuffer command_buffer, uint32_t frame_index)
+    {
+        if (commands_.empty())
+            return;
+
+        const Frame& frame = frames_[frame_index];
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer_, &offset);
+        vkCmdBindIndexBuffer(command_buffer, index_buffer_, 0, VK_INDEX_TYPE_UINT32);
+
+        // every pipeline shares the layout, so the set and constants survive pipeline changes
+        DrawPushConstants push_constants{};
+        push_constants.view_projection = view_projection_;
+        push_constants.instances = frame.descriptors + (gpu_culling_ ? kVisibleInstancesSlot : kInstancesSlot);
+        bindless_heap_.Bind(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_);
+        vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
+
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        for (uint32_t b = 0; b < batches_.size(); b++)
+        {
+            const Batch& batch = batches_[b];
+            // still compiling without a fallback, the batch waits for a later frame
+            VkPipeline pipeline = pipeline_library_.Get(pipelines_[batch.pipeline]);
+            if (pipeline == VK_NULL_HANDLE)
+                continue;
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+            VkDeviceSize command_offset = (VkDeviceSize)batch.first_command * stride;
+            if (!gpu_culling_)
+            {
+                // indirect commands cannot offset the instance, draw directly
+                for (uint32_t i = batch.first_command; i < batch.first_command + batch.command_count; i++)
+                {
+                    const auto& command = commands_[i];
+                    vkCmdDrawIndexed(command_buffer, command.indexCount, command.instanceCount,
+                        command.firstIndex, command.vertexOffset, command.firstInstance);
+                }
+            }
+            else if (draw_indirect_count_)
+            {
+                vkCmdDrawIndexedIndirectCount(command_buffer, frame.draws.buffer, command_offset,
+                    frame.counters.buffer, (VkDeviceSize)(1 + b) * sizeof(uint32_t), batch.command_count, stride);
+            }
+            else if (multi_draw_indirect_)
+            {
+                vkCmdDrawIndexedIndirect(command_buffer, frame.draws.buffer, command_offset, batch.command_count, stride);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < batch.command_count; i++)
+                    vkCmdDrawIndexedIndirect(command_buffer, frame.draws.buffer, command_offset + i * stride, 1, stride);
+            }
+        }
+    }
+
+    void Renderer::BuildLayout()
+    {
+        commands_.clear();
+        cull_commands_.clear();
+        batches_.clear();
+        submitted_instance_count_ = 0;
+
+        // buckets are visited in sort key order, so pipelines come out grouped
+        uint32_t first_instance = 0;
+        for (auto& [key, bucket] : buckets_)
+        {
+            bucket.first_instance = first_instance;
+            uint32_t instance_count = static_cast<uint32_t>(bucket.instances.size());
+            first_instance += instance_count;
+
+            const Mesh& mesh = meshes_[bucket.mesh];
+            if (mesh.ticket)
+            {
+                bucket.command = kNoCommand;
+                continue;
+            }
+
+            if (batches_.empty() || batches_.back().pipeline != bucket.pipeline)
+                batches_.push_back({ bucket.pipeline, static_cast<uint32_t>(commands_.size()), 0 });
+            batches_.back().command_count++;
+            bucket.command = static_cast<uint32_t>(commands_.size());
+            submitted_instance_count_ += instance_count;
+
+            VkDrawIndexedIndirectCommand command{};
+            command.indexCount = mesh.index_count;
+            command.instanceCount = instance_count;
+            command.firstIndex = mesh.first_index;
+            command.vertexOffset = mesh.vertex_offset;
+            command.firstInstance = bucket.first_instance;
+            commands_.push_back(command);
+
+            CullCommand cull_command{};
+            cull_command.index_count = mesh.index_count;
+            cull_command.first_index = mesh.first_index;
+            cull_command.vertex_offset = mesh.vertex_offset;
+            cull_command.first_instance = bucket.first_instance;
+            cull_command.instance_count = instance_count;
+            cull_command.batch = static_cast<uint32_t>(batches_.size() - 1);
+            cull_command.draw_offset = batches_.back().first_command;
+            std::copy(std::begin(mesh.sphere), std::end(mesh.sphere), cull_command.sphere);
+            cull_commands_.push_back(cull_command);
+        }
+
+        built_version_ = layout_version_;
+    }
+
+    void Renderer::ReserveFrameBuffers(Frame& frame)
+    {
+        // grow by doubling, the frame's previous submission has retired so the old buffers are free
+        bool reallocated = false;
+        if (frame.instance_capacity < object_count_ || frame.instances.buffer == VK_NULL_HANDLE)
+        {
+            frame.instance_capacity = std::max(frame.instance_capacity * 2, std::max(object_count_, 1024u));
+            VkDeviceSize size = (VkDeviceSize)frame.instance_capacity * sizeof(InstanceData);
+
+            CreateBuffer(frame.instances, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu);
+            if (gpu_culling_)
+            {
+                CreateBuffer(frame.instance_commands, (VkDeviceSize)frame.instance_capacity * sizeof(uint32_t),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu);
+                CreateBuffer(frame.visible_instances, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly);
+            }
+            reallocated = true;
+        }
+
+        if (!gpu_culling_)
+        {
+            if (reallocated)
+                WriteFrameDescriptors(frame);
+            return;
+        }
+
+        uint32_t command_count = static_cast<uint32_t>(commands_.size());
+        if (frame.command_capacity < command_count || frame.cull_commands.buffer == VK_NULL_HANDLE)
+        {
+            frame.command_capacity = std::max(frame.command_capacity * 2, std::max(command_count, 64u));
+
+            CreateBuffer(frame.cull_commands, (VkDeviceSize)frame.command_capacity * sizeof(CullCommand),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu);
+            CreateBuffer(frame.draws, (VkDeviceSize)frame.command_capacity * sizeof(VkDrawIndexedIndirectCommand),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly);
+            // batches never outnumber commands
+            CreateBuffer(frame.counters, (VkDeviceSize)(1 + 2 * frame.command_capacity) * sizeof(uint32_t),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                MemoryUsage::GpuOnly);
+            reallocated = true;
+        }
+
+        if (frame.readback.buffer == VK_NULL_HANDLE)
+            CreateBuffer(frame.readback, sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu);
+
+        if (reallocated)
+            WriteFrameDescriptors(frame);
+    }
+
+    void Renderer::WriteFrameDescriptors(Frame& frame)
+    {
+        const Buffer* buffers[kFrameSlotCount] = {};
+        buffers[kInstancesSlot] = &frame.instances;
+        buffers[kInstanceCommandsSlot] = &frame.instance_commands;
+        buffers[kCullCommandsSlot] = &frame.cull_commands;
+        buffers[kCountersSlot] = &frame.counters;
+        buffers[kVisibleInstancesSlot] = &frame.visible_instances;
+        buffers[kDrawsSlot] = &frame.draws;
+
+        // the frame's last submission has retired, nothing pending reads its slots
+        for (uint32_t i = 0; i < kFrameSlotCount; i++)
+        {
+            if (buffers[i]->buffer != VK_NULL_HANDLE)
+                bindless_heap_.WriteStorageBuffer(frame.descriptors + i, buffers[i]->buffer);
+        }
+    }
+
+    void Renderer::CreateBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage)
+    {
+        DestroyBuffer(buffer);
+
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = size;
+        buffer_info.usage = usage;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        buffer.allocation = allocator_.CreateBuffer(buffer_info, memory_usage, &buffer.buffer);
+    }
+
+    void Renderer::DestroyBuffer(Buffer& buffer)
+    {
+        if (buffer.buffer == VK_NULL_HANDLE)
+            return;
+
+        allocator_.DestroyBuffer(buffer.buffer, buffer.allocation);
+        buffer = Buffer{};
+    }
+
+    uint64_t Renderer::SortKey(uint32_t pipeline, uint32_t material, uint32_t mesh)
+    {
+        // pipeline changes cost the most, then material, then mesh
+        return ((uint64_t)pipeline << 56) | ((uint64_t)(material & 0xffffff) << 32) | mesh;
+    }
 }
@@ -2,7 +2,267 @@
 
 namespace vk
 {
+    // column major 4x4 matrix
+    using Matrix4 = std::array<float, 16>;
+    constexpr Matrix4 kIdentityMatrix = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    struct Material
+    {
+        float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        // disables back face culling, selects a different pipeline
+        bool double_sided = false;
+    };
+
+    // Draws many objects with few commands.
+    //
+    // Objects are kept in buckets keyed by pipeline, material and mesh, so sorting
+    // happens once when an object is added rather than every frame. Per-instance
+    // data lives in a persistently mapped buffer per frame in flight; a frame only
+    // rewrites the instances that changed since that buffer was last used, unless
+    // objects were added or removed. Every bucket becomes one indexed indirect
+    // command and all buckets sharing a pipeline are drawn by a single indirect
+    // call.
+    //
+    // Shaders reach the instance and culling buffers through the bindless heap.
+    // Every frame in flight owns a range of storage buffer slots whose base is
+    // pushed as a constant, the heap's set is bound once per command buffer.
+    //
+    // With GPU culling, a compute pass tests every instance's bounding sphere
+    // against the frustum and compacts the survivors into a per frame buffer that
+    // the draws read their instances from. A second pass writes the non-empty
+    // commands and their counts for vkCmdDrawIndexedIndirectCount. Devices without
+    // drawIndirectFirstInstance skip culling and draw each bucket directly.
     class Renderer
     {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            VkRenderPass render_pass;
+            // with a depth attachment
+            uint32_t subpass;
+            VkPipelineCache pipeline_cache;
+            uint32_t frames_in_flight;
+            // draw count above 1 in a single indirect call
+            bool multi_draw_indirect;
+            // non-zero firstInstance in indirect commands, required for gpu culling
+            bool draw_indirect_first_instance;
+            // draw count read from a buffer
+            bool draw_indirect_count;
+            // capacity of the shared mesh buffers
+            uint32_t vertex_capacity = 1u << 20;
+            uint32_t index_capacity = 4u << 20;
+        };
+
+    private:
+        struct InstanceData
+        {
+            Matrix4 transform;
+            float color[4];
+        };
+
+        // matches CullCommand in cull.comp
+        struct CullCommand
+        {
+            uint32_t index_count;
+            uint32_t first_index;
+            int32_t vertex_offset;
+            uint32_t first_instance;
+            uint32_t instance_count;
+            uint32_t batch;
+            // first draw slot of the batch
+            uint32_t draw_offset;
+            uint32_t padding;
+            // object space bounding sphere, xyz center and w radius
+            float sphere[4];
+        };
+
+        struct Mesh
+        {
+            uint32_t first_index;
+            uint32_t index_count;
+            int32_t vertex_offset;
+            // folded into the instance transforms
+            Quantization quantization;
+            // bounding sphere in quantized space, which is what the instance transforms expect
+            float sphere[4];
+            // upload ticket, 0 once the mesh can be drawn
+            uint64_t ticket;
+        };
+
+        struct Object
+        {
+            uint64_t key;
+            uint32_t index;
+            // frames in flight whose instance buffer holds a stale copy
+            uint32_t dirty_frames;
+            // false once removed, until the id is handed out again
+            bool alive;
+        };
+
+        struct Bucket
+        {
+            uint32_t pipeline;
+            uint32_t mesh;
+            // offset into the instance buffer and command index, valid while the layout is current
+            uint32_t first_instance = 0;
+            uint32_t command = 0;
+            std::vector<InstanceData> instances;
+            // object id of each instance
+            std::vector<uint32_t> objects;
+        };
+
+        // consecutive indirect commands drawn with the same pipeline
+        struct Batch
+        {
+            uint32_t pipeline;
+            uint32_t first_command;
+            uint32_t command_count;
+        };
+
+        struct Buffer
+        {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            Allocation allocation{};
+        };
+
+        struct Frame
+        {
+            // written by the cpu
+            Buffer instances;
+            Buffer instance_commands;
+            Buffer cull_commands;
+            uint32_t instance_capacity = 0;
+            uint32_t command_capacity = 0;
+            // written by the culling passes
+            Buffer visible_instances;
+            Buffer draws;
+            // visible total, then draw count per batch, then instance count per command
+            Buffer counters;
+            Buffer readback;
+            // first of the frame's storage buffer slots in the bindless heap
+            uint32_t descriptors = 0;
+            // readback holds the result of the frame's last culling pass
+            bool culled = false;
+            // layout the buffers were written with, 0 for never
+            uint64_t layout_version = 0;
+            // objects changed since the buffers were written
+            std::vector<uint32_t> dirty_objects;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        MemoryAllocator& allocator_;
+        UploadManager& upload_manager_;
+        BindlessHeap& bindless_heap_;
+        PipelineLibrary& pipeline_library_;
+        bool multi_draw_indirect_;
+        bool draw_indirect_count_;
+        bool gpu_culling_;
+
+        VkRenderPass render_pass_;
+        uint32_t subpass_;
+        VkPipelineCache pipeline_cache_;
+        VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+        // library ids indexed by Material::double_sided
+        std::vector<uint32_t> pipelines_;
+
+        VkPipelineLayout cull_pipeline_layout_ = VK_NULL_HANDLE;
+        VkPipeline cull_pipeline_ = VK_NULL_HANDLE;
+
+        VkBuffer vertex_buffer_;
+        Allocation vertex_allocation_;
+        VkBuffer index_buffer_;
+        Allocation index_allocation_;
+        uint32_t vertex_capacity_;
+        uint32_t index_capacity_;
+        uint32_t vertex_count_ = 0;
+        uint32_t index_count_ = 0;
+        std::vector<Mesh> meshes_;
+        // meshes whose upload has not finished yet
+        std::vector<uint32_t> pending_meshes_;
+
+        std::vector<Material> materials_;
+
+        std::vector<Object> objects_;
+        std::vector<uint32_t> free_objects_;
+        // ordered by sort key, iterating it yields the draw order
+        std::map<uint64_t, Bucket> buckets_;
+        uint32_t object_count_ = 0;
+        // bumped whenever instances move or meshes become ready
+        uint64_t layout_version_ = 1;
+
+        // one command per bucket with a drawable mesh
+        std::vector<VkDrawIndexedIndirectCommand> commands_;
+        std::vector<CullCommand> cull_commands_;
+        std::vector<Batch> batches_;
+        // layout_version_ that the commands and batches were built for
+        uint64_t built_version_ = 0;
+        // instances of drawable meshes, before culling
+        uint32_t submitted_instance_count_ = 0;
+        uint32_t visible_instance_count_ = 0;
+        std::vector<Frame> frames_;
+        Matrix4 view_projection_;
+
+    public:
+        Renderer(MemoryAllocator& allocator, UploadManager& upload_manager, BindlessHeap& bindless_heap, PipelineLibrary& pipeline_library,
+            const Config& config);
+        ~Renderer();
+
+        Renderer(const Renderer&) = delete;
+        Renderer& operator=(const Renderer&) = delete;
+
+        // Meshes are packed and appended to shared vertex and index buffers and
+        // become visible once their upload has finished.
+        uint32_t CreateMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+        // Upload a mesh file straight from its mapping. Returns a mesh per lod,
+        // finest first, all sharing the file's vertices.
+        std::vector<uint32_t> LoadMesh(const std::string& path);
+        uint32_t CreateMaterial(const Material& material);
+
+        uint32_t AddObject(uint32_t mesh, uint32_t material, const Matrix4& transform);
+        void SetTransform(uint32_t object, const Matrix4& transform);
+        void RemoveObject(uint32_t object);
+
+        // Bring the frame's instance and indirect buffers up to date. Call once per
+        // frame after the frame's previous submission has retired.
+        void Prepare(uint32_t frame);
+
+        // Record the frame's culling passes, outside of a render pass.
+        void RecordCulling(VkCommandBuffer command_buffer, uint32_t frame);
+        // Record the frame's draws inside a render pass, with the viewport already set.
+        void Record(VkCommandBuffer command_buffer, uint32_t frame);
+
+    private:
+        void CreatePipelineLayout();
+        void RequestPipelines();
+        void CreateCullingPipeline();
+        void CreateMeshBuffers();
+        // append to the shared buffers and return where the data went
+        uint32_t AppendVertices(const PackedVertex* vertices, uint32_t count, uint64_t& ticket);
+        uint32_t AppendIndices(const uint32_t* indices, uint32_t count, uint64_t& ticket);
+        uint32_t AddMesh(uint32_t first_index, uint32_t index_count, uint32_t vertex_offset,
+            const Quantization& quantization, const float sphere[4], uint64_t ticket);
+        void BuildLayout();
+        void ReserveFrameBuffers(Frame& frame);
+        void WriteFrameDescriptors(Frame& frame);
+        void CreateBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage);
+        void DestroyBuffer(Buffer& buffer);
+        static uint64_t SortKey(uint32_t pipeline, uint32_t material, uint32_t mesh);
+
+    public:
+        // getters
+        uint32_t GetObjectCount() const { return object_count_; }
+        uint32_t GetBatchCount() const { return static_cast<uint32_t>(batches_.size()); }
+        uint32_t GetDrawCommandCount() const { return static_cast<uint32_t>(commands_.size()); }
+        bool HasDraws() const { return !commands_.empty(); }
+        bool IsGpuCullingEnabled() const { return gpu_culling_; }
+        uint32_t GetSubmittedInstanceCount() const { return submitted_instance_count_; }
+        // as of the last retired frame, equals the submitted count without gpu culling
+        uint32_t GetVisibleInstanceCount() const { return gpu_culling_ ? visible_instance_count_ : submitted_instance_count_; }
+
+        // setters
+        void SetViewProjection(const Matrix4& view_projection) { view_projection_ = view_projection; }
     };
 }
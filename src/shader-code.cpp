@@ -0,0 +1,69 @@
+#include "pch.h"
+
+#if __has_include("embedded-shaders.h")
+#include "embedded-shaders.h"
+#define HAS_EMBEDDED_SHADERS
+#endif
+
+namespace util
+{
+    namespace
+    {
+        std::string shader_directory;
+
+        std::vector<uint32_t> ToWords(const std::vector<char>& bytes, const std::string& path)
+        {
+            if (bytes.empty() || bytes.size() % sizeof(uint32_t) != 0)
+                throw std::runtime_error("Invalid SPIR-V: " + path);
+
+            std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+            std::memcpy(code.data(), bytes.data(), bytes.size());
+            return code;
+        }
+
+#ifdef HAS_EMBEDDED_SHADERS
+        const embedded::Shader* FindEmbedded(const std::string& name)
+        {
+            for (const embedded::Shader* shader = embedded::kShaders; shader->name; shader++)
+            {
+                if (name == shader->name)
+                    return shader;
+            }
+            return nullptr;
+        }
+#else
+        const void* FindEmbedded(const std::string&)
+        {
+            return nullptr;
+        }
+#endif
+    }
+
+    std::vector<uint32_t> LoadShaderCode(const std::string& path)
+    {
+        std::string name = std::filesystem::path(path).filename().string();
+        if (!shader_directory.empty())
+        {
+            std::filesystem::path override_path = std::filesystem::path(shader_directory) / name;
+            if (std::filesystem::exists(override_path))
+                return ToWords(ReadFile(override_path.string()), override_path.string());
+        }
+
+#ifdef HAS_EMBEDDED_SHADERS
+        if (const embedded::Shader* shader = FindEmbedded(name))
+            return std::vector<uint32_t>(shader->code, shader->code + shader->size / sizeof(uint32_t));
+#endif
+
+        return ToWords(ReadFile(path), path);
+    }
+
+    bool IsShaderEmbedded(const std::string& path)
+    {
+        return FindEmbedded(std::filesystem::path(path).filename().string()) != nullptr;
+    }
+
+    void SetShaderDirectory(const std::string& directory)
+    {
+        shader_directory = directory;
+    }
+}
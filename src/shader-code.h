@@ -0,0 +1,18 @@
+#pragma once
+
+namespace util
+{
+    // SPIR-V of the engine's shaders, looked up by file name.
+    //
+    // CMake builds compile every shader and embed it, so nothing is read from
+    // disk and the working directory does not matter. A file of the same name
+    // in the override directory wins over the embedded copy, for iterating on
+    // shaders without rebuilding. Builds without the embedded shaders, such as
+    // the Visual Studio project, read the path as given, where
+    // src/shaders/compile.bat writes them.
+    std::vector<uint32_t> LoadShaderCode(const std::string& path);
+    bool IsShaderEmbedded(const std::string& path);
+
+    // empty for none; set before anything loads shaders
+    void SetShaderDirectory(const std::string& directory);
+}
@@ -1,3 +1,8 @@
 glslc.exe shader.vert -o vert.spv
 glslc.exe shader.frag -o frag.spv
+glslc.exe instanced.vert -o instanced_vert.spv
+glslc.exe instanced.frag -o instanced_frag.spv
+glslc.exe cull.comp -o cull_comp.spv
+glslc.exe bloom.comp -o bloom_comp.spv
+glslc.exe tonemap.comp -o tonemap_comp.spv
 pause
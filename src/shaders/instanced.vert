@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct Instance {
+    mat4 transform;
+    vec4 color;
+};
+
+// every storage buffer of the bindless heap
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; } instance_buffers[];
+
+layout(push_constant) uniform PushConstants {
+    mat4 view_projection;
+    uint instances;
+} pc;
+
+// PackedVertex, positions are in the mesh's quantization cube which the transform maps to object space
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUv;
+
+layout(location = 0) out vec3 fragColor;
+
+// octahedral encoding, the lower hemisphere is folded over the upper one
+vec3 DecodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    // gl_InstanceIndex includes the command's first instance
+    Instance instance = instance_buffers[pc.instances].instances[gl_InstanceIndex];
+    gl_Position = pc.view_projection * instance.transform * vec4(inPosition.xyz, 1.0);
+
+    vec3 normal = normalize(mat3(instance.transform) * DecodeNormal(inNormal));
+    float light = max(dot(normal, normalize(vec3(0.4, -0.8, 0.6))), 0.0);
+    fragColor = instance.color.rgb * (0.2 + 0.8 * light);
+}
@@ -1,6 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// written once per frame into the uniform ring
+layout(set = 0, binding = 0) uniform Globals {
+    mat4 view_projection;
+    vec2 render_extent;
+    uint frame_number;
+} globals;
+
+layout(push_constant) uniform PushConstants {
+    mat4 transform;
+} pc;
+
 layout(location = 0) out vec3 fragColor;
 
 vec2 positions[3] = vec2[](
@@ -16,6 +27,6 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = globals.view_projection * pc.transform * vec4(positions[gl_VertexIndex], 0.0, 1.0);
     fragColor = colors[gl_VertexIndex];
 }
@@ -0,0 +1,83 @@
+#include "pch.h"
+
+namespace util
+{
+    ThreadPool::ThreadPool(uint32_t thread_count)
+    {
+        if (thread_count == 0)
+            thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+        workers_.reserve(thread_count);
+        for (uint32_t i = 0; i < thread_count; i++)
+            workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        task_available_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    void ThreadPool::Submit(std::function<void(uint32_t)> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        task_available_.notify_one();
+    }
+
+    void ThreadPool::Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return tasks_.empty() && active_ == 0; });
+
+        if (error_)
+        {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void ThreadPool::WorkerLoop(uint32_t worker_index)
+    {
+        while (true)
+        {
+            std::function<void(uint32_t)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                task_available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty())
+                    return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                active_++;
+            }
+
+            try
+            {
+                task(worker_index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                active_--;
+                if (tasks_.empty() && active_ == 0)
+                    idle_.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace util
+{
+    // Fixed set of worker threads consuming a FIFO task queue.
+    // Tasks receive the index of the worker running them, so callers can keep
+    // per-worker state such as command pools without locking.
+    class ThreadPool
+    {
+    private:
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void(uint32_t)>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable task_available_;
+        std::condition_variable idle_;
+        uint32_t active_ = 0;
+        bool stopping_ = false;
+        // first exception thrown by a task since the last Wait
+        std::exception_ptr error_;
+
+    public:
+        // 0 picks one worker per hardware thread minus the calling thread
+        explicit ThreadPool(uint32_t thread_count = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void Submit(std::function<void(uint32_t)> task);
+        // block until every submitted task has finished, rethrows the first task exception
+        void Wait();
+
+    private:
+        void WorkerLoop(uint32_t worker_index);
+
+    public:
+        // getters
+        uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+    };
+}
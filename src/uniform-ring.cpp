@@ -0,0 +1,94 @@
+#include "pch.h"
+
+namespace vk
+{
+    UniformRing::UniformRing(MemoryAllocator& allocator, const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks)
+    {
+        // every block starts at an offset the device accepts
+        VkDeviceSize alignment = std::max<VkDeviceSize>(config.offset_alignment, 1);
+        block_size_ = (config.block_size + alignment - 1) / alignment * alignment;
+        ring_ = std::make_unique<RingBuffer>(allocator, block_size_ * config.blocks_per_frame, config.frames_in_flight,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = kUniformBinding;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_ALL;
+
+        VkDescriptorSetLayoutCreateInfo set_layout_info{};
+        set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        set_layout_info.bindingCount = 1;
+        set_layout_info.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device_, &set_layout_info, allocation_callbacks_, &set_layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create uniform ring descriptor set layout.");
+
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        pool_size.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+
+        if (vkCreateDescriptorPool(device_, &pool_info, allocation_callbacks_, &descriptor_pool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create uniform ring descriptor pool.");
+
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool = descriptor_pool_;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &set_layout_;
+
+        if (vkAllocateDescriptorSets(device_, &allocate_info, &descriptor_set_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate uniform ring descriptor set.");
+
+        // written once, the dynamic offset picks the block
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = ring_->GetBuffer();
+        buffer_info.offset = 0;
+        buffer_info.range = block_size_;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_set_;
+        write.dstBinding = kUniformBinding;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &buffer_info;
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    }
+
+    UniformRing::~UniformRing()
+    {
+        vkDestroyDescriptorPool(device_, descriptor_pool_, allocation_callbacks_);
+        vkDestroyDescriptorSetLayout(device_, set_layout_, allocation_callbacks_);
+        ring_.reset();
+    }
+
+    void UniformRing::BeginFrame(uint32_t frame)
+    {
+        ring_->BeginFrame(frame);
+    }
+
+    uint32_t UniformRing::Write(const void* data, VkDeviceSize size)
+    {
+        if (size > block_size_)
+            throw std::runtime_error("Uniform data exceeds the uniform ring's block size.");
+
+        // the rest of the block stays as it was, shaders only read what was written
+        RingBuffer::Slice slice = ring_->Allocate(block_size_, block_size_);
+        std::memcpy(slice.mapped, data, size);
+        return static_cast<uint32_t>(slice.offset);
+    }
+
+    void UniformRing::Bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set,
+        uint32_t offset) const
+    {
+        vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, set, 1, &descriptor_set_, 1, &offset);
+    }
+}
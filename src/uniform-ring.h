@@ -0,0 +1,72 @@
+#pragma once
+
+namespace vk
+{
+    // Per frame uniform data in a persistently mapped ring, bound with dynamic offsets.
+    //
+    // A single descriptor set covers one block of the ring; binding it with the
+    // offset Write returned selects the block. Writing uniforms is a copy into the
+    // mapped memory of the frame's segment, without descriptor writes or buffer
+    // allocations. Every block takes block_size bytes so that a dynamic offset
+    // never moves the bound range past the end of the buffer.
+    //
+    // BeginFrame rewinds the frame's segment and may only be called once the
+    // frame's previous submission has retired. Writes come from the thread
+    // driving the frames; binding from any thread.
+    class UniformRing
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            uint32_t frames_in_flight;
+            // the device's minUniformBufferOffsetAlignment
+            VkDeviceSize offset_alignment;
+            // largest uniform block a single Write may fill
+            VkDeviceSize block_size = 256;
+            uint32_t blocks_per_frame = 256;
+        };
+
+        // matches the bindings in the shaders
+        static constexpr uint32_t kUniformBinding = 0;
+
+    private:
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        VkDeviceSize block_size_;
+        std::unique_ptr<RingBuffer> ring_;
+        VkDescriptorSetLayout set_layout_;
+        VkDescriptorPool descriptor_pool_;
+        VkDescriptorSet descriptor_set_;
+
+    public:
+        UniformRing(MemoryAllocator& allocator, const Config& config);
+        ~UniformRing();
+
+        UniformRing(const UniformRing&) = delete;
+        UniformRing& operator=(const UniformRing&) = delete;
+
+        void BeginFrame(uint32_t frame);
+
+        // copy data into the frame's segment, returns the dynamic offset to bind it with
+        uint32_t Write(const void* data, VkDeviceSize size);
+        template <typename T>
+        uint32_t Write(const T& data)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "uniform data is copied as bytes");
+            return Write(&data, sizeof(T));
+        }
+
+        // bind the set as set of a layout created with GetSetLayout
+        void Bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set,
+            uint32_t offset) const;
+
+    public:
+        // getters
+        VkDescriptorSetLayout GetSetLayout() const { return set_layout_; }
+        VkDeviceSize GetBlockSize() const { return block_size_; }
+        VkDeviceSize GetFrameSize() const { return ring_->GetFrameSize(); }
+        VkDeviceSize GetFrameUsage() const { return ring_->GetFrameUsage(); }
+    };
+}
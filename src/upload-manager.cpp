@@ -0,0 +1,346 @@
+#include "pch.h"
+
+namespace vk
+{
+    namespace
+    {
+        // copies into optimal images need offsets that are multiples of 4 and of the
+        // texel block size, 16 covers every format we use
+        constexpr VkDeviceSize kStagingAlignment = 16;
+    }
+
+    UploadManager::UploadManager(MemoryAllocator& allocator, const Config& config)
+        : device_(config.device), allocation_callbacks_(config.allocation_callbacks), allocator_(allocator),
+        transfer_queue_(config.transfer_queue),
+        transfer_queue_family_index_(config.transfer_queue_family_index),
+        graphics_queue_family_index_(config.graphics_queue_family_index),
+        queue_mutex_(config.queue_mutex), staging_size_(config.staging_size)
+    {
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex = transfer_queue_family_index_;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(device_, &pool_info, allocation_callbacks_, &command_pool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create upload command pool.");
+
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext = &type_info;
+
+        if (vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks_, &timeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create upload timeline semaphore.");
+
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = staging_size_;
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        staging_allocation_ = allocator_.CreateBuffer(buffer_info, MemoryUsage::CpuToGpu, &staging_buffer_);
+    }
+
+    UploadManager::~UploadManager()
+    {
+        Finish();
+
+        allocator_.DestroyBuffer(staging_buffer_, staging_allocation_);
+        vkDestroySemaphore(device_, timeline_, allocation_callbacks_);
+        vkDestroyCommandPool(device_, command_pool_, allocation_callbacks_);
+    }
+
+    uint64_t UploadManager::UploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // chunks well below the ring size let early chunks retire while later ones are copied
+        VkDeviceSize chunk_size = std::max<VkDeviceSize>(staging_size_ / 4, kStagingAlignment);
+        for (VkDeviceSize copied = 0; copied < size;)
+        {
+            VkDeviceSize chunk = std::min(chunk_size, size - copied);
+            VkDeviceSize staging_offset = ReserveStaging(chunk, kStagingAlignment);
+            std::memcpy(static_cast<char*>(staging_allocation_.mapped) + staging_offset,
+                static_cast<const char*>(data) + copied, chunk);
+
+            VkBufferCopy region{};
+            region.srcOffset = staging_offset;
+            region.dstOffset = dst_offset + copied;
+            region.size = chunk;
+            vkCmdCopyBuffer(GetRecordingCommandBuffer(), staging_buffer_, dst, 1, &region);
+
+            copied += chunk;
+        }
+
+        if (HasOwnershipTransfer())
+        {
+            // queue family ownership release, the matching acquire is recorded on the graphics queue.
+            // earlier chunks submitted in previous batches are covered by submission order.
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = transfer_queue_family_index_;
+            barrier.dstQueueFamilyIndex = graphics_queue_family_index_;
+            barrier.buffer = dst;
+            barrier.offset = dst_offset;
+            barrier.size = size;
+
+            vkCmdPipelineBarrier(GetRecordingCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            recording_.buffer_acquires.push_back(barrier);
+        }
+
+        return next_value_;
+    }
+
+    uint64_t UploadManager::UploadImage(VkImage dst, VkExtent3D extent, uint32_t mip_level, const void* data, VkDeviceSize size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (size > staging_size_)
+            throw std::runtime_error("Image upload is larger than the staging buffer.");
+
+        VkDeviceSize staging_offset = ReserveStaging(size, kStagingAlignment);
+        std::memcpy(static_cast<char*>(staging_allocation_.mapped) + staging_offset, data, size);
+
+        VkCommandBuffer command_buffer = GetRecordingCommandBuffer();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = dst;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = mip_level;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        // previous contents of the level are discarded, so no ownership is needed yet
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = staging_offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = mip_level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {
+            std::max(1u, extent.width >> mip_level),
+            std::max(1u, extent.height >> mip_level),
+            std::max(1u, extent.depth >> mip_level)
+        };
+        vkCmdCopyBufferToImage(command_buffer, staging_buffer_, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // transition to shader read, releasing ownership to graphics if needed
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        if (HasOwnershipTransfer())
+        {
+            barrier.srcQueueFamilyIndex = transfer_queue_family_index_;
+            barrier.dstQueueFamilyIndex = graphics_queue_family_index_;
+        }
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        if (HasOwnershipTransfer())
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            recording_.image_acquires.push_back(barrier);
+        }
+
+        return next_value_;
+    }
+
+    void UploadManager::Flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (recording_.command_buffer)
+            SubmitRecording();
+    }
+
+    void UploadManager::Finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (recording_.command_buffer)
+            SubmitRecording();
+
+        uint64_t value = next_value_ - 1;
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &timeline_;
+        wait_info.pValues = &value;
+        vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+
+        Retire(false);
+    }
+
+    uint64_t UploadManager::RecordAcquireBarriers(VkCommandBuffer command_buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Retire(false);
+        if (completed_.empty())
+            return 0;
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        for (auto& batch : completed_)
+        {
+            buffer_barriers.insert(buffer_barriers.end(), batch.buffer_acquires.begin(), batch.buffer_acquires.end());
+            image_barriers.insert(image_barriers.end(), batch.image_acquires.begin(), batch.image_acquires.end());
+        }
+        if (!buffer_barriers.empty() || !image_barriers.empty())
+        {
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                0, nullptr,
+                static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+                static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+        }
+
+        acquired_value_ = completed_.back().value;
+        completed_.clear();
+        return acquired_value_;
+    }
+
+    bool UploadManager::IsReady(uint64_t ticket)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ticket <= acquired_value_;
+    }
+
+    VkDeviceSize UploadManager::ReserveStaging(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        while (true)
+        {
+            VkDeviceSize position = staging_head_ % staging_size_;
+            VkDeviceSize aligned = (position + alignment - 1) / alignment * alignment;
+            // wrap to the start instead of splitting the range
+            VkDeviceSize padding = aligned + size > staging_size_ ? staging_size_ - position : aligned - position;
+
+            if (staging_head_ + padding + size - staging_tail_ <= staging_size_)
+            {
+                staging_head_ += padding;
+                VkDeviceSize offset = staging_head_ % staging_size_;
+                staging_head_ += size;
+                return offset;
+            }
+
+            // the ring is full, submit what we have and wait for the oldest batch
+            if (recording_.command_buffer)
+                SubmitRecording();
+            Retire(true);
+        }
+    }
+
+    VkCommandBuffer UploadManager::GetRecordingCommandBuffer()
+    {
+        if (recording_.command_buffer)
+            return recording_.command_buffer;
+
+        if (free_command_buffers_.empty())
+        {
+            VkCommandBufferAllocateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            info.commandPool = command_pool_;
+            info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            info.commandBufferCount = 1;
+
+            VkCommandBuffer command_buffer;
+            if (vkAllocateCommandBuffers(device_, &info, &command_buffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate upload command buffer.");
+            free_command_buffers_.push_back(command_buffer);
+        }
+
+        recording_.command_buffer = free_command_buffers_.back();
+        free_command_buffers_.pop_back();
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(recording_.command_buffer, &begin_info) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record upload command buffer.");
+
+        return recording_.command_buffer;
+    }
+
+    void UploadManager::SubmitRecording()
+    {
+        if (vkEndCommandBuffer(recording_.command_buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record upload command buffer.");
+
+        recording_.value = next_value_++;
+        recording_.staging_end = staging_head_;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &recording_.value;
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = &timeline_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &recording_.command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &timeline_;
+
+        VkResult result;
+        if (queue_mutex_)
+        {
+            std::lock_guard<std::mutex> lock(*queue_mutex_);
+            result = vkQueueSubmit(transfer_queue_, 1, &submit_info, VK_NULL_HANDLE);
+        }
+        else result = vkQueueSubmit(transfer_queue_, 1, &submit_info, VK_NULL_HANDLE);
+        if (result != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit upload command buffer.");
+
+        in_flight_.push_back(std::move(recording_));
+        recording_ = Batch{};
+    }
+
+    void UploadManager::Retire(bool wait)
+    {
+        if (wait && !in_flight_.empty())
+        {
+            VkSemaphoreWaitInfo wait_info{};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &timeline_;
+            wait_info.pValues = &in_flight_.front().value;
+            vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+        }
+
+        uint64_t completed_value;
+        vkGetSemaphoreCounterValue(device_, timeline_, &completed_value);
+
+        size_t retired = 0;
+        for (; retired < in_flight_.size() && in_flight_[retired].value <= completed_value; retired++)
+        {
+            Batch& batch = in_flight_[retired];
+            staging_tail_ = batch.staging_end;
+            vkResetCommandBuffer(batch.command_buffer, 0);
+            free_command_buffers_.push_back(batch.command_buffer);
+            batch.command_buffer = VK_NULL_HANDLE;
+            completed_.push_back(std::move(batch));
+        }
+        in_flight_.erase(in_flight_.begin(), in_flight_.begin() + retired);
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+namespace vk
+{
+    // Streams buffer and image data to device local memory on the transfer queue.
+    //
+    // Data is copied into a persistently mapped staging ring buffer and recorded
+    // into a batch that Flush submits to the transfer queue, signalling a timeline
+    // semaphore. Staging space and command buffers are recycled once the gpu has
+    // reached a batch's value. When the transfer queue belongs to its own family,
+    // each copy releases ownership to the graphics family and RecordAcquireBarriers
+    // acquires it on the graphics queue. Neither queue waits on the other for
+    // uploads that have not finished yet. Uploads may be queued from any thread.
+    class UploadManager
+    {
+    public:
+        struct Config
+        {
+            VkDevice device;
+            const VkAllocationCallbacks* allocation_callbacks = nullptr;
+            VkQueue transfer_queue;
+            uint32_t transfer_queue_family_index;
+            uint32_t graphics_queue_family_index;
+            VkDeviceSize staging_size = 64ull << 20;
+            // held around submits, the transfer queue may be the graphics queue
+            std::mutex* queue_mutex = nullptr;
+        };
+
+    private:
+        struct Batch
+        {
+            uint64_t value;
+            // staging head when the batch was submitted
+            VkDeviceSize staging_end;
+            VkCommandBuffer command_buffer;
+            std::vector<VkBufferMemoryBarrier> buffer_acquires;
+            std::vector<VkImageMemoryBarrier> image_acquires;
+        };
+
+        VkDevice device_;
+        const VkAllocationCallbacks* allocation_callbacks_;
+        MemoryAllocator& allocator_;
+        VkQueue transfer_queue_;
+        uint32_t transfer_queue_family_index_;
+        uint32_t graphics_queue_family_index_;
+        std::mutex* queue_mutex_;
+
+        std::mutex mutex_;
+
+        VkCommandPool command_pool_;
+        std::vector<VkCommandBuffer> free_command_buffers_;
+
+        VkSemaphore timeline_;
+        // value the next submitted batch will signal
+        uint64_t next_value_ = 1;
+        // highest value whose acquire barriers were recorded on the graphics queue
+        uint64_t acquired_value_ = 0;
+
+        VkBuffer staging_buffer_;
+        Allocation staging_allocation_;
+        VkDeviceSize staging_size_;
+        // monotonic byte counters, the ring position is counter % staging_size_
+        VkDeviceSize staging_head_ = 0;
+        VkDeviceSize staging_tail_ = 0;
+
+        // batch being recorded, command_buffer is null while empty
+        Batch recording_{};
+        std::vector<Batch> in_flight_;
+        // completed on the gpu, acquires not yet recorded
+        std::vector<Batch> completed_;
+
+    public:
+        UploadManager(MemoryAllocator& allocator, const Config& config);
+        ~UploadManager();
+
+        UploadManager(const UploadManager&) = delete;
+        UploadManager& operator=(const UploadManager&) = delete;
+
+        // Queue a copy into dst. Returns the ticket to pass to IsReady.
+        // Uploads larger than the staging ring are split across batches.
+        uint64_t UploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+        // Queue a copy into one mip level of a color image. The image ends up in
+        // SHADER_READ_ONLY_OPTIMAL on the graphics queue.
+        uint64_t UploadImage(VkImage dst, VkExtent3D extent, uint32_t mip_level, const void* data, VkDeviceSize size);
+
+        // submit the batch being recorded, if any
+        void Flush();
+        // block until every queued upload has finished on the transfer queue
+        void Finish();
+
+        // Record ownership acquires for finished uploads into a graphics command
+        // buffer, outside of a render pass. Returns the timeline value the graphics
+        // submission must wait on, 0 if nothing was recorded. The value has already
+        // been reached so the wait never stalls.
+        uint64_t RecordAcquireBarriers(VkCommandBuffer command_buffer);
+
+        // true once the upload's acquire has been recorded, graphics commands
+        // recorded from then on may use it
+        bool IsReady(uint64_t ticket);
+
+    private:
+        VkDeviceSize ReserveStaging(VkDeviceSize size, VkDeviceSize alignment);
+        VkCommandBuffer GetRecordingCommandBuffer();
+        void SubmitRecording();
+        void Retire(bool wait);
+        bool HasOwnershipTransfer() const { return transfer_queue_family_index_ != graphics_queue_family_index_; }
+
+    public:
+        // getters
+        VkSemaphore GetTimelineSemaphore() const { return timeline_; }
+    };
+}
@@ -2,34 +2,272 @@
 
 namespace vk
 {
-    VulkanManager::VulkanManager(GLFWwindow* window, uint32_t width, uint32_t height)
+    namespace
+    {
+        // below this many draws per worker the hand-off costs more than recording inline
+        constexpr uint32_t kMinDrawsPerWorker = 512;
+        // per stage resources left to the other sets of a pipeline layout and its attachments
+        constexpr uint32_t kReservedStageResources = 64;
+
+        // matches Globals in shader.vert
+        struct FrameGlobals
+        {
+            Matrix4 view_projection;
+            float render_extent[2];
+            uint32_t frame_number;
+            uint32_t padding;
+        };
+
+        // matches the push constants in shader.vert
+        struct DrawPushConstants
+        {
+            Matrix4 transform;
+        };
+
+        // semaphores of one submitted batch, values are ignored for binary semaphores
+        struct BatchSemaphores
+        {
+            std::vector<VkSemaphore> waits;
+            std::vector<VkPipelineStageFlags> wait_stages;
+            std::vector<uint64_t> wait_values;
+            std::vector<VkSemaphore> signals;
+            std::vector<uint64_t> signal_values;
+            VkTimelineSemaphoreSubmitInfo timeline_info{};
+
+            void Wait(VkSemaphore semaphore, VkPipelineStageFlags stages, uint64_t value = 0)
+            {
+                waits.push_back(semaphore);
+                wait_stages.push_back(stages);
+                wait_values.push_back(value);
+            }
+
+            void Signal(VkSemaphore semaphore, uint64_t value = 0)
+            {
+                signals.push_back(semaphore);
+                signal_values.push_back(value);
+            }
+
+            // keeps pointers into this, which has to outlive the submit
+            VkSubmitInfo GetSubmitInfo(const VkCommandBuffer* command_buffer)
+            {
+                timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+                timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+                timeline_info.pWaitSemaphoreValues = wait_values.data();
+                timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+                timeline_info.pSignalSemaphoreValues = signal_values.data();
+
+                VkSubmitInfo submit_info{};
+                submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submit_info.pNext = &timeline_info;
+                submit_info.waitSemaphoreCount = static_cast<uint32_t>(waits.size());
+                submit_info.pWaitSemaphores = waits.data();
+                submit_info.pWaitDstStageMask = wait_stages.data();
+                submit_info.commandBufferCount = 1;
+                submit_info.pCommandBuffers = command_buffer;
+                submit_info.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+                submit_info.pSignalSemaphores = signals.data();
+                return submit_info;
+            }
+        };
+    }
+
+    VulkanManager::VulkanManager(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t frames_in_flight, uint32_t worker_threads)
+        : headless_(window == nullptr), window_(window), frames_in_flight_(frames_in_flight)
+    {
+        if (frames_in_flight_ == 0)
+            throw std::runtime_error("Frames in flight must be at least 1.");
+
+        startup_start_ = std::chrono::steady_clock::now();
+
+        // everything needs the device, the job system runs the phases after it
+        RunStartupPhase("Instance", [&]
+        {
+            CreateHostAllocator();
+            CreateInstance();
+            if (!headless_)
+                CreateSurface(window);
+        });
+        RunStartupPhase("Device", [&]
+        {
+            GetPhysicalDeviceAndQueuesFamilies();
+            CreateDevice();
+            CreateAllocator();
+            CreateDeletionQueue();
+            CreateJobSystem(worker_threads);
+        });
+
+        // independent of each other; shader modules load while the swapchain is created
+        RunStartupPhases({
+            { "Swapchain", [&]
+            {
+                if (headless_)
+                    CreateOffscreenTargets(width, height);
+                else
+                    CreateSwapchain(width, height);
+                CreateSyncObjects();
+            } },
+            { "Pipeline cache", [&]
+            {
+                ChooseDepthFormat();
+                CreatePipelineCache();
+                CreatePipelineLibrary();
+                pipeline_library_->LoadShaders();
+            } },
+            { "Resources", [&]
+            {
+                CreateProfiler();
+                CreateUploadManager();
+                CreateBindlessHeap();
+                CreateUniformRing();
+                CreateAssetStreamer();
+                CreateFrameCapture();
+                CreateDynamicResolution();
+                CreateCommandPools();
+                CreateCommandBuffers();
+            } },
+        });
+
+        // pipelines need the render graph's render pass, which needs the swapchain format
+        RunStartupPhase("Post processor", [&] { CreatePostProcessor(); });
+        RunStartupPhase("Render graph", [&] { CreateRenderGraph(); });
+        RunStartupPhases({
+            { "Renderer", [&] { CreateRenderer(); } },
+            { "Graphics pipeline", [&] { CreateGraphicsPipeline(); } },
+        });
+        RunStartupPhase("Prewarm", [&] { PrewarmPipelines(); });
+
+        if (!headless_)
+        {
+            glfwSetWindowUserPointer(window_, this);
+            glfwSetFramebufferSizeCallback(window_, FramebufferResizeCallback);
+        }
+
+        startup_ms_ = GetStartupElapsed();
+    }
+
+    VulkanManager::VulkanManager(uint32_t width, uint32_t height, uint32_t frames_in_flight, uint32_t worker_threads)
+        : VulkanManager(nullptr, width, height, frames_in_flight, worker_threads)
     {
-        CreateInstance();
-        CreateSurface(window);
-        GetPhysicalDeviceAndQueuesFamilies();
-        CreateDevice();
-        CreateSwapchain(width, height);
-        CreateRenderPass();
-        CreateGraphicsPipeline();
-        CreateFramebuffers();
-        CreateCommandPool();
-        CreateCommandBuffers();
     }
 
     VulkanManager::~VulkanManager()
     {
-        vkDestroyCommandPool(device_, command_pool_, nullptr);
-        for (auto framebuffer : swapchain_framebuffers_)
-            vkDestroyFramebuffer(device_, framebuffer, nullptr);
-        vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
-        vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
-        vkDestroyRenderPass(device_, render_pass_, nullptr);
-        for (auto image_view : swapchain_image_views_)
-            vkDestroyImageView(device_, image_view, nullptr);
-        vkDestroySwapchainKHR(device_, swapchain_, nullptr);
-        vkDestroyDevice(device_, nullptr);
-        vkDestroySurfaceKHR(instance_, surface_, nullptr);
-        vkDestroyInstance(instance_, nullptr);
+        if (!headless_)
+            glfwSetFramebufferSizeCallback(window_, nullptr);
+
+        try
+        {
+            WaitForSubmit();
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+
+        // frames may still be executing, streaming workers may still submit uploads
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            vkDeviceWaitIdle(device_);
+        }
+
+        // the handles below destroy themselves, but only while the device is alive
+        deletion_queue_->Flush();
+        // captures of the frames that finished still reach the consumer, before their buffers go
+        frame_capture_->Update(GetRetiredFrame(), frame_number_);
+        frame_capture_.reset();
+        image_available_semaphores_.clear();
+        render_finished_semaphores_.clear();
+        frame_semaphore_.Reset();
+        job_system_.reset();
+        worker_command_pools_.clear();
+        command_pools_.clear();
+        render_graph_.reset();
+        post_processor_.reset();
+        try
+        {
+            pipeline_library_->SaveManifest();
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+        pipeline_library_.reset();
+        renderer_.reset();
+        asset_streamer_.reset();
+        pipeline_layout_.Reset();
+        try
+        {
+            pipeline_cache_->Save();
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+        pipeline_cache_.reset();
+        bindless_heap_.reset();
+        uniform_ring_.reset();
+        if (headless_)
+        {
+            for (size_t i = 0; i < swapchain_images_.size(); i++)
+                allocator_->DestroyImage(swapchain_images_[i], offscreen_allocations_[i]);
+        }
+        swapchain_.Reset();
+        // render graph memory may have been deferred
+        deletion_queue_->Flush();
+        deletion_queue_.reset();
+        upload_manager_.reset();
+        allocator_.reset();
+        compute_profiler_.reset();
+        profiler_.reset();
+        vkDestroyDevice(device_, host_allocator_->GetCallbacks());
+        if (!headless_)
+            vkDestroySurfaceKHR(instance_, surface_, host_allocator_->GetCallbacks());
+        vkDestroyInstance(instance_, host_allocator_->GetCallbacks());
+        host_allocator_.reset();
+    }
+
+    double VulkanManager::GetStartupElapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_start_).count();
+    }
+
+    void VulkanManager::RunStartupPhase(const char* name, const std::function<void()>& work)
+    {
+        double start_ms = GetStartupElapsed();
+        work();
+        double end_ms = GetStartupElapsed();
+
+        std::lock_guard<std::mutex> lock(startup_mutex_);
+        startup_phases_.push_back({ name, start_ms, end_ms - start_ms });
+    }
+
+    void VulkanManager::RunStartupPhases(const std::vector<std::pair<const char*, std::function<void()>>>& phases)
+    {
+        std::vector<util::JobSystem::JobHandle> jobs;
+        for (const auto& phase : phases)
+            jobs.push_back(job_system_->Run([this, &phase](uint32_t) { RunStartupPhase(phase.first, phase.second); }));
+
+        // the others still use this, so they finish before the first failure is rethrown
+        std::exception_ptr error;
+        for (const auto& job : jobs)
+        {
+            try
+            {
+                job_system_->Wait(job);
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void VulkanManager::CreateHostAllocator()
+    {
+        host_allocator_ = std::make_unique<HostAllocator>();
     }
 
     void VulkanManager::CreateInstance()
@@ -41,12 +279,13 @@ namespace vk
         app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         app_info.pEngineName = "No Engine";
         app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_0;
+        app_info.apiVersion = VK_API_VERSION_1_2;
 
-        // get glfw extensions
+        // get glfw extensions, headless needs no surface extensions
         uint32_t glfw_extension_count = 0;
-        const char** glfw_extensions;
-        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        const char** glfw_extensions = nullptr;
+        if (!headless_)
+            glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
         // create info
         VkInstanceCreateInfo create_info{};
@@ -66,13 +305,13 @@ namespace vk
 #endif
 
         // create instance
-        if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS)
+        if (vkCreateInstance(&create_info, host_allocator_->GetCallbacks(), &instance_) != VK_SUCCESS)
             throw std::runtime_error("Failed to create instance.");
     }
 
     void VulkanManager::CreateSurface(GLFWwindow* window)
     {
-        if (glfwCreateWindowSurface(instance_, window, nullptr, &surface_) != VK_SUCCESS)
+        if (glfwCreateWindowSurface(instance_, window, host_allocator_->GetCallbacks(), &surface_) != VK_SUCCESS)
             throw std::runtime_error("Failed to create window surface.");
     }
 
@@ -94,6 +333,9 @@ namespace vk
         if (physical_device_ == VK_NULL_HANDLE)
             throw std::runtime_error("Failed to get physical device.");
 
+        vkGetPhysicalDeviceProperties(physical_device_, &physical_device_properties_);
+        std::cout << "Graphics Card: " << physical_device_properties_.deviceName << std::endl;
+
         // get queues families
         uint32_t queue_family_count = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, nullptr);
@@ -108,6 +350,7 @@ namespace vk
             if (queue_families_[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
             {
                 // graphics queue family index
+                graphics_queue_family_index_ = i;
                 using_queue_family_indices_.insert(i);
                 found = true;
                 break;
@@ -115,6 +358,44 @@ namespace vk
         }
         if (!found) throw std::runtime_error("Device does not support graphics queue.");
 
+        // the renderer culls on the graphics queue right before drawing, and post
+        // processing falls back to it, so the graphics family has to support compute
+        if (!(queue_families_[graphics_queue_family_index_].queueFlags & VK_QUEUE_COMPUTE_BIT))
+            throw std::runtime_error("Device does not support compute on the graphics queue.");
+
+        // get compute only queue family index, runs post processing alongside graphics
+        compute_queue_family_index_ = graphics_queue_family_index_;
+        for (uint32_t i = 0; i < queue_families_.size(); i++)
+        {
+            VkQueueFlags flags = queue_families_[i].queueFlags;
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            {
+                compute_queue_family_index_ = i;
+                using_queue_family_indices_.insert(i);
+                break;
+            }
+        }
+
+        // get transfer only queue family index, usually backed by dedicated copy engines
+        transfer_queue_family_index_ = graphics_queue_family_index_;
+        for (uint32_t i = 0; i < queue_families_.size(); i++)
+        {
+            VkQueueFlags flags = queue_families_[i].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            {
+                transfer_queue_family_index_ = i;
+                using_queue_family_indices_.insert(i);
+                break;
+            }
+        }
+
+        // nothing is presented in headless mode
+        if (headless_)
+        {
+            present_queue_family_index_ = graphics_queue_family_index_;
+            return;
+        }
+
         // get present queue family index
         found = false;
         for (int i = 0; i < queue_families_.size(); i++)
@@ -125,6 +406,7 @@ namespace vk
             if (present_support)
             {
                 // present queue family index
+                present_queue_family_index_ = i;
                 using_queue_family_indices_.insert(i);
                 found = true;
                 break;
@@ -148,44 +430,240 @@ namespace vk
             queue_create_infos.push_back(queue_create_info);
         }
 
-        std::vector<const char*> extensions =
-        {
-            VK_KHR_SWAPCHAIN_EXTENSION_NAME
-        };
+        std::vector<const char*> extensions;
+        if (!headless_)
+            extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+        // vulkan 1.2 features
+        VkPhysicalDeviceVulkan12Features supported_features_12{};
+        supported_features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supported_features{};
+        supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported_features.pNext = &supported_features_12;
+        vkGetPhysicalDeviceFeatures2(physical_device_, &supported_features);
+
+        if (!supported_features_12.timelineSemaphore)
+            throw std::runtime_error("Device does not support timeline semaphores.");
+        // the bindless heap is a partially bound, update after bind runtime array
+        if (!supported_features_12.runtimeDescriptorArray || !supported_features_12.descriptorBindingPartiallyBound ||
+            !supported_features_12.descriptorBindingStorageBufferUpdateAfterBind ||
+            !supported_features_12.descriptorBindingSampledImageUpdateAfterBind ||
+            !supported_features_12.descriptorBindingUpdateUnusedWhilePending)
+            throw std::runtime_error("Device does not support descriptor indexing.");
+
+        enabled_features_12_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        enabled_features_12_.timelineSemaphore = VK_TRUE;
+        enabled_features_12_.drawIndirectCount = supported_features_12.drawIndirectCount;
+        enabled_features_12_.descriptorIndexing = supported_features_12.descriptorIndexing;
+        enabled_features_12_.runtimeDescriptorArray = VK_TRUE;
+        enabled_features_12_.descriptorBindingPartiallyBound = VK_TRUE;
+        enabled_features_12_.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        enabled_features_12_.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabled_features_12_.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        // lets shaders pick a different texture per invocation, push constant indices do not need it
+        enabled_features_12_.shaderSampledImageArrayNonUniformIndexing = supported_features_12.shaderSampledImageArrayNonUniformIndexing;
+        enabled_features_12_.shaderStorageBufferArrayNonUniformIndexing = supported_features_12.shaderStorageBufferArrayNonUniformIndexing;
+
+        // the renderer batches draws with these, and falls back without them
+        enabled_features_.multiDrawIndirect = supported_features.features.multiDrawIndirect;
+        enabled_features_.drawIndirectFirstInstance = supported_features.features.drawIndirectFirstInstance;
 
         // create logical device
         VkDeviceCreateInfo create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        create_info.pNext = &enabled_features_12_;
+        create_info.pEnabledFeatures = &enabled_features_;
         create_info.pQueueCreateInfos = queue_create_infos.data();
         create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
         create_info.enabledLayerCount = 0;
         create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
         create_info.ppEnabledExtensionNames = extensions.data();
 
-        if (vkCreateDevice(physical_device_, &create_info, nullptr, &device_) != VK_SUCCESS)
+        if (vkCreateDevice(physical_device_, &create_info, host_allocator_->GetCallbacks(), &device_) != VK_SUCCESS)
             throw std::runtime_error("Failed to create logical device.");
+
+        vkGetDeviceQueue(device_, graphics_queue_family_index_, 0, &graphics_queue_);
+        vkGetDeviceQueue(device_, present_queue_family_index_, 0, &present_queue_);
+        vkGetDeviceQueue(device_, transfer_queue_family_index_, 0, &transfer_queue_);
+        vkGetDeviceQueue(device_, compute_queue_family_index_, 0, &compute_queue_);
+    }
+
+    void VulkanManager::CreateAllocator()
+    {
+        allocator_ = std::make_unique<MemoryAllocator>(physical_device_, device_, 64ull << 20, host_allocator_->GetCallbacks());
+    }
+
+    void VulkanManager::CreateDeletionQueue()
+    {
+        deletion_queue_ = std::make_unique<DeletionQueue>(frames_in_flight_);
+    }
+
+    void VulkanManager::CreateProfiler()
+    {
+        // gpu zones live in the frame's command buffer, so the graphics queue needs timestamps
+        uint32_t timestamp_valid_bits = queue_families_[graphics_queue_family_index_].timestampValidBits;
+        profiler_ = std::make_unique<Profiler>(device_, physical_device_properties_, timestamp_valid_bits, frames_in_flight_,
+            host_allocator_->GetCallbacks());
+
+        // async post processing reuses its command buffers per post processor slot,
+        // one more than frames in flight
+        if (compute_queue_family_index_ != graphics_queue_family_index_)
+        {
+            timestamp_valid_bits = queue_families_[compute_queue_family_index_].timestampValidBits;
+            compute_profiler_ = std::make_unique<Profiler>(device_, physical_device_properties_, timestamp_valid_bits, frames_in_flight_ + 1,
+                host_allocator_->GetCallbacks());
+        }
+    }
+
+    void VulkanManager::CreateUploadManager()
+    {
+        UploadManager::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.transfer_queue = transfer_queue_;
+        config.transfer_queue_family_index = transfer_queue_family_index_;
+        config.graphics_queue_family_index = graphics_queue_family_index_;
+        config.queue_mutex = &queue_mutex_;
+
+        upload_manager_ = std::make_unique<UploadManager>(*allocator_, config);
+    }
+
+    void VulkanManager::CreateBindlessHeap()
+    {
+        VkPhysicalDeviceVulkan12Properties properties_12{};
+        properties_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties_12;
+        vkGetPhysicalDeviceProperties2(physical_device_, &properties);
+
+        // the set is visible to every stage, so the per stage limits apply to all of it
+        BindlessHeap::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.storage_buffer_capacity = std::min({ config.storage_buffer_capacity,
+            properties_12.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            properties_12.maxDescriptorSetUpdateAfterBindStorageBuffers });
+        config.sampled_image_capacity = std::min({ config.sampled_image_capacity,
+            properties_12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            properties_12.maxPerStageDescriptorUpdateAfterBindSamplers,
+            properties_12.maxDescriptorSetUpdateAfterBindSampledImages,
+            properties_12.maxDescriptorSetUpdateAfterBindSamplers });
+
+        // both bindings count towards every stage's resource limit, scale them down together to fit
+        uint32_t stage_resources = properties_12.maxPerStageUpdateAfterBindResources > kReservedStageResources ?
+            properties_12.maxPerStageUpdateAfterBindResources - kReservedStageResources : 0;
+        uint64_t total = (uint64_t)config.storage_buffer_capacity + config.sampled_image_capacity;
+        if (total > stage_resources)
+        {
+            config.storage_buffer_capacity = static_cast<uint32_t>(config.storage_buffer_capacity * (uint64_t)stage_resources / total);
+            config.sampled_image_capacity = stage_resources - config.storage_buffer_capacity;
+        }
+        if (config.storage_buffer_capacity == 0 || config.sampled_image_capacity == 0)
+            throw std::runtime_error("Device has too few per stage resources for the bindless heap.");
+
+        bindless_heap_ = std::make_unique<BindlessHeap>(config);
+    }
+
+    void VulkanManager::CreateUniformRing()
+    {
+        UniformRing::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.frames_in_flight = frames_in_flight_;
+        config.offset_alignment = physical_device_properties_.limits.minUniformBufferOffsetAlignment;
+
+        uniform_ring_ = std::make_unique<UniformRing>(*allocator_, config);
     }
 
-    void VulkanManager::CreateSwapchain(uint32_t width, uint32_t height)
+    void VulkanManager::CreateFrameCapture()
+    {
+        FrameCapture::Config config{};
+        // frames in flight finish before their slots are handed over, the rest give the consumer slack
+        config.slot_count = frames_in_flight_ + 2;
+
+        frame_capture_ = std::make_unique<FrameCapture>(*allocator_, config);
+    }
+
+    void VulkanManager::CreateAssetStreamer()
+    {
+        AssetStreamer::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.frames_in_flight = frames_in_flight_;
+
+        asset_streamer_ = std::make_unique<AssetStreamer>(*allocator_, *upload_manager_, *bindless_heap_, config);
+    }
+
+    void VulkanManager::CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR old_swapchain)
     {
         // get capabilities
         VkSurfaceCapabilitiesKHR capabilities;
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device_, surface_, &capabilities);
 
-        // get supported formats
-        uint32_t format_count;
-        std::vector<VkSurfaceFormatKHR> formats;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &format_count, nullptr);
-        formats.resize(format_count);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &format_count, formats.data());
-        swapchain_format_ = formats[0];
+        // choose the format once, the render pass and pipelines depend on it
+        if (old_swapchain == VK_NULL_HANDLE)
+        {
+            uint32_t format_count;
+            std::vector<VkSurfaceFormatKHR> formats;
+            vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &format_count, nullptr);
+            formats.resize(format_count);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &format_count, formats.data());
+
+            swapchain_format_ = formats[0];
+            for (const auto& format : formats)
+            {
+                if (format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+                {
+                    swapchain_format_ = format;
+                    break;
+                }
+            }
+        }
+
+        // choose the present mode, fifo is always supported
+        uint32_t present_mode_count;
+        std::vector<VkPresentModeKHR> present_modes;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device_, surface_, &present_mode_count, nullptr);
+        present_modes.resize(present_mode_count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device_, surface_, &present_mode_count, present_modes.data());
+
+        std::vector<VkPresentModeKHR> candidates;
+        switch (requested_present_mode_)
+        {
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            // no tearing first, then no waiting
+            candidates = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+            break;
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+            break;
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            candidates = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+            break;
+        default:
+            break;
+        }
+        present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+        for (auto candidate : candidates)
+        {
+            if (std::find(present_modes.begin(), present_modes.end(), candidate) != present_modes.end())
+            {
+                present_mode_ = candidate;
+                break;
+            }
+        }
 
         swapchain_extent_ = {
             std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, width)),
             std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, height))
         };
 
-        uint32_t image_count = std::max(3, (int)capabilities.minImageCount);
+        // fewer images means less queued latency, mailbox needs a spare one to
+        // always have an image to render into
+        uint32_t image_count = std::max(3u, capabilities.minImageCount);
+        if (low_latency_)
+            image_count = capabilities.minImageCount + (present_mode_ == VK_PRESENT_MODE_MAILBOX_KHR ? 1 : 0);
         if (capabilities.maxImageCount > 0 && capabilities.maxImageCount < image_count)
             image_count = capabilities.maxImageCount;
 
@@ -198,290 +676,829 @@ namespace vk
         swapchain_create_info.imageColorSpace = swapchain_format_.colorSpace;
         swapchain_create_info.imageExtent = swapchain_extent_;
         swapchain_create_info.imageArrayLayers = 1;
-        swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-        if (using_queue_family_indices_.size() > 1)
+        // nothing renders to the swapchain, post processing blits its output onto it
+        if (!(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+            throw std::runtime_error("Swapchain images do not support transfers.");
+        swapchain_create_info.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        // frame capture copies them out
+        capture_available_ = (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+        if (capture_available_)
+            swapchain_create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        // only the graphics and present queues touch swapchain images
+        uint32_t indices[] = { graphics_queue_family_index_, present_queue_family_index_ };
+        if (graphics_queue_family_index_ != present_queue_family_index_)
         {
-            std::vector<uint32_t> indices(using_queue_family_indices_.begin(), using_queue_family_indices_.end());
             swapchain_create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            swapchain_create_info.queueFamilyIndexCount = static_cast<uint32_t>(using_queue_family_indices_.size());
-            swapchain_create_info.pQueueFamilyIndices = indices.data();
+            swapchain_create_info.queueFamilyIndexCount = 2;
+            swapchain_create_info.pQueueFamilyIndices = indices;
         }
         else swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
         swapchain_create_info.preTransform = capabilities.currentTransform;
         swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        swapchain_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        swapchain_create_info.presentMode = present_mode_;
         swapchain_create_info.clipped = VK_TRUE;
-        swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
+        // lets the driver hand resources over and keep presenting the old images meanwhile
+        swapchain_create_info.oldSwapchain = old_swapchain;
 
         // create swapchain
-        if (vkCreateSwapchainKHR(device_, &swapchain_create_info, nullptr, &swapchain_) != VK_SUCCESS)
+        const VkAllocationCallbacks* allocation_callbacks = host_allocator_->GetCallbacks();
+        if (vkCreateSwapchainKHR(device_, &swapchain_create_info, allocation_callbacks, swapchain_.Replace(device_, allocation_callbacks)) != VK_SUCCESS)
             throw std::runtime_error("Failed to create swapchain.");
 
         // get swapchain images
         image_count = 0;
-        vkGetSwapchainImagesKHR(device_, swapchain_, &image_count, nullptr);
+        vkGetSwapchainImagesKHR(device_, swapchain_.Get(), &image_count, nullptr);
         swapchain_images_.resize(image_count);
-        vkGetSwapchainImagesKHR(device_, swapchain_, &image_count, swapchain_images_.data());
+        vkGetSwapchainImagesKHR(device_, swapchain_.Get(), &image_count, swapchain_images_.data());
+    }
 
-        // create image views for swapchain images
-        swapchain_image_views_.resize(image_count);
-        for (uint32_t i = 0; i < image_count; i++)
+    void VulkanManager::RecreateSwapchain()
+    {
+        // a minimized window has no framebuffer, wait until it is restored
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window_, &width, &height);
+        while (width == 0 || height == 0)
         {
-            VkImageViewCreateInfo create_info{};
-            create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            create_info.image = swapchain_images_[i];
-            create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            create_info.format = swapchain_format_.format;
-            create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            create_info.subresourceRange.baseMipLevel = 0;
-            create_info.subresourceRange.levelCount = 1;
-            create_info.subresourceRange.baseArrayLayer = 0;
-            create_info.subresourceRange.layerCount = 1;
-            if (vkCreateImageView(device_, &create_info, nullptr, &swapchain_image_views_[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to create swapchain image views.");
+            glfwWaitEvents();
+            glfwGetFramebufferSize(window_, &width, &height);
         }
+
+        // frames in flight may still composite into the old images, the old
+        // swapchain and the old scene images go once those frames have retired
+        UniqueSwapchain old_swapchain = std::move(swapchain_);
+        CreateSwapchain(width, height, old_swapchain.Get());
+        // retired by the new swapchain, images still queued for present are released by the driver
+        old_swapchain.Retire(*deletion_queue_);
+
+        // same formats, so the render passes stay the same; viewports are dynamic,
+        // so a new size only rebuilds the framebuffers and transient images
+        post_processor_->Resize(swapchain_extent_);
+        render_graph_->SetImportedImages(scene_color_, post_processor_->GetSceneImages(), post_processor_->GetSceneViews());
+        // the render scale carries over to the new size
+        ApplyRenderExtent(dynamic_resolution_->GetExtent(swapchain_extent_));
+        images_in_flight_.assign(swapchain_images_.size(), 0);
+
+        swapchain_dirty_ = false;
     }
 
-    void VulkanManager::CreateRenderPass()
+    void VulkanManager::FramebufferResizeCallback(GLFWwindow* window, int, int)
     {
-        VkAttachmentDescription color_attachment{};
-        color_attachment.format = swapchain_format_.format;
-        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        auto vk_manager = static_cast<VulkanManager*>(glfwGetWindowUserPointer(window));
+        vk_manager->swapchain_dirty_ = true;
+    }
 
-        VkAttachmentReference color_attachment_ref{};
-        color_attachment_ref.attachment = 0;
-        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    void VulkanManager::CreateOffscreenTargets(uint32_t width, uint32_t height)
+    {
+        swapchain_format_ = { VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+        swapchain_extent_ = { width, height };
 
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &color_attachment_ref;
+        // one target per frame in flight so frames never wait on each other's image
+        uint32_t image_count = frames_in_flight_;
+        swapchain_images_.resize(image_count);
+        offscreen_allocations_.resize(image_count);
 
-        VkRenderPassCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        create_info.attachmentCount = 1;
-        create_info.pAttachments = &color_attachment;
-        create_info.subpassCount = 1;
-        create_info.pSubpasses = &subpass;
+        for (uint32_t i = 0; i < image_count; i++)
+        {
+            VkImageCreateInfo image_info{};
+            image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_info.imageType = VK_IMAGE_TYPE_2D;
+            image_info.format = swapchain_format_.format;
+            image_info.extent = { width, height, 1 };
+            image_info.mipLevels = 1;
+            image_info.arrayLayers = 1;
+            image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            offscreen_allocations_[i] = allocator_->CreateImage(image_info, MemoryUsage::GpuOnly, &swapchain_images_[i]);
+        }
+    }
 
-        if (vkCreateRenderPass(device_, &create_info, nullptr, &render_pass_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create render pass.");
+    void VulkanManager::ChooseDepthFormat()
+    {
+        // both are optimal tiled depth formats on nearly every device, d32 first for precision
+        for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT })
+        {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
+            if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            {
+                depth_format_ = format;
+                return;
+            }
+        }
+        throw std::runtime_error("Failed to find a depth format.");
     }
 
-    VkShaderModule VulkanManager::CreateShaderModule(const std::string& filename)
+    void VulkanManager::CreateDynamicResolution()
     {
-        auto code = util::ReadFile(filename);
+        DynamicResolution::Config config{};
+        // async post processing timings come back one frame later still
+        config.latency_frames = frames_in_flight_ + 1;
 
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        dynamic_resolution_ = std::make_unique<DynamicResolution>(config);
+    }
 
-        VkShaderModule shader_module;
-        if (vkCreateShaderModule(device_, &createInfo, nullptr, &shader_module) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create shader module.");
+    void VulkanManager::CreatePostProcessor()
+    {
+        // the composite blits the tone mapped output onto the swapchain image
+        VkFormatProperties output_properties, target_properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device_, PostProcessor::kOutputFormat, &output_properties);
+        vkGetPhysicalDeviceFormatProperties(physical_device_, swapchain_format_.format, &target_properties);
+        if (!(output_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) ||
+            !(target_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+            throw std::runtime_error("Device cannot blit post processing output to the swapchain format.");
+
+        PostProcessor::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.pipeline_cache = pipeline_cache_->Get();
+        config.deletion_queue = deletion_queue_.get();
+        config.frames_in_flight = frames_in_flight_;
+        config.graphics_queue_family_index = graphics_queue_family_index_;
+        config.compute_queue_family_index = compute_queue_family_index_;
+        config.extent = swapchain_extent_;
+
+        post_processor_ = std::make_unique<PostProcessor>(*allocator_, config);
+    }
+
+    void VulkanManager::CreateRenderGraph()
+    {
+        RenderGraph::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.profiler = profiler_.get();
+        config.deletion_queue = deletion_queue_.get();
+
+        render_graph_ = std::make_unique<RenderGraph>(*allocator_, config);
+        render_extent_ = swapchain_extent_;
+        render_graph_->SetExtent(render_extent_);
+
+        // one scene image per post processor slot, executed with the slot as image index;
+        // left for post processing, which samples it on either queue
+        scene_color_ = render_graph_->ImportImages("SceneColor", PostProcessor::kSceneFormat,
+            post_processor_->GetSceneImages(), post_processor_->GetSceneViews(),
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        depth_buffer_ = render_graph_->CreateImage("Depth", { depth_format_ });
+
+        // gpu culling writes the draws recorded in the main pass, through buffers the graph does not see
+        culling_pass_ = render_graph_->AddPass("Culling", RenderGraph::PassType::Compute,
+            [this](const RenderGraph::PassContext& context) { renderer_->RecordCulling(context.command_buffer, current_frame_); });
+        render_graph_->SetSideEffect(culling_pass_);
+
+        main_pass_ = render_graph_->AddPass("MainPass", RenderGraph::PassType::Graphics,
+            [this](const RenderGraph::PassContext& context) { RecordMainPass(context); });
+        VkClearColorValue clear_color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+        VkClearDepthStencilValue clear_depth = { 1.0f, 0 };
+        render_graph_->WriteColor(main_pass_, scene_color_, &clear_color);
+        render_graph_->WriteDepth(main_pass_, depth_buffer_, &clear_depth);
+
+        render_graph_->Compile();
+        pipeline_library_->RegisterRenderPass("MainPass", render_graph_->GetRenderPass(main_pass_));
+    }
+
+    void VulkanManager::CreatePipelineCache()
+    {
+        pipeline_cache_ = std::make_unique<PipelineCache>(device_, physical_device_properties_, "pipeline_cache.bin",
+            host_allocator_->GetCallbacks());
+    }
+
+    void VulkanManager::CreatePipelineLibrary()
+    {
+        PipelineLibrary::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.pipeline_cache = pipeline_cache_->Get();
+        config.manifest_path = "pipeline_manifest.txt";
 
-        return shader_module;
+        pipeline_library_ = std::make_unique<PipelineLibrary>(config);
     }
 
     void VulkanManager::CreateGraphicsPipeline()
     {
-        VkShaderModule vertex_shader = CreateShaderModule("src/shaders/vert.spv");
-        VkShaderModule fragment_shader = CreateShaderModule("src/shaders/frag.spv");
-
-        VkPipelineShaderStageCreateInfo vertex_shader_stage_info{};
-        vertex_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertex_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertex_shader_stage_info.module = vertex_shader;
-        vertex_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo fragment_shader_stage_info{};
-        fragment_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragment_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragment_shader_stage_info.module = fragment_shader;
-        fragment_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shaderStages[] = { vertex_shader_stage_info, fragment_shader_stage_info };
-
-        VkPipelineVertexInputStateCreateInfo vertex_info_info{};
-        vertex_info_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertex_info_info.vertexBindingDescriptionCount = 0;
-        vertex_info_info.vertexAttributeDescriptionCount = 0;
-
-        VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        input_assembly.primitiveRestartEnable = VK_FALSE;
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)swapchain_extent_.width;
-        viewport.height = (float)swapchain_extent_.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = swapchain_extent_;
-
-        VkPipelineViewportStateCreateInfo viewport_state{};
-        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewport_state.viewportCount = 1;
-        viewport_state.pViewports = &viewport;
-        viewport_state.scissorCount = 1;
-        viewport_state.pScissors = &scissor;
-
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-        VkPipelineColorBlendAttachmentState color_blend_attachment{};
-        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        color_blend_attachment.blendEnable = VK_FALSE;
-
-        VkPipelineColorBlendStateCreateInfo color_blending{};
-        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        color_blending.logicOpEnable = VK_FALSE;
-        color_blending.logicOp = VK_LOGIC_OP_COPY;
-        color_blending.attachmentCount = 1;
-        color_blending.pAttachments = &color_blend_attachment;
-        color_blending.blendConstants[0] = 0.0f;
-        color_blending.blendConstants[1] = 0.0f;
-        color_blending.blendConstants[2] = 0.0f;
-        color_blending.blendConstants[3] = 0.0f;
-
-        // create pipeline layout
+        const VkAllocationCallbacks* allocation_callbacks = host_allocator_->GetCallbacks();
+
+        // globals from the uniform ring, the transform of each draw as push constants
+        VkDescriptorSetLayout set_layout = uniform_ring_->GetSetLayout();
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(DrawPushConstants);
+
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipeline_layout_info.setLayoutCount = 0;
-        pipeline_layout_info.pushConstantRangeCount = 0;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
-        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS)
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, allocation_callbacks, pipeline_layout_.Replace(device_, allocation_callbacks)) != VK_SUCCESS)
             throw std::runtime_error("Failed to create pipeline layout.");
+        pipeline_library_->RegisterLayout("Test", pipeline_layout_.Get());
+
+        GraphicsPipelineDesc desc{};
+        desc.vertex_shader = "src/shaders/vert.spv";
+        desc.fragment_shader = "src/shaders/frag.spv";
+        desc.layout = pipeline_layout_.Get();
+        desc.render_pass = render_graph_->GetRenderPass(main_pass_);
+        desc.subpass = render_graph_->GetSubpass(main_pass_);
+        // the test triangles are flat and drawn over each other, they ignore the depth buffer
+        desc.depth_test = false;
+        desc.depth_write = false;
+        graphics_pipeline_ = pipeline_library_->Request(desc);
+    }
 
-        // create pipline
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertex_info_info;
-        pipelineInfo.pInputAssemblyState = &input_assembly;
-        pipelineInfo.pViewportState = &viewport_state;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pColorBlendState = &color_blending;
-        pipelineInfo.layout = pipeline_layout_;
-        pipelineInfo.renderPass = render_pass_;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    void VulkanManager::CreateRenderer()
+    {
+        Renderer::Config config{};
+        config.device = device_;
+        config.allocation_callbacks = host_allocator_->GetCallbacks();
+        config.render_pass = render_graph_->GetRenderPass(main_pass_);
+        config.subpass = render_graph_->GetSubpass(main_pass_);
+        config.pipeline_cache = pipeline_cache_->Get();
+        config.frames_in_flight = frames_in_flight_;
+        config.multi_draw_indirect = enabled_features_.multiDrawIndirect;
+        config.draw_indirect_first_instance = enabled_features_.drawIndirectFirstInstance;
+        config.draw_indirect_count = enabled_features_12_.drawIndirectCount;
+
+        renderer_ = std::make_unique<Renderer>(*allocator_, *upload_manager_, *bindless_heap_, *pipeline_library_, config);
+    }
 
-        if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphics_pipeline_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create graphics pipline.");
+    void VulkanManager::PrewarmPipelines()
+    {
+        // compile what the last run needed alongside what this one asked for, and
+        // wait for all of it here rather than hitch on it during the first frames
+        auto start = std::chrono::steady_clock::now();
+        uint32_t prewarmed = pipeline_library_->Prewarm();
+        pipeline_library_->Wait();
+        pipeline_creation_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << pipeline_library_->GetPipelineCount() << " graphics pipelines (" << prewarmed << " from the manifest) created in "
+            << pipeline_creation_ms_ << " ms (" << (pipeline_cache_->IsWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+    }
 
-        vkDestroyShaderModule(device_, fragment_shader, nullptr);
-        vkDestroyShaderModule(device_, vertex_shader, nullptr);
+    void VulkanManager::CreateJobSystem(uint32_t worker_threads)
+    {
+        job_system_ = std::make_unique<util::JobSystem>(worker_threads);
     }
 
-    void VulkanManager::CreateFramebuffers()
+    void VulkanManager::CreateCommandPools()
     {
-        swapchain_framebuffers_.resize(swapchain_image_views_.size());
+        // one more for the thread driving the frames
+        uint32_t worker_count = job_system_->GetThreadCount() + 1;
 
-        for (int i = 0; i < swapchain_image_views_.size(); i++)
+        // every pool is reset as a whole once its frame has retired
+        const VkAllocationCallbacks* allocation_callbacks = host_allocator_->GetCallbacks();
+        VkCommandPoolCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        create_info.queueFamilyIndex = graphics_queue_family_index_;
+        create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        command_pools_.resize(frames_in_flight_);
+        worker_command_pools_.resize(frames_in_flight_);
+        secondary_command_buffers_.resize(frames_in_flight_);
+        secondary_command_buffers_used_.resize(worker_count, 0);
+
+        for (uint32_t i = 0; i < frames_in_flight_; i++)
         {
-            VkImageView attachments[] = { swapchain_image_views_[i] };
+            if (vkCreateCommandPool(device_, &create_info, allocation_callbacks, command_pools_[i].Replace(device_, allocation_callbacks)) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create command pool.");
+
+            worker_command_pools_[i].resize(worker_count);
+            secondary_command_buffers_[i].resize(worker_count);
+            for (uint32_t j = 0; j < worker_count; j++)
+            {
+                if (vkCreateCommandPool(device_, &create_info, allocation_callbacks, worker_command_pools_[i][j].Replace(device_, allocation_callbacks)) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create worker command pool.");
+            }
+        }
+    }
 
-            VkFramebufferCreateInfo frame_buffer_info{};
-            frame_buffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            frame_buffer_info.renderPass = render_pass_;
-            frame_buffer_info.attachmentCount = 1;
-            frame_buffer_info.pAttachments = attachments;
-            frame_buffer_info.width = swapchain_extent_.width;
-            frame_buffer_info.height = swapchain_extent_.height;
-            frame_buffer_info.layers = 1;
+    void VulkanManager::CreateCommandBuffers()
+    {
+        command_buffers_.resize(frames_in_flight_);
+        composite_command_buffers_.resize(frames_in_flight_);
 
-            if (vkCreateFramebuffer(device_, &frame_buffer_info, nullptr, &swapchain_framebuffers_[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to create framebuffer.");
+        for (uint32_t i = 0; i < frames_in_flight_; i++)
+        {
+            VkCommandBufferAllocateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            info.commandPool = command_pools_[i].Get();
+            info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            info.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device_, &info, &command_buffers_[i]) != VK_SUCCESS ||
+                vkAllocateCommandBuffers(device_, &info, &composite_command_buffers_[i]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate command buffers.");
         }
     }
 
-    void VulkanManager::CreateCommandPool()
+    void VulkanManager::CreateSyncObjects()
     {
-        VkCommandPoolCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        create_info.queueFamilyIndex = *using_queue_family_indices_.begin();
-        create_info.flags = 0;
+        image_available_semaphores_.resize(frames_in_flight_);
+        render_finished_semaphores_.resize(frames_in_flight_);
+        // frame number 0 is never submitted, so the first wait on each slot returns immediately
+        frame_numbers_.resize(frames_in_flight_, 0);
+        images_in_flight_.resize(swapchain_images_.size(), 0);
+
+        const VkAllocationCallbacks* allocation_callbacks = host_allocator_->GetCallbacks();
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (uint32_t i = 0; i < frames_in_flight_; i++)
+        {
+            if (vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks, image_available_semaphores_[i].Replace(device_, allocation_callbacks)) != VK_SUCCESS ||
+                vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks, render_finished_semaphores_[i].Replace(device_, allocation_callbacks)) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create frame synchronization objects.");
+        }
+
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+        semaphore_info.pNext = &type_info;
 
-        if (vkCreateCommandPool(device_, &create_info, nullptr, &command_pool_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create command pool.");
+        if (vkCreateSemaphore(device_, &semaphore_info, allocation_callbacks, frame_semaphore_.Replace(device_, allocation_callbacks)) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create frame timeline semaphore.");
     }
 
-    void VulkanManager::CreateCommandBuffers()
+    void VulkanManager::RecordCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index, bool async)
     {
-        command_buffers_.resize(swapchain_framebuffers_.size());
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(command_buffer, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record command buffer.");
+
+        profiler_->BeginGpuFrame(command_buffer);
 
-        VkCommandBufferAllocateInfo info{};
-        info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        info.commandPool = command_pool_;
-        info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        info.commandBufferCount = (uint32_t)command_buffers_.size();
+        // take ownership of finished uploads before anything reads them
+        submission_.upload_wait_value = upload_manager_->RecordAcquireBarriers(command_buffer);
 
-        if (vkAllocateCommandBuffers(device_, &info, command_buffers_.data()) != VK_SUCCESS)
-            throw std::runtime_error("Failed to allocate command buffers.");
+        // split the test triangles across workers once there are enough of them,
+        // the renderer's batches are few and go into one more secondary
+        chunk_count_ = std::min(job_system_->GetThreadCount() + 1, draw_count_ / kMinDrawsPerWorker);
+        if (chunk_count_ <= 1)
+            chunk_count_ = 0;
+        render_graph_->SetSubpassContents(main_pass_, chunk_count_ ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+        render_graph_->Execute(command_buffer, post_processor_->GetSlot());
 
-        // record commands for each swapchain framebuffer
-        for (size_t i = 0; i < command_buffers_.size(); i++)
+        // async frames post process and composite in other batches
+        if (!async)
         {
-            VkCommandBufferBeginInfo beginInfo{};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            post_processor_->Record(command_buffer, profiler_.get());
+            RecordComposite(command_buffer, image_index);
+        }
 
-            if (vkBeginCommandBuffer(command_buffers_[i], &beginInfo) != VK_SUCCESS)
-                throw std::runtime_error("Failed to record command buffer.");
+        profiler_->EndGpuFrame(command_buffer);
 
-            VkRenderPassBeginInfo renderPassInfo{};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = render_pass_;
-            renderPassInfo.framebuffer = swapchain_framebuffers_[i];
-            renderPassInfo.renderArea.offset = { 0, 0 };
-            renderPassInfo.renderArea.extent = swapchain_extent_;
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record command buffer.");
+    }
 
-            VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
+    void VulkanManager::RecordCompositeCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index)
+    {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record composite command buffer.");
+        RecordComposite(command_buffer, image_index);
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record composite command buffer.");
+    }
 
-            vkCmdBeginRenderPass(command_buffers_[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    void VulkanManager::RecordComposite(VkCommandBuffer command_buffer, uint32_t image_index)
+    {
+        uint32_t zone = profiler_->BeginGpuZone(command_buffer, "Composite");
+        // offscreen targets are left ready to be copied out
+        VkImage image = swapchain_images_[image_index];
+        VkImageLayout final_layout = headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        if (frame_capture_->IsCapturing() && capture_available_)
+        {
+            // the capture copies the image out and moves it on to its final layout
+            post_processor_->RecordComposite(command_buffer, image, swapchain_extent_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            frame_capture_->Record(command_buffer, image, swapchain_extent_, swapchain_format_.format, submission_.frame_number, final_layout);
+        }
+        else post_processor_->RecordComposite(command_buffer, image, swapchain_extent_, final_layout);
+        profiler_->EndGpuZone(command_buffer, zone);
+    }
+
+    void VulkanManager::RecordMainPass(const RenderGraph::PassContext& context)
+    {
+        if (chunk_count_ == 0)
+        {
+            RecordScene(context.command_buffer, 0, draw_count_);
+            renderer_->Record(context.command_buffer, current_frame_);
+            return;
+        }
+
+        VkCommandBufferInheritanceInfo inheritance_info{};
+        inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance_info.renderPass = context.render_pass;
+        inheritance_info.subpass = context.subpass;
+        inheritance_info.framebuffer = context.framebuffer;
+
+        uint32_t chunk_count = chunk_count_;
+        uint32_t secondary_count = chunk_count + (renderer_->HasDraws() ? 1 : 0);
+        std::fill(secondary_command_buffers_used_.begin(), secondary_command_buffers_used_.end(), 0);
+        recorded_secondaries_.resize(secondary_count);
+        job_system_->ParallelFor(secondary_count, 1, [&](uint32_t worker, uint32_t begin, uint32_t end)
+        {
+            for (uint32_t chunk = begin; chunk < end; chunk++)
+            {
+                Profiler::CpuZone zone(*profiler_, "RecordSecondary");
+                VkCommandBuffer secondary = GetSecondaryCommandBuffer(worker);
+
+                VkCommandBufferBeginInfo begin_info{};
+                begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                begin_info.pInheritanceInfo = &inheritance_info;
+
+                if (vkBeginCommandBuffer(secondary, &begin_info) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to record secondary command buffer.");
+                RenderGraph::SetViewport(secondary, context.extent);
+                if (chunk < chunk_count)
+                {
+                    uint32_t first_draw = (uint64_t)draw_count_ * chunk / chunk_count;
+                    uint32_t last_draw = (uint64_t)draw_count_ * (chunk + 1) / chunk_count;
+                    RecordScene(secondary, first_draw, last_draw - first_draw);
+                }
+                else
+                    renderer_->Record(secondary, current_frame_);
+                if (vkEndCommandBuffer(secondary) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to record secondary command buffer.");
+
+                recorded_secondaries_[chunk] = secondary;
+            }
+        });
 
-            vkCmdBindPipeline(command_buffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+        vkCmdExecuteCommands(context.command_buffer, secondary_count, recorded_secondaries_.data());
+    }
 
-            vkCmdDraw(command_buffers_[i], 3, 1, 0, 0);
+    void VulkanManager::RecordScene(VkCommandBuffer command_buffer, uint32_t first_draw, uint32_t draw_count)
+    {
+        if (draw_count == 0)
+            return;
 
-            vkCmdEndRenderPass(command_buffers_[i]);
+        // skipped until the pipeline or its fallback is ready
+        VkPipeline pipeline = pipeline_library_->Get(graphics_pipeline_);
+        if (pipeline == VK_NULL_HANDLE)
+            return;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        uniform_ring_->Bind(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_.Get(), 0, globals_offset_);
 
-            if (vkEndCommandBuffer(command_buffers_[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to record command buffer.");
+        for (uint32_t i = first_draw; i < first_draw + draw_count; i++)
+        {
+            DrawPushConstants push_constants{ draw_transforms_[i] };
+            vkCmdPushConstants(command_buffer, pipeline_layout_.Get(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
+            vkCmdDraw(command_buffer, 3, 1, 0, 0);
+        }
+    }
+
+    VkCommandBuffer VulkanManager::GetSecondaryCommandBuffer(uint32_t worker)
+    {
+        // buffers are reused every time this frame slot comes around, grow on demand
+        auto& buffers = secondary_command_buffers_[current_frame_][worker];
+        uint32_t& used = secondary_command_buffers_used_[worker];
+        if (used == buffers.size())
+        {
+            VkCommandBufferAllocateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            info.commandPool = worker_command_pools_[current_frame_][worker].Get();
+            info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            info.commandBufferCount = 1;
+
+            VkCommandBuffer command_buffer;
+            if (vkAllocateCommandBuffers(device_, &info, &command_buffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate secondary command buffer.");
+            buffers.push_back(command_buffer);
+        }
+        return buffers[used++];
+    }
+
+    void VulkanManager::DrawFrame()
+    {
+        Profiler::CpuZone frame_zone(*profiler_, "DrawFrame");
+
+        // the last frame may still be submitting
+        WaitForSubmit();
+        frame_host_allocations_ = host_allocator_->TakeFrameAllocations();
+
+        if (swapchain_dirty_)
+            RecreateSwapchain();
+
+        // wait until the gpu has retired the last submission of this frame slot,
+        // earlier slots keep running while this one is recorded
+        {
+            Profiler::CpuZone zone(*profiler_, "WaitForFrame");
+            WaitForFrame(frame_numbers_[current_frame_]);
+        }
+        profiler_->BeginFrame(current_frame_);
+
+        // async frames composite the output of the frame before, the first has none to show
+        bool async = IsAsyncCompute();
+        bool composite = !async || post_processor_->HasOutput();
+
+        // headless frame slots own their target image
+        uint32_t image_index = current_frame_;
+        if (!headless_ && composite)
+        {
+            Profiler::CpuZone zone(*profiler_, "Acquire");
+            VkResult result = vkAcquireNextImageKHR(device_, swapchain_.Get(), UINT64_MAX,
+                image_available_semaphores_[current_frame_].Get(), VK_NULL_HANDLE, &image_index);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                // nothing was acquired, retry with a new swapchain next frame
+                swapchain_dirty_ = true;
+                return;
+            }
+            // suboptimal images are still presented, the swapchain is recreated after
+            if (result == VK_SUBOPTIMAL_KHR)
+                swapchain_dirty_ = true;
+            else if (result != VK_SUCCESS)
+                throw std::runtime_error("Failed to acquire swapchain image.");
+        }
+
+        // Later frames wait for this frame number on the slot and the image, so it is
+        // only handed out once the jobs are running, which end in the submit; a frame
+        // that fails after that is signalled from the host by WaitForSubmit. The post
+        // processing frame is only waited for once the record job has run.
+        uint64_t frame_number = frame_number_ + 1;
+        uint64_t post_frame = post_processor_->BeginFrame();
+        if (compute_profiler_)
+            compute_profiler_->BeginFrame(post_processor_->GetSlot());
+
+        // pick the render scale from the latest timings; with async post processing
+        // the two queues overlap, so the slower one sets the pace
+        double gpu_frame_ms = profiler_->GetLastGpuFrameTime();
+        if (async)
+            gpu_frame_ms = std::max(gpu_frame_ms, compute_profiler_->GetLastGpuFrameTime());
+        dynamic_resolution_->Update(gpu_frame_ms);
+        VkExtent2D render_extent = dynamic_resolution_->GetExtent(swapchain_extent_);
+        if (render_extent.width != render_extent_.width || render_extent.height != render_extent_.height)
+            ApplyRenderExtent(render_extent);
+
+        // the slot's previous frame has retired, so its uniforms can be rewritten
+        FrameGlobals globals{};
+        globals.view_projection = view_projection_;
+        globals.render_extent[0] = (float)render_extent_.width;
+        globals.render_extent[1] = (float)render_extent_.height;
+        globals.frame_number = static_cast<uint32_t>(frame_number);
+        uniform_ring_->BeginFrame(current_frame_);
+        globals_offset_ = uniform_ring_->Write(globals);
+
+        // the acquired image may still be rendered to by another frame slot
+        if (composite)
+            WaitForFrame(images_in_flight_[image_index]);
+
+        // captures of retired frames go to the consumer, a few frames after they were recorded
+        frame_capture_->Update(GetRetiredFrame(), frame_number);
+
+        // kick off uploads queued since the last frame
+        upload_manager_->Flush();
+
+        // the frame has retired, recycle all of its command memory at once
+        vkResetCommandPool(device_, command_pools_[current_frame_].Get(), 0);
+        for (const auto& pool : worker_command_pools_[current_frame_])
+            vkResetCommandPool(device_, pool.Get(), 0);
+
+        submission_ = {};
+        submission_.frame = current_frame_;
+        submission_.image_index = image_index;
+        submission_.frame_number = frame_number;
+        submission_.async = async;
+        submission_.composite = composite;
+        submission_.post_frame = post_frame;
+        // taken before this frame's async post processing replaces it
+        submission_.post_wait_value = post_processor_->TakePostWait();
+
+        frame_number_ = frame_number;
+        frame_numbers_[current_frame_] = frame_number;
+        if (composite)
+            images_in_flight_[image_index] = frame_number;
+
+        // Streaming and preparing the renderer's buffers are independent, recording
+        // needs both and the submit needs the recording. Recording is the last job
+        // to read state the caller may change between frames, so DrawFrame returns
+        // once it is done and the submit and present overlap the caller's next frame.
+        auto stream = job_system_->Run([this](uint32_t)
+        {
+            Profiler::CpuZone zone(*profiler_, "StreamAssets");
+            asset_streamer_->Update();
+        });
+        auto prepare = job_system_->Run([this](uint32_t)
+        {
+            Profiler::CpuZone zone(*profiler_, "Prepare");
+            renderer_->Prepare(current_frame_);
+        });
+        auto record = job_system_->Run([this, image_index, async, composite](uint32_t)
+        {
+            Profiler::CpuZone zone(*profiler_, "Record");
+            RecordCommandBuffer(command_buffers_[current_frame_], image_index, async);
+            if (async)
+            {
+                // blits the previous output, so before this frame's post processing replaces it
+                if (composite)
+                    RecordCompositeCommandBuffer(composite_command_buffers_[current_frame_], image_index);
+                submission_.compute_command_buffer = post_processor_->RecordAsync(compute_profiler_.get());
+            }
+        }, { stream, prepare });
+        submit_job_ = job_system_->Run([this](uint32_t) { SubmitFrame(); }, { record });
+
+        // the calling thread runs jobs meanwhile
+        job_system_->Wait(record);
+
+        current_frame_ = (current_frame_ + 1) % frames_in_flight_;
+    }
+
+    void VulkanManager::ApplyRenderExtent(VkExtent2D extent)
+    {
+        // the scene renders into the top left of the scene images, post processing
+        // works on that part and the composite blit scales it up to the swapchain
+        render_extent_ = extent;
+        post_processor_->SetRenderExtent(extent);
+        render_graph_->SetExtent(extent);
+        render_graph_->Compile();
+    }
+
+    void VulkanManager::SubmitFrame()
+    {
+        FrameSubmission& frame = submission_;
+        VkCommandBuffer command_buffer = command_buffers_[frame.frame];
+        VkCommandBuffer composite_command_buffer = composite_command_buffers_[frame.frame];
+
+        // Synchronous frames are one batch. Async frames are a geometry batch
+        // and a composite batch on the graphics queue, with post processing on
+        // the compute queue in between; the composite waits on the post
+        // processing of the frame before, so nothing here waits on the compute
+        // work that was just submitted.
+        BatchSemaphores frame_semaphores, composite_semaphores, compute_semaphores;
+        BatchSemaphores& present_semaphores = frame.async ? composite_semaphores : frame_semaphores;
+        if (frame.upload_wait_value)
+        {
+            // already reached on the transfer queue, orders the ownership acquires after the releases
+            frame_semaphores.Wait(upload_manager_->GetTimelineSemaphore(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, frame.upload_wait_value);
+        }
+        // only the composite touches the swapchain image
+        if (!headless_ && frame.composite)
+        {
+            present_semaphores.Wait(image_available_semaphores_[frame.frame].Get(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+            present_semaphores.Signal(render_finished_semaphores_[frame.frame].Get());
+        }
+        // also after switching to synchronous, so the slot is known to be done when its frame retires
+        if (frame.post_wait_value)
+            present_semaphores.Wait(post_processor_->GetPostSemaphore(), VK_PIPELINE_STAGE_TRANSFER_BIT, frame.post_wait_value);
+        if (frame.async)
+        {
+            frame_semaphores.Signal(post_processor_->GetSceneSemaphore(), frame.post_frame);
+            compute_semaphores.Wait(post_processor_->GetSceneSemaphore(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, frame.post_frame);
+            compute_semaphores.Signal(post_processor_->GetPostSemaphore(), frame.post_frame);
+        }
+        // the last graphics batch retires the frame, earlier batches complete before it
+        bool composite_batch = frame.async && frame.composite;
+        (composite_batch ? composite_semaphores : frame_semaphores).Signal(frame_semaphore_.Get(), frame.frame_number);
+
+        VkSubmitInfo submit_infos[2];
+        uint32_t submit_count = 0;
+        submit_infos[submit_count++] = frame_semaphores.GetSubmitInfo(&command_buffer);
+        if (composite_batch)
+            submit_infos[submit_count++] = composite_semaphores.GetSubmitInfo(&composite_command_buffer);
+
+        {
+            Profiler::CpuZone zone(*profiler_, "Submit");
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (vkQueueSubmit(graphics_queue_, submit_count, submit_infos, VK_NULL_HANDLE) != VK_SUCCESS)
+                throw std::runtime_error("Failed to submit draw command buffer.");
+            frame.submitted = true;
+            if (frame.async)
+            {
+                VkSubmitInfo compute_info = compute_semaphores.GetSubmitInfo(&frame.compute_command_buffer);
+                if (vkQueueSubmit(compute_queue_, 1, &compute_info, VK_NULL_HANDLE) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to submit post processing command buffer.");
+                frame.compute_submitted = true;
+            }
+        }
+        deletion_queue_->NextFrame();
+        if (frame.frame_number == 1)
+            first_frame_ms_ = GetStartupElapsed();
+
+        if (headless_ || !frame.composite)
+            return;
+
+        // present
+        VkSemaphore signal_semaphore = render_finished_semaphores_[frame.frame].Get();
+        VkPresentInfoKHR present_info{};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = &signal_semaphore;
+        present_info.swapchainCount = 1;
+        VkSwapchainKHR swapchain = swapchain_.Get();
+        present_info.pSwapchains = &swapchain;
+        present_info.pImageIndices = &frame.image_index;
+
+        VkResult result;
+        {
+            Profiler::CpuZone zone(*profiler_, "Present");
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            result = vkQueuePresentKHR(present_queue_, &present_info);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+            swapchain_dirty_ = true;
+        else if (result != VK_SUCCESS)
+            throw std::runtime_error("Failed to present swapchain image.");
+    }
+
+    void VulkanManager::AbandonFrame()
+    {
+        const FrameSubmission& frame = submission_;
+
+        // a host signal may not overtake pending signals of lower values, so the
+        // submissions of earlier frames have to finish first
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            vkQueueWaitIdle(graphics_queue_);
+            vkQueueWaitIdle(compute_queue_);
+        }
+
+        auto signal = [this](VkSemaphore semaphore, uint64_t value)
+        {
+            VkSemaphoreSignalInfo signal_info{};
+            signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+            signal_info.semaphore = semaphore;
+            signal_info.value = value;
+            vkSignalSemaphore(device_, &signal_info);
+        };
+        // the frame slot and its image are waited on by later frames, an async
+        // frame's post processing by the composite of the next one
+        if (!frame.submitted)
+            signal(frame_semaphore_.Get(), frame.frame_number);
+        if (frame.async && !frame.compute_submitted)
+            signal(post_processor_->GetPostSemaphore(), frame.post_frame);
+    }
+
+    void VulkanManager::WaitForSubmit()
+    {
+        // cleared first, a failed submit throws only once
+        util::JobSystem::JobHandle submit_job = std::move(submit_job_);
+        submit_job_.reset();
+        try
+        {
+            job_system_->Wait(submit_job);
+        }
+        catch (...)
+        {
+            // also when a job the submit depended on failed
+            AbandonFrame();
+            throw;
+        }
+    }
+
+    void VulkanManager::WaitForFrame(uint64_t frame_number)
+    {
+        if (frame_number == 0)
+            return;
+
+        VkSemaphore semaphore = frame_semaphore_.Get();
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &semaphore;
+        wait_info.pValues = &frame_number;
+        vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+    }
+
+    void VulkanManager::SetCaptureConsumer(FrameCapture::Consumer consumer)
+    {
+        if (consumer && !capture_available_)
+            throw std::runtime_error("Swapchain images cannot be copied from.");
+        frame_capture_->SetConsumer(std::move(consumer));
+    }
+
+    uint64_t VulkanManager::GetRetiredFrame() const
+    {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device_, frame_semaphore_.Get(), &value);
+        return value;
+    }
+
+    void VulkanManager::WaitIdle()
+    {
+        WaitForSubmit();
+
+        // idling the device also needs every queue to be externally synchronized
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            vkDeviceWaitIdle(device_);
         }
+        frame_capture_->Update(frame_number_, frame_number_);
     }
 }
@@ -4,47 +4,294 @@ namespace vk
 {
     class VulkanManager
     {
+    public:
+        // a step of the constructor, phases started together overlap
+        struct StartupPhase
+        {
+            const char* name;
+            // since the constructor started
+            double start_ms;
+            double ms;
+        };
+
     private:
+        // what the submit job needs, filled while the frame is recorded
+        struct FrameSubmission
+        {
+            uint32_t frame;
+            uint32_t image_index;
+            uint64_t frame_number;
+            bool async;
+            bool composite;
+            uint64_t post_frame;
+            uint64_t post_wait_value;
+            // upload timeline value to wait on, 0 for none
+            uint64_t upload_wait_value;
+            VkCommandBuffer compute_command_buffer;
+            // set once the queue accepted the batches signalling the frame's timeline values
+            bool submitted;
+            bool compute_submitted;
+        };
+
+        // no window, surface or swapchain; frames render into offscreen images
+        bool headless_;
+
+        std::chrono::steady_clock::time_point startup_start_;
+        // phases run as jobs record themselves from the workers
+        std::mutex startup_mutex_;
+        std::vector<StartupPhase> startup_phases_;
+        double startup_ms_ = 0.0;
+        // until the first frame was submitted, written by the submit job
+        std::atomic<double> first_frame_ms_{ 0.0 };
+
+        // every Vulkan object is created and destroyed with its callbacks, so it goes last
+        std::unique_ptr<HostAllocator> host_allocator_;
+        // host allocations per scope of the last finished frame, its submit included
+        std::array<uint64_t, HostAllocator::kScopeCount> frame_host_allocations_{};
+
         VkInstance instance_;
         VkPhysicalDevice physical_device_;
-        VkSurfaceKHR surface_;
+        VkPhysicalDeviceProperties physical_device_properties_;
+        GLFWwindow* window_ = nullptr;
+        VkSurfaceKHR surface_ = VK_NULL_HANDLE;
         VkDevice device_;
+        std::unique_ptr<MemoryAllocator> allocator_;
+        // replaced resources wait here for the frames that may use them
+        std::unique_ptr<DeletionQueue> deletion_queue_;
+        std::unique_ptr<UploadManager> upload_manager_;
+        std::unique_ptr<BindlessHeap> bindless_heap_;
+        // per frame uniforms, the frame's globals first
+        std::unique_ptr<UniformRing> uniform_ring_;
+        uint32_t globals_offset_ = 0;
+        Matrix4 view_projection_ = kIdentityMatrix;
+        std::unique_ptr<AssetStreamer> asset_streamer_;
+        // copies composited frames back to the host for a consumer, while one is set
+        std::unique_ptr<FrameCapture> frame_capture_;
+        // the swapchain images can be copied from, always true headless
+        bool capture_available_ = true;
+        // graphics, present and transfer queues may be one queue, submits from any thread hold this
+        std::mutex queue_mutex_;
+        // optional features turned on when the device supports them
+        VkPhysicalDeviceFeatures enabled_features_{};
+        VkPhysicalDeviceVulkan12Features enabled_features_12_{};
+        std::unique_ptr<Profiler> profiler_;
+        // gpu zones of the async compute queue, null without a separate compute family
+        std::unique_ptr<Profiler> compute_profiler_;
 
-        VkSwapchainKHR swapchain_;
+        UniqueSwapchain swapchain_;
+        // in headless mode these are the offscreen targets, one per frame in flight
         std::vector<VkImage> swapchain_images_;
-        std::vector<VkImageView> swapchain_image_views_;
-        std::vector<VkFramebuffer> swapchain_framebuffers_;
+        std::vector<Allocation> offscreen_allocations_;
         VkSurfaceFormatKHR swapchain_format_;
+        VkFormat depth_format_;
         VkExtent2D swapchain_extent_;
+        // requested mode, falls back to the closest supported one
+        VkPresentModeKHR requested_present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+        VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+        // ask for the fewest swapchain images the present mode allows
+        bool low_latency_ = false;
+        // resized, out of date or settings changed, recreated before the next frame;
+        // also set by the submit job and the resize callback
+        std::atomic<bool> swapchain_dirty_{ false };
 
         std::vector<VkQueueFamilyProperties> queue_families_;
         std::set<uint32_t> using_queue_family_indices_;
+        uint32_t graphics_queue_family_index_;
+        uint32_t present_queue_family_index_;
+        // same as the graphics family when there is no transfer only family
+        uint32_t transfer_queue_family_index_;
+        // a compute only family for post processing, else the graphics family;
+        // culling is always recorded into the frame's command buffer
+        uint32_t compute_queue_family_index_;
+        VkQueue graphics_queue_;
+        VkQueue present_queue_;
+        VkQueue transfer_queue_;
+        VkQueue compute_queue_;
 
-        VkRenderPass render_pass_;
-        VkPipelineLayout pipeline_layout_;
-        VkPipeline graphics_pipeline_;
+        // owns the scene images, presented through its composite
+        std::unique_ptr<PostProcessor> post_processor_;
+        // post process on the compute queue when there is one, toggled for comparisons
+        bool async_compute_ = true;
+        // scales the scene below the swapchain extent to stay within a gpu frame time budget, off by default
+        std::unique_ptr<DynamicResolution> dynamic_resolution_;
+        // extent of the render graph, the top left of the scene images
+        VkExtent2D render_extent_;
 
-        VkCommandPool command_pool_;
+        // owns the render passes, framebuffers and the depth buffer
+        std::unique_ptr<RenderGraph> render_graph_;
+        uint32_t scene_color_;
+        uint32_t depth_buffer_;
+        uint32_t culling_pass_;
+        uint32_t main_pass_;
+        // secondaries the main pass is split into this frame, 0 records inline
+        uint32_t chunk_count_ = 0;
+        std::unique_ptr<PipelineCache> pipeline_cache_;
+        std::unique_ptr<PipelineLibrary> pipeline_library_;
+        UniquePipelineLayout pipeline_layout_;
+        // library id of the test triangle pipeline
+        uint32_t graphics_pipeline_;
+        // waiting for the pipelines needed at startup, prewarmed variants included
+        double pipeline_creation_ms_ = 0.0;
+        std::unique_ptr<Renderer> renderer_;
+
+        // frames are recorded as jobs, scene recording is split across the workers into secondary command buffers
+        std::unique_ptr<util::JobSystem> job_system_;
+        // primary pool and buffer per frame in flight
+        std::vector<UniqueCommandPool> command_pools_;
         std::vector<VkCommandBuffer> command_buffers_;
+        // async frames composite in a second batch, after the geometry batch
+        std::vector<VkCommandBuffer> composite_command_buffers_;
+        // [frame][worker], each pool is only touched by its worker; the last worker
+        // is the thread calling DrawFrame, which runs jobs while it waits
+        std::vector<std::vector<UniqueCommandPool>> worker_command_pools_;
+        std::vector<std::vector<std::vector<VkCommandBuffer>>> secondary_command_buffers_;
+        // secondary buffers handed out per worker in the frame being recorded
+        std::vector<uint32_t> secondary_command_buffers_used_;
+        std::vector<VkCommandBuffer> recorded_secondaries_;
+
+        // frame pacing, one entry per frame in flight
+        uint32_t frames_in_flight_;
+        uint32_t current_frame_ = 0;
+        std::vector<UniqueSemaphore> image_available_semaphores_;
+        std::vector<UniqueSemaphore> render_finished_semaphores_;
+        // timeline semaphore signalled with its frame number by each frame's last graphics batch
+        UniqueSemaphore frame_semaphore_;
+        uint64_t frame_number_ = 0;
+        // frame number each frame slot submitted last, 0 for none
+        std::vector<uint64_t> frame_numbers_;
+        // frame number of the frame currently using each swapchain image
+        std::vector<uint64_t> images_in_flight_;
+
+        FrameSubmission submission_{};
+        // Submits and presents the last frame while the caller works on the next
+        // one. Owns the queues, the swapchain and submission_ until it finishes.
+        util::JobSystem::JobHandle submit_job_;
+
+        // number of times the test triangle is drawn per frame
+        uint32_t draw_count_ = 1;
+        // one per draw, pushed as constants
+        std::vector<Matrix4> draw_transforms_ = { kIdentityMatrix };
 
     public:
-        VulkanManager(GLFWwindow* window, uint32_t width, uint32_t height);
+        // worker_threads 0 uses one worker per spare hardware thread
+        VulkanManager(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t frames_in_flight = 2, uint32_t worker_threads = 0);
+        // headless
+        VulkanManager(uint32_t width, uint32_t height, uint32_t frames_in_flight = 2, uint32_t worker_threads = 0);
         ~VulkanManager();
 
+        // Returns once the frame is recorded; it is submitted and presented by a
+        // job meanwhile, which the next DrawFrame or WaitIdle waits for.
+        void DrawFrame();
+        void WaitIdle();
+
     private:
+        double GetStartupElapsed() const;
+        void RunStartupPhase(const char* name, const std::function<void()>& work);
+        // as jobs, returns once all of them have finished and rethrows the first failure
+        void RunStartupPhases(const std::vector<std::pair<const char*, std::function<void()>>>& phases);
+        void CreateHostAllocator();
         void CreateInstance();
         void CreateSurface(GLFWwindow* window);
         void GetPhysicalDeviceAndQueuesFamilies();
         void CreateDevice();
-        void CreateSwapchain(uint32_t width, uint32_t height);
-        void CreateRenderPass();
-        VkShaderModule CreateShaderModule(const std::string& filename);
+        void CreateAllocator();
+        void CreateDeletionQueue();
+        void CreateProfiler();
+        void CreateUploadManager();
+        void CreateBindlessHeap();
+        void CreateUniformRing();
+        void CreateAssetStreamer();
+        void CreateFrameCapture();
+        void CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
+        void RecreateSwapchain();
+        void CreateOffscreenTargets(uint32_t width, uint32_t height);
+        void ChooseDepthFormat();
+        void CreateDynamicResolution();
+        void CreatePostProcessor();
+        void CreateRenderGraph();
+        void CreatePipelineCache();
+        void CreatePipelineLibrary();
         void CreateGraphicsPipeline();
-        void CreateFramebuffers();
-        void CreateCommandPool();
+        void CreateRenderer();
+        void PrewarmPipelines();
+        void CreateJobSystem(uint32_t worker_threads);
+        void CreateCommandPools();
         void CreateCommandBuffers();
+        void CreateSyncObjects();
+        // recompiles the render graph
+        void ApplyRenderExtent(VkExtent2D extent);
+        void SubmitFrame();
+        // signals the timeline values of a frame that failed before it was submitted
+        void AbandonFrame();
+        void WaitForSubmit();
+        // returns at once for 0
+        void WaitForFrame(uint64_t frame_number);
+        // last frame number whose graphics work has finished, without waiting
+        uint64_t GetRetiredFrame() const;
+        void RecordCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index, bool async);
+        void RecordCompositeCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index);
+        void RecordComposite(VkCommandBuffer command_buffer, uint32_t image_index);
+        void RecordMainPass(const RenderGraph::PassContext& context);
+        void RecordScene(VkCommandBuffer command_buffer, uint32_t first_draw, uint32_t draw_count);
+        VkCommandBuffer GetSecondaryCommandBuffer(uint32_t worker);
+        static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
 
     public:
         // getters
+        bool IsHeadless() const { return headless_; }
+        const char* GetDeviceName() const { return physical_device_properties_.deviceName; }
+        VkExtent2D GetExtent() const { return swapchain_extent_; }
+        // what the scene renders at, below GetExtent with dynamic resolution
+        VkExtent2D GetRenderExtent() const { return render_extent_; }
+        DynamicResolution& GetDynamicResolution() { return *dynamic_resolution_; }
+        VkPresentModeKHR GetPresentMode() const { return present_mode_; }
+        MemoryAllocator& GetAllocator() { return *allocator_; }
+        HostAllocator& GetHostAllocator() { return *host_allocator_; }
+        const std::array<uint64_t, HostAllocator::kScopeCount>& GetFrameHostAllocations() const { return frame_host_allocations_; }
+        DeletionQueue& GetDeletionQueue() { return *deletion_queue_; }
+        UploadManager& GetUploadManager() { return *upload_manager_; }
+        BindlessHeap& GetBindlessHeap() { return *bindless_heap_; }
+        UniformRing& GetUniformRing() { return *uniform_ring_; }
+        AssetStreamer& GetAssetStreamer() { return *asset_streamer_; }
+        FrameCapture& GetFrameCapture() { return *frame_capture_; }
+        bool IsCaptureAvailable() const { return capture_available_; }
+        Renderer& GetRenderer() { return *renderer_; }
+        Profiler& GetProfiler() { return *profiler_; }
+        // null without a separate compute family
+        Profiler* GetComputeProfiler() { return compute_profiler_.get(); }
+        PostProcessor& GetPostProcessor() { return *post_processor_; }
+        bool IsAsyncComputeAvailable() const { return post_processor_->IsAsyncAvailable(); }
+        // post processing runs on the compute queue
+        bool IsAsyncCompute() const { return async_compute_ && post_processor_->IsAsyncAvailable(); }
+        RenderGraph& GetRenderGraph() { return *render_graph_; }
+        uint32_t GetWorkerThreadCount() const { return job_system_->GetThreadCount(); }
+        // for the caller's own jobs, such as simulating the next frame while this one is submitted
+        util::JobSystem& GetJobSystem() { return *job_system_; }
+        // signalled with the frame number once a frame's graphics work has finished
+        VkSemaphore GetFrameSemaphore() const { return frame_semaphore_.Get(); }
+        uint64_t GetFrameNumber() const { return frame_number_; }
+        double GetPipelineCreationTime() const { return pipeline_creation_ms_; }
+        const std::vector<StartupPhase>& GetStartupPhases() const { return startup_phases_; }
+        // constructor wall clock
+        double GetStartupTime() const { return startup_ms_; }
+        // from the constructor starting until the first frame was submitted, 0 before that
+        double GetFirstFrameTime() const { return first_frame_ms_; }
+        bool IsPipelineCacheWarm() const { return pipeline_cache_->IsWarm(); }
+        PipelineLibrary& GetPipelineLibrary() { return *pipeline_library_; }
+
+        // setters
+        // new draws start with the identity transform
+        void SetDrawCount(uint32_t draw_count) { draw_count_ = draw_count; draw_transforms_.resize(draw_count, kIdentityMatrix); }
+        void SetDrawTransform(uint32_t draw, const Matrix4& transform) { draw_transforms_[draw] = transform; }
+        // the camera of the test triangles and the renderer, written to the globals once per frame
+        void SetViewProjection(const Matrix4& view_projection) { view_projection_ = view_projection; renderer_->SetViewProjection(view_projection); }
+        // Every composited frame is copied back and handed to consumer on the capture
+        // thread a few frames later, null stops capturing. Set between frames.
+        void SetCaptureConsumer(FrameCapture::Consumer consumer);
+        // ignored without a separate compute family, post processing stays on the graphics queue
+        void SetAsyncCompute(bool async_compute) { async_compute_ = async_compute; }
+        // take effect when the swapchain is recreated before the next frame
+        void SetPresentMode(VkPresentModeKHR present_mode) { requested_present_mode_ = present_mode; swapchain_dirty_ = !headless_; }
+        void SetLowLatency(bool low_latency) { low_latency_ = low_latency; swapchain_dirty_ = !headless_; }
     };
 }
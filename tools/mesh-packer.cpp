@@ -0,0 +1,180 @@
+#include "pch.h"
+
+#include <sstream>
+
+// Packs a Wavefront OBJ file into the renderer's binary mesh format.
+//
+// usage: vulkan-demo-2-mesh-packer INPUT.obj OUTPUT [--lods N] [--overdraw F]
+//
+// --lods is the number of simplified lods to add after the full resolution one,
+// fewer are written once simplifying stops paying off. --overdraw is how much the
+// cache miss ratio may grow in exchange for less overdraw, 1 disables the overdraw
+// reordering. Faces are triangulated as fans, groups and materials are ignored
+// and the result is a single mesh.
+
+namespace
+{
+    struct Options
+    {
+        std::string input;
+        std::string output;
+        vk::MeshBuilder::Config builder;
+    };
+
+    Options ParseOptions(int argc, char** argv)
+    {
+        Options options;
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0)
+            {
+                paths.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            std::string value = argv[++i];
+
+            if (arg == "--lods") options.builder.lod_count = std::stoul(value);
+            else if (arg == "--overdraw") options.builder.overdraw_threshold = std::stof(value);
+            else throw std::runtime_error("Unknown argument: " + arg);
+        }
+        if (paths.size() != 2)
+            throw std::runtime_error("usage: vulkan-demo-2-mesh-packer INPUT.obj OUTPUT [--lods N] [--overdraw F]");
+        options.input = paths[0];
+        options.output = paths[1];
+        return options;
+    }
+
+    // 1 based, negative counts back from the last element
+    uint32_t ObjIndex(const std::string& token, size_t count)
+    {
+        long index = std::stol(token);
+        long resolved = index < 0 ? (long)count + index : index - 1;
+        if (resolved < 0 || resolved >= (long)count)
+            throw std::runtime_error("OBJ index out of range: " + token);
+        return static_cast<uint32_t>(resolved);
+    }
+
+    void LoadObj(const std::string& path, std::vector<vk::Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to read file: " + path);
+
+        std::vector<std::array<float, 3>> positions, normals;
+        std::vector<std::array<float, 2>> uvs;
+        // position, uv and normal index of each vertex, ~0u where missing
+        std::map<std::array<uint32_t, 3>, uint32_t> unique;
+        bool missing_normals = false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string type;
+            stream >> type;
+
+            if (type == "v")
+            {
+                std::array<float, 3> p{};
+                stream >> p[0] >> p[1] >> p[2];
+                positions.push_back(p);
+            }
+            else if (type == "vn")
+            {
+                std::array<float, 3> n{};
+                stream >> n[0] >> n[1] >> n[2];
+                normals.push_back(n);
+            }
+            else if (type == "vt")
+            {
+                std::array<float, 2> t{};
+                stream >> t[0] >> t[1];
+                uvs.push_back(t);
+            }
+            else if (type == "f")
+            {
+                std::vector<uint32_t> face;
+                std::string corner;
+                while (stream >> corner)
+                {
+                    // v, v/vt, v//vn or v/vt/vn
+                    std::array<uint32_t, 3> key = { ~0u, ~0u, ~0u };
+                    size_t first = corner.find('/');
+                    key[0] = ObjIndex(corner.substr(0, first), positions.size());
+                    if (first != std::string::npos)
+                    {
+                        size_t second = corner.find('/', first + 1);
+                        std::string uv = corner.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+                        if (!uv.empty())
+                            key[1] = ObjIndex(uv, uvs.size());
+                        if (second != std::string::npos)
+                            key[2] = ObjIndex(corner.substr(second + 1), normals.size());
+                    }
+                    missing_normals |= key[2] == ~0u;
+
+                    auto [it, inserted] = unique.try_emplace(key, static_cast<uint32_t>(vertices.size()));
+                    if (inserted)
+                    {
+                        vk::Vertex vertex{};
+                        std::copy(positions[key[0]].begin(), positions[key[0]].end(), vertex.position);
+                        if (key[1] != ~0u)
+                            std::copy(uvs[key[1]].begin(), uvs[key[1]].end(), vertex.uv);
+                        if (key[2] != ~0u)
+                            std::copy(normals[key[2]].begin(), normals[key[2]].end(), vertex.normal);
+                        vertices.push_back(vertex);
+                    }
+                    face.push_back(it->second);
+                }
+
+                for (size_t i = 2; i < face.size(); i++)
+                    indices.insert(indices.end(), { face[0], face[i - 1], face[i] });
+            }
+        }
+
+        if (missing_normals)
+            std::cout << "warning: some vertices have no normal" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = ParseOptions(argc, argv);
+
+        std::vector<vk::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        LoadObj(options.input, vertices, indices);
+        if (indices.empty())
+            throw std::runtime_error("No faces in " + options.input);
+
+        float input_acmr = vk::ComputeAcmr(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()));
+
+        vk::MeshBuilder builder(options.builder);
+        builder.Build(vertices, indices);
+        builder.Write(options.output);
+
+        const auto& built_indices = builder.GetIndices();
+        uint32_t vertex_count = static_cast<uint32_t>(builder.GetVertices().size());
+        std::cout << vertex_count << " vertices, " << vertex_count * sizeof(vk::PackedVertex) << " bytes packed, "
+            << vertex_count * sizeof(vk::Vertex) << " as floats" << std::endl;
+        std::cout << "input: " << indices.size() / 3 << " triangles, acmr " << input_acmr << std::endl;
+
+        const auto& lods = builder.GetLods();
+        for (size_t i = 0; i < lods.size(); i++)
+        {
+            float acmr = vk::ComputeAcmr(built_indices.data() + lods[i].first_index, lods[i].index_count, vertex_count);
+            std::cout << "lod " << i << ": " << lods[i].index_count / 3 << " triangles, acmr " << acmr
+                << ", error " << lods[i].error << std::endl;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+}